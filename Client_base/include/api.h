@@ -8,11 +8,28 @@ typedef struct {
   int victory;
   int game_over;
   int accumulated_points;
+  int offset_x; // posição do viewport no nível
+  int offset_y;
   char* data;
 } Board;
 
+/// Define o viewport (em células) anunciado ao servidor no próximo connect, 0 = tabuleiro inteiro.
+void pacman_set_viewport(int width, int height);
+
+/// Define o mundo partilhado onde o próximo connect entra, NULL ou "" = jogo individual.
+void pacman_set_world(char const *world_name);
+
 int pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path);
 
+/// Liga-se como espectador do jogo de target_id: recebe os mesmos frames que o jogador.
+/// @return 0 if the connection was successful, 1 otherwise (e.g. no such game).
+int pacman_spectate(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path,
+                    char const *target_id);
+
+/// @return the wait in ms the server asked for when the last connect was refused for lack of capacity,
+/// 0 if the refusal was final (or the connect succeeded).
+int pacman_retry_after(void);
+
 void pacman_play(char command);
 
 /// @return 0 if the disconnection was successful, 1 otherwise.
@@ -8,6 +8,54 @@ enum {
   OP_CODE_DISCONNECT = 2,
   OP_CODE_PLAY = 3,
   OP_CODE_BOARD = 4,
+  OP_CODE_SPECTATE = 5,
 };
 
-#endif
\ No newline at end of file
+// Codificações do tabuleiro, o cliente anuncia as que suporta no connect (máscara de bits)
+enum {
+  BOARD_ENCODING_RAW = 0,     // um símbolo ASCII por célula
+  BOARD_ENCODING_PACKED4 = 1, // duas células por byte, célula par no nibble baixo
+};
+#define BOARD_ENCODING_BIT(encoding) (1 << (encoding))
+
+// Códigos de 4 bits das células, cada código é o índice do seu símbolo em BOARD_SYMBOLS
+enum {
+  CELL_EMPTY = 0,
+  CELL_WALL = 1,
+  CELL_PACMAN = 2,
+  CELL_GHOST = 3,
+  CELL_CHARGED_GHOST = 4,
+  CELL_DOT = 5,
+  CELL_PORTAL = 6,
+};
+#define BOARD_SYMBOLS " #CMG.@"
+
+// Transporte dos frames e das jogadas depois do connect
+enum {
+  TRANSPORT_FIFO = 0, // pelos pipes do cliente
+  TRANSPORT_SHM = 1,  // pelo segmento de memória partilhada criado pelo cliente
+};
+
+// Connect: OP + pipe de pedidos + pipe de notificações + largura e altura do viewport (0 = tabuleiro inteiro)
+//          + máscara de codificações suportadas + nome do segmento partilhado ("" = só pipes)
+//          + nome do mundo partilhado onde entrar ("" = jogo individual)
+#define CONNECT_REQUEST_SIZE (1 + 4 * MAX_PIPE_PATH_LENGTH + 3 * sizeof(int))
+
+// Spectate: mesmo formato do connect, mas o último campo é o id do jogador a ver (sem memória partilhada).
+//           O espectador recebe os frames do jogador tal como são enviados (mesmo viewport e codificação)
+
+// Resultado do connect
+enum {
+  CONNECT_OK = 0,
+  CONNECT_REFUSED = 1, // p.ex. mundo cheio ou jogo inexistente
+  CONNECT_BUSY = 2,    // servidor sem capacidade, tentar de novo depois de retry_after_ms
+};
+
+// Resposta ao connect: OP + resultado + transporte aceite + retry_after_ms (int, só com CONNECT_BUSY)
+#define CONNECT_ACK_SIZE (3 + sizeof(int))
+
+// Board: OP + width, height, tempo, victory, game_over, points, offset_x, offset_y, encoding
+//        + width * height células na codificação indicada
+#define BOARD_HEADER_SIZE (1 + 9 * sizeof(int))
+
+#endif
@@ -1,6 +1,7 @@
 #include "../../include/api.h"
 #include "../../include/protocol.h"
 #include "../../include/debug.h"
+#include "shm_channel.h"
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -8,8 +9,10 @@
 #include <stdio.h>
 #include <sys/stat.h>
 #include <stdlib.h>
-
-#define BOARD_HEADER_SIZE (1 + 6 * sizeof(int))
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 struct Session {
   char op_code;
@@ -17,10 +20,32 @@ struct Session {
   int fd_notif_pipe;
   char req_pipe_path[MAX_PIPE_PATH_LENGTH + 1];
   char notif_pipe_path[MAX_PIPE_PATH_LENGTH + 1];
+  int view_width;
+  int view_height;
+  char world_name[MAX_PIPE_PATH_LENGTH]; // mundo partilhado onde entrar ("" = jogo individual)
+  int use_socket;        // registo do servidor é um socket SOCK_SEQPACKET: um só fd, sem FIFOs
+  int spectating;        // só recebe frames, as jogadas são ignoradas
+  shm_channel_t *shm;    // segmento partilhado com o servidor (NULL = só pipes)
+  char *frame;           // cópia local do último frame lido (segmento ou socket)
+  int frame_capacity;
+  unsigned int frame_seq;
+  int retry_after_ms;    // espera pedida pelo servidor na última recusa por falta de capacidade
 };
 
 static struct Session session = {.op_code = -1};
 
+void pacman_set_viewport(int width, int height) {
+    session.view_width = (width > 0) ? width : 0;
+    session.view_height = (height > 0) ? height : 0;
+}
+
+void pacman_set_world(char const *world_name) {
+    memset(session.world_name, 0, sizeof(session.world_name));
+    if (world_name) {
+        strncpy(session.world_name, world_name, MAX_PIPE_PATH_LENGTH - 1);
+    }
+}
+
 static int read_all(int fd, void *buf, size_t len) {
     size_t total = 0;
     while (total < len) {
@@ -31,88 +56,215 @@ static int read_all(int fd, void *buf, size_t len) {
     return 1;
 }
 
-int pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path) {
+/*Função auxiliar que liga ao socket de registo do servidor, devolve o fd ou -1*/
+static int connect_server_socket(char const *server_path) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd == -1) return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, server_path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*Função auxiliar com o connect comum a jogadores (target NULL) e espectadores (id do jogador a ver)*/
+static int open_session(char op_code, char const *req_pipe_path, char const *notif_pipe_path,
+                        char const *server_pipe_path, char const *target) {
     debug("Connecting to server...\n");
+    session.spectating = (target != NULL);
+    session.retry_after_ms = 0;
+
+    // 0. Um registo do tipo socket dispensa os FIFOs: os caminhos só identificam o cliente
+    struct stat st;
+    session.use_socket = (stat(server_pipe_path, &st) == 0 && S_ISSOCK(st.st_mode));
 
     // 1. Criar os pipes do cliente
-    if (mkfifo(req_pipe_path, 0666) == -1 ) {
-        debug("Failed to create client request FIFO\n");
-        return 1;
+    if (session.use_socket) {
+        debug("Server registry is a socket\n");
     }
-    if (mkfifo(notif_pipe_path, 0666) == -1 ) {
-        debug("Failed to create client notification FIFO\n");
-        unlink(req_pipe_path);
-        return 1;
+    else {
+        if (mkfifo(req_pipe_path, 0666) == -1 ) {
+            debug("Failed to create client request FIFO\n");
+            return 1;
+        }
+        if (mkfifo(notif_pipe_path, 0666) == -1 ) {
+            debug("Failed to create client notification FIFO\n");
+            unlink(req_pipe_path);
+            return 1;
+        }
+
+        debug("Client FIFOs created: %s, %s\n", req_pipe_path, notif_pipe_path);
     }
-  
-    debug("Client FIFOs created: %s, %s\n", req_pipe_path, notif_pipe_path);
 
     //2. Preparar estrutura de dados para pedido de conexão
     strncpy(session.req_pipe_path, req_pipe_path, MAX_PIPE_PATH_LENGTH);
     strncpy(session.notif_pipe_path, notif_pipe_path, MAX_PIPE_PATH_LENGTH);
 
-    char connect_req_buffer[(1 + 2 * MAX_PIPE_PATH_LENGTH) * sizeof(char)];
+    char connect_req_buffer[CONNECT_REQUEST_SIZE];
     memset(connect_req_buffer, 0, sizeof(connect_req_buffer));
 
-    connect_req_buffer[0] = OP_CODE_CONNECT;
+    connect_req_buffer[0] = op_code;
     strncpy(&connect_req_buffer[sizeof(char)], req_pipe_path, MAX_PIPE_PATH_LENGTH);
     strncpy(&connect_req_buffer[sizeof(char) + MAX_PIPE_PATH_LENGTH * sizeof(char)], notif_pipe_path, MAX_PIPE_PATH_LENGTH);
-
-    // 3. Abrir o FIFO para pedido de conexão ao servidor
-    int fd_server = open(server_pipe_path, O_WRONLY);
-    if (fd_server == -1) {
-        debug("Failed to open server FIFO\n");
-        return 1;
+    int view_offset = sizeof(char) + 2 * MAX_PIPE_PATH_LENGTH * sizeof(char);
+    memcpy(&connect_req_buffer[view_offset], &session.view_width, sizeof(int));
+    memcpy(&connect_req_buffer[view_offset + sizeof(int)], &session.view_height, sizeof(int));
+    int encodings = BOARD_ENCODING_BIT(BOARD_ENCODING_RAW) | BOARD_ENCODING_BIT(BOARD_ENCODING_PACKED4);
+    memcpy(&connect_req_buffer[view_offset + 2 * sizeof(int)], &encodings, sizeof(int));
+
+    // 2.1 Com viewport conhecido, propor frames e jogadas por memória partilhada
+    char shm_name[MAX_PIPE_PATH_LENGTH];
+    memset(shm_name, 0, sizeof(shm_name));
+    if (!target && session.view_width > 0 && session.view_height > 0) {
+        int slot_capacity = BOARD_HEADER_SIZE + session.view_width * session.view_height;
+        snprintf(shm_name, sizeof(shm_name), "/pacman_%d", (int)getpid());
+        session.shm = shm_channel_create(shm_name, slot_capacity);
+        session.frame = session.shm ? malloc(slot_capacity) : NULL;
+        session.frame_capacity = session.frame ? slot_capacity : 0;
+        if (!session.frame) {
+            shm_channel_detach(session.shm);
+            session.shm = NULL;
+            shm_unlink(shm_name);
+            memset(shm_name, 0, sizeof(shm_name));
+        }
     }
+    memcpy(&connect_req_buffer[view_offset + 3 * sizeof(int)], shm_name, MAX_PIPE_PATH_LENGTH);
 
-    // 4. Enviar pedido de conexão
-    if (write(fd_server, connect_req_buffer, sizeof(connect_req_buffer)) == -1) {
-        debug("Failed to write connection request to server\n");
-        return 1;
+    // 2.2 Um espectador usa o mesmo campo para o id do jogador que quer ver
+    if (target) {
+        strncpy(&connect_req_buffer[view_offset + 3 * sizeof(int)], target, MAX_PIPE_PATH_LENGTH - 1);
     }
-    debug("Connection request sent to server\n");
-
-    //5. Fechar o pipe do servidor, já que não é mais necessário
-    if (close(fd_server) == -1) {
-        debug("Failed to close server FIFO\n");
-        return 1;
-    }
-
-    // 6. Abrir o pipe de notificações e requests sincronizado com o Servidor
-    session.fd_notif_pipe = open(notif_pipe_path, O_RDONLY);
-    session.fd_req_pipe = open(session.req_pipe_path, O_WRONLY);
-
-    if (session.fd_notif_pipe == -1) {
-        debug("Failed to open notification FIFO\n");
-        return 1;
+    memcpy(&connect_req_buffer[view_offset + 3 * sizeof(int) + MAX_PIPE_PATH_LENGTH], session.world_name, MAX_PIPE_PATH_LENGTH);
+
+    // 3. Com socket, a mesma ligação leva o pedido, as jogadas e os frames
+    if (session.use_socket) {
+        int fd = connect_server_socket(server_pipe_path);
+        if (fd == -1 || write(fd, connect_req_buffer, sizeof(connect_req_buffer)) == -1) {
+            debug("Failed to send connection request to server socket\n");
+            if (fd != -1) close(fd);
+            goto open_session_failed;
+        }
+        session.fd_req_pipe = fd;
+        session.fd_notif_pipe = fd;
+        debug("Connection request sent to server\n");
     }
-    if (session.fd_req_pipe == -1) {
-        debug("Failed to open request FIFO\n");
-        return 1;
+    else {
+        // 3. Abrir o FIFO para pedido de conexão ao servidor
+        int fd_server = open(server_pipe_path, O_WRONLY);
+        if (fd_server == -1) {
+            debug("Failed to open server FIFO\n");
+            goto open_session_failed;
+        }
+
+        // 4. Enviar pedido de conexão
+        if (write(fd_server, connect_req_buffer, sizeof(connect_req_buffer)) == -1) {
+            debug("Failed to write connection request to server\n");
+            close(fd_server);
+            goto open_session_failed;
+        }
+        debug("Connection request sent to server\n");
+
+        //5. Fechar o pipe do servidor, já que não é mais necessário
+        if (close(fd_server) == -1) {
+            debug("Failed to close server FIFO\n");
+            goto open_session_failed;
+        }
+
+        // 6. Abrir o pipe de notificações e requests sincronizado com o Servidor
+        session.fd_notif_pipe = open(notif_pipe_path, O_RDONLY);
+        session.fd_req_pipe = open(session.req_pipe_path, O_WRONLY);
+
+        if (session.fd_notif_pipe == -1 || session.fd_req_pipe == -1) {
+            debug("Failed to open %s FIFO\n", (session.fd_notif_pipe == -1) ? "notification" : "request");
+            if (session.fd_notif_pipe != -1) close(session.fd_notif_pipe);
+            if (session.fd_req_pipe != -1) close(session.fd_req_pipe);
+            goto open_session_failed;
+        }
     }
 
 
     // 7. Ler a resposta de conexão (ack)
-    char connect_resp_buffer[2 * sizeof(char)];
+    char connect_resp_buffer[CONNECT_ACK_SIZE];
 
-    if(read_all(session.fd_notif_pipe, connect_resp_buffer, sizeof(connect_resp_buffer)) == -1) {
+    int ack_status = read_all(session.fd_notif_pipe, connect_resp_buffer, sizeof(connect_resp_buffer));
+
+    // 7.1 O servidor já mapeou (ou recusou) o segmento, o nome deixa de ser necessário
+    if (shm_name[0] != '\0') {
+        shm_unlink(shm_name);
+    }
+    if (ack_status == -1) {
+        pacman_disconnect();
         return 1;
     }
     char op, result;
     memcpy(&op, &connect_resp_buffer[0], sizeof(char));
     memcpy(&result, &connect_resp_buffer[1], sizeof(char));
 
-    if (op == OP_CODE_CONNECT && result == 0) {
+    if (session.shm && connect_resp_buffer[2] != TRANSPORT_SHM) {
+        debug("Server refused shared memory, using pipes\n");
+        shm_channel_detach(session.shm);
+        free(session.frame);
+        session.shm = NULL;
+        session.frame = NULL;
+        session.frame_capacity = 0;
+    }
+    // Um servidor em corrotinas espera por jogadas no fd de pedidos, não no futex
+    if (session.shm) session.shm->nudge_fd = session.fd_req_pipe;
+
+    if (op == op_code && result == CONNECT_OK) {
         // 8. Sucesso! Agora abrimos o pipe de pedidos para enviar jogadas futuras
         debug("Connected to server successfully\n");
         return 0;
     }
 
+    // 9. Servidor ocupado: guardar a espera sugerida e libertar os pipes para a próxima tentativa
+    if (result == CONNECT_BUSY) {
+        memcpy(&session.retry_after_ms, &connect_resp_buffer[3], sizeof(int));
+        debug("Server busy, retry in %d ms\n", session.retry_after_ms);
+    }
+    pacman_disconnect();
+
     debug("Connection to server failed\n");
     return 1; // Falha na conexão
+
+    // Erro antes do ACK: o servidor nunca vai mapear o segmento, apagá-lo junto com os FIFOs
+    open_session_failed:
+    if (shm_name[0] != '\0') shm_unlink(shm_name);
+    shm_channel_detach(session.shm);
+    free(session.frame);
+    session.shm = NULL;
+    session.frame = NULL;
+    session.frame_capacity = 0;
+    if (!session.use_socket) {
+        unlink(req_pipe_path);
+        unlink(notif_pipe_path);
+    }
+    return 1;
+}
+
+int pacman_retry_after(void) {
+    return session.retry_after_ms;
+}
+
+int pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path) {
+    return open_session(OP_CODE_CONNECT, req_pipe_path, notif_pipe_path, server_pipe_path, NULL);
+}
+
+int pacman_spectate(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path,
+                    char const *target_id) {
+    return open_session(OP_CODE_SPECTATE, req_pipe_path, notif_pipe_path, server_pipe_path, target_id);
 }
 
 void pacman_play(char command) {
+    // 0. O servidor não lê jogadas de espectadores
+    if (session.spectating) {
+        return;
+    }
 
     // 1. Preparar estrutura de dados para pedido de jogada
     char play_req_buffer[2 * sizeof(char)];
@@ -125,6 +277,14 @@ void pacman_play(char command) {
         play_req_buffer[0] = OP_CODE_DISCONNECT;
     }
 
+    // 1.1 Com memória partilhada a jogada vai para o anel, sem syscall se o servidor estiver acordado
+    if (session.shm) {
+        int full = shm_channel_push_input(session.shm, play_req_buffer[0], play_req_buffer[1]);
+        if (full > 0) debug("Input ring full, dropping play request\n");
+        else if (full < 0) debug("Shared memory segment no longer valid, dropping play request\n");
+        return;
+    }
+
     // 2. Enviar pedido de jogada ao servidor
     if (write(session.fd_req_pipe, &play_req_buffer, sizeof(play_req_buffer)) == -1) {
         debug("Failed to write play request to server\n");
@@ -137,12 +297,23 @@ int pacman_disconnect() {
         debug("Failed to close request pipe\n");
         return 1;
     }
-    if (close(session.fd_notif_pipe) == -1) {
+    if (session.fd_notif_pipe != session.fd_req_pipe && close(session.fd_notif_pipe) == -1) {
         debug("Failed to close notification pipe\n");
         return 1;
     }
     debug("Client pipes closed\n");
 
+    shm_channel_detach(session.shm);
+    free(session.frame);
+    session.shm = NULL;
+    session.frame = NULL;
+    session.frame_capacity = 0;
+
+    // 1.1 Por socket não há FIFOs para apagar
+    if (session.use_socket) {
+        return 0;
+    }
+
     //2. Apagar os pipes do cliente
     if (unlink(session.req_pipe_path) == -1) {
         debug("Failed to unlink request pipe\n");
@@ -155,47 +326,138 @@ int pacman_disconnect() {
     return 0;
 }
 
+/*Função auxiliar que lê o cabeçalho de um frame, devolve a codificação ou -1*/
+static int parse_board_header(const char *header, Board *board) {
+    int off = 0;
+    char op = header[off++];
+    if (op != OP_CODE_BOARD) {
+        debug("Invalid OP code: %d\n", op);
+        return -1;
+    }
+
+    memcpy(&board->width, header + off, sizeof(int)); off += sizeof(int);
+    memcpy(&board->height, header + off, sizeof(int)); off += sizeof(int);
+    memcpy(&board->tempo, header + off, sizeof(int)); off += sizeof(int);
+    memcpy(&board->victory, header + off, sizeof(int)); off += sizeof(int);
+    memcpy(&board->game_over, header + off, sizeof(int)); off += sizeof(int);
+    memcpy(&board->accumulated_points, header + off, sizeof(int)); off += sizeof(int);
+    memcpy(&board->offset_x, header + off, sizeof(int)); off += sizeof(int);
+    memcpy(&board->offset_y, header + off, sizeof(int)); off += sizeof(int);
+    int encoding;
+    memcpy(&encoding, header + off, sizeof(int));
+    return encoding;
+}
+
+/*Função auxiliar que descodifica as células para os símbolos que o display desenha*/
+static void decode_cells(Board *board, int encoding, const unsigned char *payload) {
+    int n_cells = board->width * board->height;
+    if (encoding == BOARD_ENCODING_RAW) {
+        memcpy(board->data, payload, n_cells);
+        return;
+    }
+
+    // Duas células por byte, a célula par no nibble baixo
+    static const char symbols[16] = BOARD_SYMBOLS;
+    for (int i = 0; i < n_cells; i++) {
+        unsigned char code = (i & 1) ? (payload[i / 2] >> 4) : (payload[i / 2] & 0x0F);
+        board->data[i] = symbols[code];
+    }
+}
+
+/*Função auxiliar que espera pelo próximo frame no segmento partilhado, devolve o tamanho ou -1*/
+static int wait_shared_frame(void) {
+    while (1) {
+        int size = shm_channel_wait_frame(session.shm, &session.frame_seq, session.frame,
+                                          session.frame_capacity, 200);
+        if (size != 0) return size;
+
+        // Sem frames: o pipe de notificações só serve para detetar o fim do servidor
+        struct pollfd pfd = { .fd = session.fd_notif_pipe, .events = POLLIN };
+        if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR))) return -1;
+    }
+}
+
+/*Função auxiliar que lê um frame inteiro do socket (uma mensagem SEQPACKET), devolve o tamanho ou -1*/
+static int recv_socket_frame(void) {
+    // 1. Espreitar o tamanho da mensagem sem a consumir
+    ssize_t size = recv(session.fd_notif_pipe, NULL, 0, MSG_PEEK | MSG_TRUNC);
+    if (size <= 0) return -1;
+
+    // 2. Crescer o buffer local apenas quando o frame aumenta
+    if (size > session.frame_capacity) {
+        char *frame = realloc(session.frame, size);
+        if (!frame) return -1;
+        session.frame = frame;
+        session.frame_capacity = size;
+    }
+    return recv(session.fd_notif_pipe, session.frame, size, 0);
+}
+
 Board receive_board_update(void) {
     Board board;
     char header[BOARD_HEADER_SIZE]; // Buffer para a string de texto
 
     memset(&board, 0, sizeof(Board));
 
-    // 1. Ler a atualização do tabuleiro do pipe de notificações
-    if(read_all(session.fd_notif_pipe, header, sizeof(header)) <= 0) {
+    // 1. Ler o cabeçalho do segmento partilhado, do socket ou do pipe de notificações
+    const char *frame = NULL;
+    int frame_size = 0;
+    if (session.shm || session.use_socket) {
+        frame_size = session.shm ? wait_shared_frame() : recv_socket_frame();
+        if (frame_size < (int)BOARD_HEADER_SIZE) {
+            return board;
+        }
+        frame = session.frame;
+        memcpy(header, frame, BOARD_HEADER_SIZE);
+    }
+    else if(read_all(session.fd_notif_pipe, header, sizeof(header)) <= 0) {
         return board;
     }
     
     // 2. Processar a atualização do tabuleiro
-    int off = 0;
-    char op = header[off++];
-    if (op != OP_CODE_BOARD) {
-        debug("Invalid OP code: %d\n", op);
+    int encoding = parse_board_header(header, &board);
+    if (encoding < 0) {
         return board;
     }
 
-    memcpy(&board.width, header + off, sizeof(int)); off += sizeof(int);
-    memcpy(&board.height, header + off, sizeof(int)); off += sizeof(int);
-    memcpy(&board.tempo, header + off, sizeof(int)); off += sizeof(int);
-    memcpy(&board.victory, header + off, sizeof(int)); off += sizeof(int);
-    memcpy(&board.game_over, header + off, sizeof(int)); off += sizeof(int);
-    memcpy(&board.accumulated_points, header + off, sizeof(int));
-
-    
-
     // 3. Alocar memória para os dados do tabuleiro
-    board.data = (char*)malloc(board.width * board.height * sizeof(char));
+    int n_cells = board.width * board.height;
+    int payload_size = (encoding == BOARD_ENCODING_PACKED4) ? (n_cells + 1) / 2 : n_cells;
+    board.data = (char*)malloc(n_cells * sizeof(char));
     if (!board.data) {
         debug("Failed to allocate memory for board data\n");
         return board;
     }
 
-    // 4. Ler os dados do tabuleiro do pipe de notificações
-    if (read_all(session.fd_notif_pipe, board.data, board.width * board.height * sizeof(char)) <= 0) {
+    // 4. O frame partilhado (ou a mensagem do socket) já está todo em memória
+    if (frame) {
+        if (frame_size < (int)BOARD_HEADER_SIZE + payload_size) {
+            free(board.data);
+            board.data = NULL;
+            return board;
+        }
+        decode_cells(&board, encoding, (const unsigned char *)frame + BOARD_HEADER_SIZE);
+        return board;
+    }
+
+    // 5. Ler os dados do tabuleiro do pipe de notificações
+    if (encoding == BOARD_ENCODING_RAW) {
+        if (read_all(session.fd_notif_pipe, board.data, n_cells * sizeof(char)) <= 0) {
+            free(board.data);
+            board.data = NULL;
+        }
+        return board;
+    }
+
+    unsigned char *payload = malloc(payload_size);
+    if (!payload || read_all(session.fd_notif_pipe, payload, payload_size) <= 0) {
+        free(payload);
         free(board.data);
         board.data = NULL;
         return board;
     }
+    decode_cells(&board, encoding, payload);
+    free(payload);
 
     return board;
-}
\ No newline at end of file
+}
@@ -11,6 +11,10 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <signal.h>
+#include <sys/ioctl.h>
+
+#define UI_ROWS 5 // título, estado, linha em branco e pontuação
+#define CONNECT_ATTEMPTS 5 // tentativas de connect enquanto o servidor está ocupado
 
 Board board;
 bool stop_execution = false;
@@ -105,12 +109,23 @@ void* ncurses_thread(void *arg) {
 int main(int argc, char *argv[]) {
     signal(SIGPIPE, SIG_IGN);
 
-    if (argc != 3 && argc != 4) {
+    // Opções: -w <client_id> vê o jogo de outro cliente em vez de jogar
+    //        -j <mundo> joga no mesmo tabuleiro que os outros clientes desse mundo
+    const char *watch_id = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:j:")) != -1) {
+        if (opt == 'w') watch_id = optarg;
+        else if (opt == 'j') pacman_set_world(optarg);
+        else argc = -1;
+    }
+    if (argc - optind != 2 && argc - optind != 3) {
         fprintf(stderr,
-            "Usage: %s <client_id> <register_pipe> [commands_file]\n",
+            "Usage: %s [-w watched_client_id] [-j world] <client_id> <register_pipe> [commands_file]\n",
             argv[0]);
         return 1;
     }
+    argc -= optind - 1;
+    argv += optind - 1;
 
     // 1. Processar os argumentos
     const char *client_id = argv[1];
@@ -144,8 +159,24 @@ int main(int argc, char *argv[]) {
 
     open_debug_file("client-debug.log");
 
-    // 4. Conectar ao servidor
-    if (pacman_connect(req_pipe_path, notif_pipe_path, register_pipe) != 0) {
+    // 3.1 Anunciar o tamanho do terminal, descontando as linhas de interface
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > UI_ROWS) {
+        pacman_set_viewport(ws.ws_col, ws.ws_row - UI_ROWS);
+    }
+
+    // 4. Conectar ao servidor, como jogador ou como espectador,
+    //    voltando a tentar depois da espera pedida se o servidor estiver ocupado
+    int connected;
+    for (int attempt = 1; ; attempt++) {
+        connected = watch_id ? pacman_spectate(req_pipe_path, notif_pipe_path, register_pipe, watch_id)
+                             : pacman_connect(req_pipe_path, notif_pipe_path, register_pipe);
+        int retry_after_ms = pacman_retry_after();
+        if (connected == 0 || retry_after_ms <= 0 || attempt == CONNECT_ATTEMPTS) break;
+        debug("Server busy, attempt %d of %d in %d ms\n", attempt + 1, CONNECT_ATTEMPTS, retry_after_ms);
+        sleep_ms(retry_after_ms);
+    }
+    if (connected != 0) {
         perror("Failed to connect to server");
         return 1;
     }
@@ -125,6 +125,9 @@ void draw_board_client(Board board) {
     attron(COLOR_PAIR(5));
     mvprintw(start_row + board.height + 1, 0, "Points: %d",
              board.accumulated_points);
+    if (board.offset_x || board.offset_y) {
+        printw("  |  View: %d,%d", board.offset_x, board.offset_y);
+    }
     attroff(COLOR_PAIR(5));
 }
 
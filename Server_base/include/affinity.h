@@ -0,0 +1,57 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+
+/*
+Afinidade das tarefas do servidor a conjuntos de cores, por papel.
+Sem afinidade configurada para um papel, as suas tarefas ficam onde o sistema as puser.
+Com cores de simulação em mais do que um nó NUMA, cada mundo fica num só nó (affinity_pick_node):
+a tarefa do mundo corre nos cores desse nó e a memória que a simulação usa (o mundo, os seus
+níveis e as sessões dos jogadores) é colocada lá por política (mbind), seja qual for a tarefa
+que a aloca ou toca primeiro: no modo -C quem a aloca são os escalonadores de corrotinas, nos cores de IO.
+*/
+
+#define AFFINITY_MAX_NODES 64 // nós NUMA que cabem numa máscara do mbind
+
+enum {
+    AFFINITY_IO = 0,  // host, sessões, espectadores e escalonadores de corrotinas
+    AFFINITY_SIM = 1, // mundos, monstros e trabalhadores do tick pool
+    AFFINITY_LOG = 2, // escrita do leaderboard
+    AFFINITY_ROLES
+};
+
+/*Lê a configuração "io:sim:log", cada campo uma lista de cores como "0-3,8" (vazio = sem afinidade).
+Devolve 0 se a configuração é válida*/
+int affinity_configure(const char *spec);
+
+/*Fixa a tarefa que chama aos cores do papel*/
+void affinity_pin(int role);
+
+/*Fixa a tarefa que chama a um só core do papel, o index-ésimo (circular).
+Devolve o core escolhido, ou -1 sem afinidade para o papel*/
+int affinity_pin_one(int role, int index);
+
+/*Nó NUMA de um core (0 se o sistema não indica)*/
+int affinity_cpu_node(int cpu);
+
+/*Nó NUMA para o próximo mundo: os nós dos cores do papel, à vez. -1 sem afinidade para o papel*/
+int affinity_pick_node(int role);
+
+/*Fixa a tarefa que chama aos cores do papel que estão no nó (-1 não faz nada)*/
+void affinity_pin_node(int role, int node);
+
+/*Prefere o nó NUMA para as páginas inteiras de [addr, addr + size), mudando para lá as que
+já estão noutro. Com node -1 não faz nada*/
+void affinity_place(void *addr, size_t size, int node);
+
+/*size bytes a zero em páginas próprias, colocadas no nó como em affinity_place. NULL sem memória*/
+void *affinity_alloc(size_t size, int node);
+
+/*Muda para o nó o que affinity_alloc deu, com o mesmo size (todas as páginas, também a última)*/
+void affinity_move(void *ptr, size_t size, int node);
+
+/*Liberta o que affinity_alloc deu, com o mesmo size (NULL não faz nada)*/
+void affinity_release(void *ptr, size_t size);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 16 // alinhamento de cada alocação
+
+/*
+Memória de um nível alocada por incremento de um ponteiro, sem passar pelo malloc
+(e sem disputar os seus locks com as outras tarefas), e devolvida toda de uma vez.
+O bloco principal é dimensionado para o maior nível; o que não cabe vai para blocos
+extra que o reset liberta.
+*/
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t capacity;
+    size_t used;
+    char data[];
+} arena_block_t;
+
+typedef struct {
+    arena_block_t *block;    // bloco principal, reutilizado a cada reset
+    arena_block_t *overflow; // blocos extra, libertados no reset
+} arena_t;
+
+/*Reserva o bloco principal, devolve 0 se conseguiu (capacity 0 = só blocos extra)*/
+int arena_init(arena_t *arena, size_t capacity);
+
+/*Alocação a zeros, válida até ao próximo reset; NULL sem memória*/
+void *arena_alloc(arena_t *arena, size_t size);
+
+/*Devolve de uma vez tudo o que foi alocado*/
+void arena_reset(arena_t *arena);
+
+void arena_destroy(arena_t *arena);
+
+#endif
@@ -5,9 +5,17 @@
 #define MAX_LEVELS 20
 #define MAX_FILENAME 256
 #define MAX_GHOSTS 25
+#define MAX_PACMANS 4 // players that can share one board
+#define GHOST_LOOP_DEPTH 4 // nested REPEAT blocks in a ghost script
+
+#define NO_ENTITY -1                       // empty position in board_t.occupant
+#define GHOST_ENTITY(i) (MAX_PACMANS + (i)) // ghosts come after the pacmans in board_t.occupant
 
 #include <pthread.h>
+#include <stdint.h>
 #include "game_session.h"
+#include "protocol.h"
+#include "arena.h"
 
 typedef enum {
     REACHED_PORTAL = 1,
@@ -33,15 +41,21 @@ typedef struct {
     int waiting;
 } pacman_t;
 
+// Ghost state as parallel arrays (entry i is ghost i), so move_ghosts goes through each field in a tight loop
 typedef struct {
-    int pos_x, pos_y; //current position
-    int passo; // number of plays to wait before starting
-    command_t moves[MAX_MOVES];
-    int n_moves;
-    int current_move;
-    int waiting;
-    int charged;
-} ghost_t;
+    struct ghost_script** script; // compiled moves, shared with every ghost that has the same ones
+    int* pos_x; //current position
+    int* pos_y;
+    int* passo; // number of plays to wait before starting
+    int* waiting;
+    int* charged;
+    int* pc; // next instruction of the script
+    int* wait_left; // turns left in the current 'T n'
+    int* loop_depth;
+    int* loop_left; // iterations left in each open REPEAT, GHOST_LOOP_DEPTH per ghost
+} ghosts_t;
+
+#define GHOST_STATE_SIZE (sizeof(struct ghost_script*) + (8 + GHOST_LOOP_DEPTH) * sizeof(int)) // bytes per ghost
 
 typedef struct {
     char content; // stuff like 'P' for pacman 'M' for monster and 'W' for wall
@@ -53,41 +67,90 @@ typedef struct {
 typedef struct {
     int width, height; //dimensions of the board
     board_pos_t* board; //actual board, most likely a row-major matrix
+    unsigned char* cells; // compact CELL_* code of every position, kept in sync with board
     int n_pacmans; //number of pacmans in the board
     pacman_t* pacmans; // array containing every pacman in the board to iterate through when processing
     int n_ghosts; //number of ghosts in the board
-    ghost_t* ghosts; // array containing every ghost in the board to iterate through when processing
+    ghosts_t ghosts; // every ghost in the board, one array per field
     char level_name[256]; //name for the level file to keep track of which will be the next
     char pacman_file[256]; // file with pacman movements
     char ghosts_files[MAX_GHOSTS][256]; // files with monster movements
+    uint64_t* walls;        // bitboards, one bit per position in row-major order
+    uint64_t* dots;
+    uint64_t* portals;
+    uint64_t* ghost_cells;  // positions with a ghost ('M')
+    uint64_t* pacman_cells; // positions with a live pacman ('P')
+    short* occupant;        // per position: pacman index, GHOST_ENTITY(ghost index) or NO_ENTITY
+    int bitboard_words;     // uint64_t words in each bitboard
+    int dots_left;          // dots not eaten yet, kept up to date by move_pacman
+    int* wall_left;  // per position: column of the nearest wall to the left (-1 = none)
+    int* wall_right; // column of the nearest wall to the right (width = none)
+    int* wall_up;    // row of the nearest wall above (-1 = none)
+    int* wall_down;  // row of the nearest wall below (height = none)
+    struct flow_field* flow; // distances to the nearest pacman, only when a ghost chases ('H')
+    unsigned int rng; // rand_r state for the 'R' moves of this board, so runs with the same seed repeat
     int tempo; // Duracao de cada jogada???
     pthread_rwlock_t state_lock;
+    arena_t *arena; // memória do nível (NULL = malloc, libertada pelo unload_level)
 } board_t;
 
+// Bitboard helpers, one bit per position in row-major order
+static inline int bit_test(const uint64_t* bits, int index) {
+    return (bits[index >> 6] >> (index & 63)) & 1;
+}
+
+static inline void bit_set(uint64_t* bits, int index) {
+    bits[index >> 6] |= (uint64_t)1 << (index & 63);
+}
+
+static inline void bit_clear(uint64_t* bits, int index) {
+    bits[index >> 6] &= ~((uint64_t)1 << (index & 63));
+}
+
 /*Move pacman/monster in a certain direction on the board must check for boundaries, walls and other monsters
 Maybe do 1 function for pacman and 1 for monsters if required
 Maybe do 1 function for each direction
 */
 int move_pacman(board_t* board, int pacman_index, command_t* command);
-int move_ghost(board_t* board, int ghost_index, command_t* command);
+/*Moves every ghost whose turn it is (due[i] != 0, all of them if due is NULL) in one batch:
+waits, script commands and target cells for all ghosts first, then the moves in ghost order*/
+void move_ghosts(board_t* board, const unsigned char* due);
+/*Charges a ghost in direction until the nearest wall or ghost, or onto the first live pacman (killed)*/
+int move_ghost_charged(board_t* board, int ghost_index, char direction);
 
 /*Remove an object (Pacman)*/
 void kill_pacman(board_t* board, int pacman_index);
 
-/*Adds a pacman to the board from a file*/
-int load_pacman(board_t* board, GameSession *session, int points);
+/*Places the pacman of a player on the first free dot of the board*/
+int load_pacman(board_t* board, int pacman_index, int points);
+
+/*Places a pacman at (x, y), or like load_pacman if that position is outside, a wall or taken*/
+int load_pacman_at(board_t* board, int pacman_index, int points, int x, int y);
 
 /*Adds a ghost to the board from a file*/
 int load_ghost(board_t* board);
 
+/*Allocates the state of the board's n_ghosts ghosts, returns -1 if it could not*/
+int alloc_ghosts(board_t* board);
+
 
 /*
 Fils the board with the information coming from the file
+Pacmans are placed afterwards, one load_pacman per player
 */
-int load_level(board_t* board, GameSession* session, char* filename, char* dirname, int accumulated_points);
-// Unloads levels loaded by load_level
+int load_level(board_t* board, char* filename, char* dirname);
+/*Copies a level loaded by load_level (and not played) into board, in board's arena, without touching any file.
+The ghost scripts are shared with the original*/
+int copy_level(board_t* board, const board_t* from);
+// Unloads levels loaded by load_level or copy_level
 void unload_level(board_t * board);
 
+/*Memória de um nível com estas dimensões numa arena (tabuleiro, pacmans e o máximo de monstros)*/
+size_t level_memory_size(int width, int height);
+
+/*Aloca memória do nível a zeros, na arena do tabuleiro se tiver uma*/
+void *level_alloc(board_t *board, size_t count, size_t size);
+
 void sleep_ms(int milliseconds);
 
 #endif
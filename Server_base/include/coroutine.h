@@ -0,0 +1,68 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+/*
+Corrotinas com pilha própria (ucontext) multiplexadas em poucas tarefas do sistema, os escalonadores.
+Uma corrotina corre sempre no mesmo escalonador. As esperas (coro_sleep_ms, coro_poll) cedem o
+escalonador às outras corrotinas em vez de o bloquear; fora de uma corrotina são um sleep_ms e um poll.
+Uma corrotina nunca bloqueia o escalonador: os locks que também são tomados por corrotinas
+são pedidos com coro_mutex_lock / coro_rwlock_*, que a põem numa fila de espera do lock enquanto
+está ocupado, e as escritas para clientes usam fds não bloqueantes com coro_write, que cede
+enquanto dão EAGAIN. Quem larga um destes locks, corrotina ou não, usa coro_mutex_unlock /
+coro_rwlock_unlock, que acordam a fila; por isso não podem ser largados por uma variável de
+condição (pthread_cond_wait): as esperas por uma mudança são feitas num contador (coro_wait).
+Uma corrotina pode ceder com um destes locks trancado: as outras que o querem ficam na fila,
+em vez de bloquear a tarefa para sempre.
+*/
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#define CORO_STACK_SIZE (128 * 1024) // reservada sem ocupar memória, só as páginas usadas contam
+
+/*Arranca n_threads escalonadores (0 = um por core), devolve 0 se conseguiu.
+As corrotinas herdam a máscara de sinais de quem chama*/
+int coro_start(int n_threads);
+
+/*Cria uma corrotina que corre fn(arg) num dos escalonadores, a partir de qualquer tarefa.
+Devolve 0 se conseguiu*/
+int coro_spawn(void (*fn)(void *), void *arg);
+
+/*1 se quem chama é uma corrotina*/
+int coro_running(void);
+
+/*Passa a vez às outras corrotinas prontas do mesmo escalonador*/
+void coro_yield(void);
+
+void coro_sleep_ms(int milliseconds);
+
+/*Dorme até ao instante deadline_ms do CLOCK_MONOTONIC (em milissegundos), sem escorregar com o trabalho feito antes*/
+void coro_sleep_until_ms(long long deadline_ms);
+
+/*Espera por eventos num fd, como poll() com um só fd (timeout -1 = sem limite).
+Devolve os eventos ocorridos, 0 se o tempo acabou, -1 em erro*/
+int coro_poll(int fd, short events, int timeout_ms);
+
+/*Tranca o mutex; numa corrotina espera na fila do lock enquanto estiver ocupado, em vez de bloquear*/
+void coro_mutex_lock(pthread_mutex_t *mutex);
+
+/*Larga o mutex e acorda a primeira corrotina à espera dele*/
+void coro_mutex_unlock(pthread_mutex_t *mutex);
+
+/*Como coro_mutex_lock e coro_mutex_unlock, para um rwlock*/
+void coro_rwlock_rdlock(pthread_rwlock_t *lock);
+void coro_rwlock_wrlock(pthread_rwlock_t *lock);
+void coro_rwlock_unlock(pthread_rwlock_t *lock);
+
+/*Espera enquanto *word == value, até timeout_ms (-1 = sem limite) ou até um coro_wake(word).
+Numa corrotina cede o escalonador; fora dela dorme num futex. Devolve 1 se *word mudou*/
+int coro_wait(int *word, int value, int timeout_ms);
+
+/*Acorda quem espera em coro_wait(word), depois de *word ter mudado*/
+void coro_wake(int *word);
+
+/*Escreve size bytes em fd; num fd não bloqueante espera (coro_poll) enquanto dá EAGAIN.
+Devolve size, ou -1 em erro (o que já foi escrito fica escrito)*/
+ssize_t coro_write(int fd, const void *buf, size_t size);
+
+#endif
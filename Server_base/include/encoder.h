@@ -0,0 +1,27 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include "protocol.h"
+
+// Implementações das duas codificações, por conjunto de instruções
+enum {
+    ENCODER_SCALAR = 0,
+    ENCODER_SSSE3 = 1, // pshufb para os símbolos, SSE2 para juntar em nibbles
+    ENCODER_AVX2 = 2,
+    ENCODER_ISAS
+};
+
+/*Escolhe, conforme o CPU, a melhor implementação vetorial das duas codificações*/
+void encoder_init(void);
+
+/*Passa a usar as implementações do conjunto de instruções isa (ENCODER_*).
+Devolve 0, ou -1 se o CPU (ou a arquitetura compilada) não o tem*/
+int encoder_use(int isa);
+
+/*Número de bytes que n células ocupam na codificação indicada*/
+int encoded_size(int n_cells, int encoding);
+
+/*Codifica n códigos de célula (CELL_*) para out, devolve o número de bytes escritos*/
+int encode_cells(const unsigned char *cells, int n_cells, int encoding, char *out);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef FLOW_FIELD_H
+#define FLOW_FIELD_H
+
+#include <limits.h>
+#include "board.h"
+
+#define FLOW_UNREACHABLE INT_MAX // posição sem caminho para nenhum pacman vivo
+
+/*
+Campo de distâncias partilhado pelos monstros que perseguem (comando 'H'): para cada posição,
+os passos até ao pacman vivo mais próximo, contornando as paredes.
+Um pacman que se mexe um passo muda a distância de quase todas as posições, por isso o campo não
+é reparado a cada jogada: as jogadas, entradas e mortes só o marcam como desatualizado, e o
+primeiro monstro que persegue refaz o BFS a partir de todos os pacmans. Fica um BFS por ronda de
+monstros (mais um por cada pacman morto a meio dela), e nenhum se ninguém persegue.
+É estado do nível como o resto do tabuleiro, protegido pelo state_lock.
+*/
+typedef struct flow_field {
+    int *dist;   // passos até ao pacman mais próximo
+    int *queue;  // fila do BFS
+    int stale;   // algum pacman mexeu-se, entrou ou morreu desde o último BFS
+} flow_field_t;
+
+/*Cria o campo do nível (sem pacmans), devolve 0 se conseguiu*/
+int flow_field_init(board_t *board);
+
+/*Marca o campo como desatualizado depois de um pacman mudar de posição, entrar ou morrer (sem campo não faz nada)*/
+void flow_field_invalidate(board_t *board);
+
+/*Direção ('W', 'A', 'S', 'D') que aproxima quem está em (x, y) do pacman mais próximo, 0 se nenhuma*/
+char flow_field_step(board_t *board, int x, int y);
+
+/*Memória do campo para um nível com estas dimensões*/
+size_t flow_field_size(int width, int height);
+
+#endif
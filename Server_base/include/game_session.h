@@ -2,17 +2,38 @@
 #define GAME_SESSION_H
 
 #include <pthread.h>
+#include "shm_channel.h"
+
+#define MAX_CLIENT_ID_LENGTH 32
+
+struct spectator_list; // definida em spectator.c
+struct frame;          // definida em spectator.h
 
 typedef struct {
     int active;           // Flag para parar as threads
     int fd_req;           // Ler do cliente
     int fd_notif;         // Escrever para o cliente
+    shm_channel_t *shm;   // Frames e jogadas por memória partilhada (NULL = pelos pipes)
+    char client_id[MAX_CLIENT_ID_LENGTH]; // Extraído do nome dos pipes do cliente
+    struct spectator_list *spectators;    // Quem está a ver este jogo (NULL fora de jogo)
+    struct frame *frame;  // Último frame enviado, preenchido de novo quando os espectadores o largam
+    int sndbuf;           // Socket: bytes pedidos para o buffer de envio (0 = o do sistema)
     
-    // Dados do Jogo
-    pthread_mutex_t lock; // Protege o acesso ao jogo
-    char *grid;           // O array do tabuleiro
-    int width;
+    // Dados do Jogo (protegidos pelo lock do mundo onde o jogador está)
+    unsigned char *cells; // Códigos (CELL_*) das células dentro do viewport
+    char *grid;           // Janela do tabuleiro já codificada para enviar ao cliente
+    int grid_width;       // Dimensões atuais do viewport
+    int grid_height;
+    int grid_bytes;       // Tamanho de grid na codificação negociada
+    int encoding;         // Codificação negociada no connect (BOARD_ENCODING_*)
+    int width;            // Dimensões do nível
     int height;
+    int view_width;       // Viewport pedido pelo cliente (0 = tabuleiro inteiro)
+    int view_height;
+    int view_x;           // Canto superior esquerdo do viewport no nível
+    int view_y;
+    int pacman_index;     // Pacman do jogador no tabuleiro do seu mundo
+    int first_level;      // Primeiro nível do mundo que o jogador joga (world->level desse nível)
     int pacman_x;
     int pacman_y;
     int tempo;
@@ -0,0 +1,77 @@
+#ifndef GHOST_SCRIPT_H
+#define GHOST_SCRIPT_H
+
+#include "board.h"
+
+/*
+Movimentos dos monstros (ficheiros .m) compilados no carregamento para um bytecode.
+Cada instrução é um opcode de um byte; GOP_WAIT, GOP_REPEAT e GOP_END levam um int a seguir.
+Os programas são imutáveis e partilhados: monstros, níveis e mundos com os mesmos movimentos
+apontam para a mesma cópia (contagem de referências). O estado de execução (pc, espera, voltas)
+fica nos arrays dos monstros (ghosts_t).
+
+Além de W, A, S, D, R, C, H e "T n", um .m pode repetir um bloco:
+    REPEAT n
+    ...
+    END
+com até GHOST_LOOP_DEPTH blocos encaixados. No fim do programa o monstro volta ao início.
+Os pacmans do modo headless (ficheiro PAC do nível) usam os mesmos programas.
+*/
+
+enum {
+    GOP_UP = 0,     // 'W' (as direções na ordem da escolha aleatória do 'R')
+    GOP_DOWN = 1,   // 'S'
+    GOP_LEFT = 2,   // 'A'
+    GOP_RIGHT = 3,  // 'D'
+    GOP_RANDOM,     // 'R'
+    GOP_CHARGE,     // 'C'
+    GOP_CHASE,      // 'H'
+    GOP_WAIT,       // "T n": fica n turnos parado
+    GOP_REPEAT,     // "REPEAT n": corre o bloco até ao GOP_END n vezes
+    GOP_END,        // fim do bloco, operando = início do corpo
+};
+
+typedef struct ghost_script {
+    struct ghost_script *next; // tabela de programas partilhados
+    unsigned int hash;
+    int refcount;
+    int has_chase;             // algum GOP_CHASE (o nível precisa do campo de distâncias)
+    int size;                  // bytes de code, 0 = monstro parado
+    unsigned char code[];
+} ghost_script_t;
+
+typedef struct {
+    unsigned char *code;
+    int size;
+    int capacity;
+    int loops[GHOST_LOOP_DEPTH]; // início de cada REPEAT aberto
+    int loop_moves[GHOST_LOOP_DEPTH]; // moves quando o REPEAT abriu
+    int depth;
+    int skipped;                 // REPEAT ignorados (encaixe a mais), para ignorar os seus END
+    int moves;                   // instruções que gastam um turno
+    int failed;
+} ghost_script_builder_t;
+
+/*Começa a compilação de um .m*/
+void ghost_script_begin(ghost_script_builder_t *builder);
+
+/*Compila uma linha de movimentos. Devolve 0, ou -1 se a linha não é um comando (ignorada)*/
+int ghost_script_add_line(ghost_script_builder_t *builder, const char *line);
+
+/*Acaba a compilação e devolve o programa partilhado (referência nova), NULL sem memória*/
+ghost_script_t *ghost_script_finish(ghost_script_builder_t *builder);
+
+/*Mais uma referência a um programa já partilhado (NULL não faz nada)*/
+void ghost_script_retain(ghost_script_t *script);
+
+/*Larga uma referência a um programa (NULL não faz nada)*/
+void ghost_script_release(ghost_script_t *script);
+
+/*Próximo passo de um programa: uma direção, GOP_RANDOM, GOP_CHARGE, GOP_CHASE ou GOP_WAIT (parado).
+Avança o pc, as voltas dos blocos (loop_left tem GHOST_LOOP_DEPTH posições) e a espera do "T n"*/
+int ghost_script_step(const ghost_script_t *script, int *pc, int *wait_left, int *loop_depth, int *loop_left);
+
+/*ghost_script_step com o estado do monstro ghost_index*/
+int ghost_script_next(ghosts_t *ghosts, int ghost_index);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "board.h"
+#include "ghost_script.h"
+
+#define HEADLESS_MAX_TICKS 100000 // ticks de um nível headless antes de o dar por perdido
+
+/*
+Simulação de um nível sem clientes nem relógio (modo -H do servidor e pacman_batch).
+Cada tick é uma jogada do pacman 0, escolhida por uma política, seguida dos monstros que
+têm a vez (cada um a cada 1 + passo ticks, como com os relógios). O TEMPO do nível é ignorado.
+*/
+
+/*Jogada do pacman neste tick ('W', 'A', 'S', 'D', 'R'), 0 para ficar parado*/
+typedef char (*pacman_policy_t)(board_t *board, int pacman_index, void *state);
+
+// Política que segue um programa compilado (o ficheiro PAC do nível)
+typedef struct {
+    ghost_script_t *script;
+    int pc;
+    int wait_left;
+    int loop_depth;
+    int loop_left[GHOST_LOOP_DEPTH];
+} script_policy_t;
+
+/*pacman_policy_t de um script_policy_t (C e H não são jogadas de pacman)*/
+char script_policy(board_t *board, int pacman_index, void *state);
+
+// Pacman de um ficheiro PAC, lido uma vez por nível e colocado em cada jogo
+typedef struct {
+    ghost_script_t *script; // NULL sem ficheiro PAC (o pacman fica parado)
+    int pos_x, pos_y;       // -1 = primeiro ponto livre
+    int passo;
+} headless_pacman_t;
+
+/*Lê o ficheiro PAC do nível, se tiver um*/
+void headless_read_pacman(board_t *board, headless_pacman_t *pacman);
+
+/*Larga o programa de um pacman lido por headless_read_pacman*/
+void headless_free_pacman(headless_pacman_t *pacman);
+
+/*Coloca o pacman 0 na posição e com o passo de pacman (sem posição, no primeiro ponto livre) e prepara
+policy com o seu programa, emprestado: pacman tem de durar até ao fim do jogo.
+Devolve 0, ou -1 se o pacman não tem onde ficar*/
+int headless_place_pacman(board_t *board, int points, const headless_pacman_t *pacman, script_policy_t *policy);
+
+/*Joga o nível, com o pacman 0 já colocado, até max_ticks ticks. Soma os ticks jogados a *ticks.
+Devolve REACHED_PORTAL, DEAD_PACMAN, ou VALID_MOVE se o nível não acabou*/
+int headless_play_level(board_t *board, pacman_policy_t policy, void *state, long long max_ticks, long long *ticks);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#define LEADERBOARD_LOG_FILE "leaderboard.log"
+#define LEADERBOARD_INDEX_FILE "leaderboard.idx"
+#define LEADERBOARD_ID_LENGTH 32
+#define LEADERBOARD_QUEUE_SIZE 256       // jogos à espera de serem escritos
+#define LEADERBOARD_COMPACT_THRESHOLD 64 // registos fora do índice antes de compactar
+#define LEADERBOARD_COMPACT_PERIOD_MS 5000
+
+// Registo de um jogo terminado, tal como fica no log (tamanho fixo)
+typedef struct {
+    char client_id[LEADERBOARD_ID_LENGTH];
+    int levels;          // níveis alcançados
+    int points;          // pontuação final
+    int duration_ms;     // duração do jogo
+    int reserved;
+    long long finished_at; // segundos desde epoch
+} leaderboard_record_t;
+
+/*Abre o log e o índice, e arranca a tarefa de escrita/compactação*/
+int leaderboard_open(void);
+
+/*Entrega um jogo terminado à tarefa de escrita, nunca faz I/O nem bloqueia*/
+void leaderboard_submit(const leaderboard_record_t *record);
+
+/*Copia para out os k melhores jogos de sempre, devolve quantos copiou*/
+int leaderboard_top(leaderboard_record_t *out, int k);
+
+/*Copia para out os k melhores jogos de um jogador, devolve quantos copiou*/
+int leaderboard_player(const char *client_id, leaderboard_record_t *out, int k);
+
+/*Escreve os jogos pendentes, compacta e termina a tarefa de escrita*/
+void leaderboard_close(void);
+
+#endif
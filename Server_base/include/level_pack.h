@@ -0,0 +1,45 @@
+#ifndef LEVEL_PACK_H
+#define LEVEL_PACK_H
+
+#include <stddef.h>
+#include "board.h"
+#include "arena.h"
+#include "headless.h"
+
+#define LEVEL_PACK_SETTLE_MS 200 // diretoria sem mudanças durante este tempo antes de a voltar a ler
+#define LEVEL_PACK_POLL_MS 500   // espera máxima da tarefa de vigilância antes de rever se deve parar
+
+/*
+Pacote de níveis: todos os níveis da diretoria já lidos, numa versão imutável e partilhada.
+Um mundo fixa a versão atual quando começa e joga-a até ao fim, copiando cada nível (copy_level)
+sem ler ficheiros; os ficheiros PAC também já vêm lidos, para o modo headless. Cada nível tem a sua
+arena, do tamanho dele. Com vigilância (inotify, ativa antes da primeira leitura), uma mudança na
+diretoria gera em segundo plano uma versão nova, que passa a ser a atual de uma só vez quando está completa; os mundos que já estavam
+a jogar ficam com a sua. As mudanças seguidas (até LEVEL_PACK_SETTLE_MS entre elas) dão uma só versão,
+e uma versão sem níveis não substitui a anterior.
+*/
+typedef struct {
+    int version;
+    int refcount;      // mundos que a usam, mais um enquanto é a atual
+    int n_levels;
+    char **names;      // ficheiros .lvl, pela ordem da diretoria
+    board_t **levels;  // níveis carregados e nunca jogados, só para copiar
+    arena_t *arenas;   // memória de cada nível
+    headless_pacman_t *pacmans; // ficheiro PAC de cada nível, lido uma vez
+    size_t largest;    // level_memory_size do maior, para as arenas de quem os copia
+} level_pack_t;
+
+/*Lê a diretoria como primeira versão e, com watch, arranca a tarefa que a vigia.
+Devolve 0, ou -1 se não há níveis (com watch, a versão aparece quando a diretoria tiver níveis)*/
+int level_pack_open(const char *dirpath, int watch);
+
+/*Versão atual (mais uma referência), NULL se não há nenhuma*/
+level_pack_t *level_pack_acquire(void);
+
+/*Larga uma referência a uma versão (NULL não faz nada)*/
+void level_pack_release(level_pack_t *pack);
+
+/*Para a vigilância e larga a versão atual*/
+void level_pack_close(void);
+
+#endif
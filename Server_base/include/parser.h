@@ -5,7 +5,13 @@
 #define MAX_COMMAND_LENGTH 256
 
 int read_line(int fd, char* buffer);
-int read_level(board_t* board, GameSession* session, char* filename, char* dirname);
+int read_line_max(int fd, char* buffer, int max);
+int read_level(board_t* board, char* filename, char* dirname);
+/*Lê só as dimensões de um nível (linha DIM), devolve -1 se não as encontra*/
+int read_level_dim(char *filename, char *dirname, int *width, int *height);
 int read_ghosts(board_t* board);
+/*Lê o ficheiro PAC do nível (modo headless): PASSO e POS (-1 sem POS) para pacman, e os movimentos.
+Devolve o programa compilado (ghost_script_release para largar), NULL se falhou*/
+struct ghost_script *read_pacman(board_t* board, pacman_t* pacman);
 
 #endif
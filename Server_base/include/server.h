@@ -2,22 +2,78 @@
 #define SERVER_H
 
 #include "board.h"
+#include "protocol.h"
+#include "world.h"
+#include "tick_pool.h"
+#include "tick_clock.h"
+#include "level_pack.h"
 
 #define CONTINUE_PLAY 0
 #define NEXT_LEVEL 1
 #define QUIT_GAME 2
 
+#define MAX_CONNECT_QUEUE 512        // limite do buffer de pedidos à espera de sessão
+#define SESSION_IDLE_TIMEOUT_MS 5000 // tarefa de sessão sem clientes durante este tempo sai do pool
+#define CONNECT_RETRY_MS 1000        // espera sugerida a um cliente recusado, por cada fila de sessões cheia
+#define FRAME_PERIOD_MS 100          // período do envio do tabuleiro aos clientes (10 FPS)
+#define MAX_HANDSHAKES 64            // clientes aceites no socket à espera de mandarem o pedido
+#define HANDSHAKE_TIMEOUT_MS 1000    // tempo que um cliente aceite tem para mandar o pedido
+
 //Game session structure defined in board.h for logical header reasons
 
+// Pedido de conexão à espera de uma sessão livre
+typedef struct {
+    char request[CONNECT_REQUEST_SIZE];
+    int fd; // socket do cliente já aceite (modo -S), -1 quando o cliente usa FIFOs
+} connect_request_t;
+
+// Monstros de um nível no tick pool (modo -T)
+typedef struct {
+    tick_task_t task;                    // primeiro campo: o pool só conhece a tarefa
+    world_t *world;
+    int *running;                        // contador do world_thread, decrementado quando o nível sai do pool
+    tick_clock_t ghost_clocks[MAX_GHOSTS]; // próximo movimento de cada monstro
+} level_ticker_t;
+
+// Níveis de um mundo e o próximo, copiado em segundo plano enquanto o atual é jogado
+typedef struct {
+    level_pack_t *pack; // versão dos níveis fixada quando o mundo começou
+    int next;       // próximo nível do pacote a copiar
+    board_t *board; // nível pronto a jogar, NULL se já não há mais
+    int board_level; // índice de board no pacote
+    arena_t arenas[2]; // memória do nível a decorrer e do seguinte, à vez
+    int next_arena;    // arena do próximo nível a carregar
+} level_prefetch_t;
+
+// Trabalhador do modo headless (-H) e as suas contas
+typedef struct {
+    pthread_t tid;
+    int index;
+    long long ticks;  // ticks simulados: uma jogada do pacman e os monstros que têm a vez
+    long long points;
+    int games;
+    int levels;       // níveis passados
+    int deaths;
+    int timeouts;     // níveis que não acabaram em HEADLESS_MAX_TICKS
+} headless_worker_t;
+
+// Tarefa arrancada por start_task, thread ou corrotina
+typedef struct {
+    void *(*fn)(void *);
+    void *arg;
+    int *running; // contador de quem espera pelo fim, ou NULL
+} task_arg_t;
+
+// Cliente aceite no socket de registo, ainda sem o pedido de conexão
+typedef struct {
+    int fd;
+    long long accepted_ms;
+} handshake_t;
+
+// Recusa por entregar a um cliente por FIFOs
 typedef struct {
-    board_t *board;
-    GameSession *game_session;
-    int ghost_index;
-} ghost_thread_arg_t;
-
-typedef struct{
-    board_t *board;
-    GameSession *game_session;
-} pacman_thread_arg_t;
+    char request[CONNECT_REQUEST_SIZE];
+    char ack[CONNECT_ACK_SIZE];
+} reject_arg_t;
 
 #endif
\ No newline at end of file
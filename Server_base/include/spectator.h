@@ -0,0 +1,52 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include "game_session.h"
+
+#define SOCKET_FRAMES_IN_FLIGHT 2     // frames que o buffer de envio de um socket comporta
+#define SPECTATOR_OPEN_TIMEOUT_MS 1000 // tempo que um espectador por FIFOs tem para abrir o pipe de notificações
+#define SPECTATOR_OPEN_RETRY_MS 10     // intervalo entre tentativas de abrir esse pipe
+
+// Frame já codificado (cabeçalho + células), partilhado por contagem de referências
+typedef struct frame {
+    int refcount;
+    int size;
+    int capacity; // bytes reservados em data
+    char data[];
+} frame_t;
+
+/*Aloca um frame com uma referência, para quem o vai preencher*/
+frame_t *frame_alloc(int size);
+
+/*Frame para voltar a preencher: o próprio se mais ninguém o tem e cabe, senão um novo
+(largando a referência ao anterior). NULL sem memória*/
+frame_t *frame_reuse(frame_t *frame, int size);
+
+void frame_retain(frame_t *frame);
+
+/*Larga uma referência, o último a largar liberta o frame*/
+void frame_release(frame_t *frame);
+
+/*Garante que o buffer de envio do socket fd leva um frame de size bytes numa só mensagem
+(um SOCK_SEQPACKET não parte mensagens), para SOCKET_FRAMES_IN_FLIGHT frames.
+Só cresce quando o frame cresce, *requested guarda o último pedido. Devolve -1 se o sistema não deixa*/
+int frame_fit_send_buffer(int fd, int *requested, int size);
+
+/*Trata um pedido OP_CODE_SPECTATE sem bloquear quem o recebeu: todos os espectadores são servidos
+por uma só tarefa de envio, com fds não bloqueantes. fd é o socket já aceite em modo -S,
+ou -1 para abrir os pipes do pedido*/
+void spectator_attach(const char *request, int fd);
+
+/*A sessão passa a aceitar espectadores (depois do ACK ao jogador)*/
+void spectators_open(GameSession *session);
+
+/*1 se alguém está a ver a sessão, serve só para evitar copiar frames sem espectadores*/
+int spectators_watching(GameSession *session);
+
+/*Entrega o frame a todos os espectadores da sessão, sem esperar pelas escritas*/
+void spectators_publish(GameSession *session, frame_t *frame);
+
+/*Fim do jogo: os espectadores enviam o último frame pendente e desligam*/
+void spectators_close(GameSession *session);
+
+#endif
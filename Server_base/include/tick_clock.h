@@ -0,0 +1,34 @@
+#ifndef TICK_CLOCK_H
+#define TICK_CLOCK_H
+
+/*
+Ticks periódicos com prazos absolutos no CLOCK_MONOTONIC: o período não escorrega com o
+tempo do trabalho nem com as esperas pelos locks, e a velocidade do jogo não depende da carga.
+Um tick atrasado mais do que um período é um overrun: os ticks perdidos são saltados
+em vez de corridos de rajada. Os atrasos de todos os relógios são somados para estatística.
+*/
+
+typedef struct {
+    long long next_ms; // prazo do próximo tick (CLOCK_MONOTONIC)
+} tick_clock_t;
+
+typedef struct {
+    long long ticks;
+    long long overruns;    // ticks que já tinham perdido o seguinte
+    long long late_ms;     // atraso somado de todos os ticks
+    long long max_late_ms;
+} tick_stats_t;
+
+/*Tempo monotónico em milissegundos, a mesma base dos prazos*/
+long long tick_clock_now_ms(void);
+
+/*Primeiro prazo daqui a period_ms*/
+void tick_clock_start(tick_clock_t *clock, int period_ms);
+
+/*Regista o tick que começou em now_ms e marca o prazo seguinte, period_ms depois do anterior*/
+void tick_clock_advance(tick_clock_t *clock, long long now_ms, int period_ms);
+
+/*Estatísticas somadas de todos os relógios desde o arranque*/
+void tick_clock_stats(tick_stats_t *stats);
+
+#endif
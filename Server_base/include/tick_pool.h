@@ -0,0 +1,33 @@
+#ifndef TICK_POOL_H
+#define TICK_POOL_H
+
+/*
+Pool de tarefas periódicas (ticks da simulação) com roubo de trabalho.
+Cada trabalhador tem os seus prazos (heap) e um deque Chase-Lev com os ticks já vencidos:
+o dono tira do fundo, os trabalhadores sem trabalho roubam do topo dos outros.
+Um tick passa a pertencer a quem o correu da última vez, o que reequilibra a carga sozinho.
+Um trabalhador sem trabalho dorme num futex até ao seu próximo prazo; é acordado quando
+lhe entregam uma tarefa ou quando outro tem mais do que um tick vencido para repartir.
+*/
+
+#define TICK_DEQUE_SIZE 1024 // ticks vencidos por trabalhador (potência de 2)
+
+typedef struct tick_task {
+    long long deadline_ms; // próximo tick (CLOCK_MONOTONIC)
+    int node;              // nó NUMA onde está a memória do tick, entregue a um trabalhador de lá (-1 = qualquer)
+    /*Corre o tick. Devolve 0 com deadline_ms atualizado para continuar, -1 para sair do pool
+    (a tarefa pode ser libertada dentro de run, o pool já não lhe toca)*/
+    int (*run)(struct tick_task *task, long long now_ms);
+} tick_task_t;
+
+/*Arranca n_workers trabalhadores (0 = um por core), devolve 0 se conseguiu*/
+int tick_pool_start(int n_workers);
+
+/*1 se o pool foi arrancado*/
+int tick_pool_running(void);
+
+/*Entrega uma tarefa ao pool, a partir de qualquer tarefa; o primeiro tick é em deadline_ms.
+Devolve 0 se conseguiu*/
+int tick_pool_submit(tick_task_t *task);
+
+#endif
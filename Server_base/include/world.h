@@ -0,0 +1,54 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <pthread.h>
+#include "board.h"
+
+/*
+Mundo partilhado: um tabuleiro, uma simulação de fantasmas e um envio de frames
+para todos os jogadores que lá estão. O índice de cada jogador é o índice do seu pacman.
+Um jogo individual é um mundo sem nome, que não aparece no registo.
+*/
+typedef struct world {
+    char name[MAX_PIPE_PATH_LENGTH];
+    board_t *board;          // nível a decorrer, NULL entre níveis (o seguinte já vem carregado)
+    pthread_mutex_t lock;    // protege o que está abaixo e o tabuleiro entre níveis
+    int changes;             // mudanças (jogadores a sair, fim de nível), esperadas em world_wait
+    GameSession *players[MAX_PACMANS];
+    int placed[MAX_PACMANS]; // já recebeu o ACK: entra no tabuleiro e recebe frames
+    int n_players;
+    int level;               // níveis carregados até agora
+    int active;              // há um nível a decorrer (as threads do nível param quando fica 0)
+    int level_result;        // NEXT_LEVEL quando um dos pacmans chega ao portal
+    int closed;              // acabou (ou vai acabar) sem mais níveis: world_join já não entra nele
+    int sending;             // frames a ser escritos sem o lock; os jogadores só saem quando acabam
+    int node;                // nó NUMA onde o mundo corre e tem a memória (-1 = sem afinidade)
+    struct world *next;
+} world_t;
+
+/*Junta a sessão ao mundo com este nome, criando-o se não existir (*created = 1).
+Um mundo fechado (closed) já não conta: é criado outro. Devolve NULL se o mundo estiver cheio. O jogador só entra no tabuleiro em world_enter*/
+world_t *world_join(const char *name, GameSession *session, int *created);
+
+/*Coloca o pacman do jogador no tabuleiro, depois do ACK*/
+void world_enter(world_t *world, GameSession *session);
+
+/*Tira o jogador do mundo e o seu pacman do tabuleiro, depois dos envios em curso.
+Devolve os níveis que este jogador alcançou (o que decorria quando entrou conta)*/
+int world_leave(world_t *world, GameSession *session);
+
+/*Jogadores que ainda podem jogar o nível atual: pacman vivo ou a entrar (com o lock do mundo)*/
+int world_alive_players(world_t *world);
+
+/*Espera até ms por uma mudança no mundo (com o lock do mundo)*/
+void world_wait(world_t *world, int ms);
+
+/*Acorda quem espera em world_wait (com o lock do mundo)*/
+void world_signal(world_t *world);
+
+/*Tira o mundo do registo (usado pela tarefa do mundo quando acaba, depois de o marcar closed)*/
+void world_close(world_t *world);
+
+void world_free(world_t *world);
+
+#endif
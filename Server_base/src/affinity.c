@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "affinity.h"
+#include "debug.h"
+
+static cpu_set_t role_cpus[AFFINITY_ROLES];
+static int role_count[AFFINITY_ROLES]; // 0 = sem afinidade
+
+// Cores de cada papel separados por nó NUMA, pela ordem em que os nós aparecem
+static int role_nodes[AFFINITY_ROLES][AFFINITY_MAX_NODES];
+static cpu_set_t role_node_cpus[AFFINITY_ROLES][AFFINITY_MAX_NODES];
+static int role_n_nodes[AFFINITY_ROLES];
+static unsigned int next_node[AFFINITY_ROLES];
+
+/*Função auxiliar que separa os cores do papel pelos seus nós NUMA*/
+static void group_by_node(int role) {
+    role_n_nodes[role] = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &role_cpus[role])) continue;
+        int node = affinity_cpu_node(cpu);
+        if (node < 0 || node >= AFFINITY_MAX_NODES) continue;
+
+        int i = 0;
+        while (i < role_n_nodes[role] && role_nodes[role][i] != node) i++;
+        if (i == role_n_nodes[role]) {
+            role_nodes[role][i] = node;
+            CPU_ZERO(&role_node_cpus[role][i]);
+            role_n_nodes[role]++;
+        }
+        CPU_SET(cpu, &role_node_cpus[role][i]);
+    }
+}
+
+/*Função auxiliar que lê uma lista de cores ("0-3,8") até ao fim do campo, devolve -1 se inválida*/
+static int parse_cpu_list(const char *list, size_t len, cpu_set_t *cpus) {
+    CPU_ZERO(cpus);
+    size_t i = 0;
+    while (i < len) {
+        char *end;
+        long first = strtol(list + i, &end, 10);
+        if (end == list + i || first < 0 || first >= CPU_SETSIZE) return -1;
+        long last = first;
+        i = end - list;
+
+        if (i < len && list[i] == '-') {
+            i++;
+            last = strtol(list + i, &end, 10);
+            if (end == list + i || last < first || last >= CPU_SETSIZE) return -1;
+            i = end - list;
+        }
+        for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, cpus);
+
+        if (i < len && list[i] != ',') return -1;
+        i++;
+    }
+    return 0;
+}
+
+int affinity_configure(const char *spec) {
+    const char *field = spec;
+    for (int role = 0; role < AFFINITY_ROLES; role++) {
+        const char *end = strchr(field, ':');
+        size_t len = end ? (size_t)(end - field) : strlen(field);
+
+        if (parse_cpu_list(field, len, &role_cpus[role]) != 0) {
+            debug("Invalid core list for affinity role %d: %.*s\n", role, (int)len, field);
+            return -1;
+        }
+        role_count[role] = CPU_COUNT(&role_cpus[role]);
+        group_by_node(role);
+
+        if (!end) break;
+        field = end + 1;
+    }
+    return 0;
+}
+
+void affinity_pin(int role) {
+    if (role_count[role] == 0) return;
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &role_cpus[role]) != 0) {
+        debug("Failed to set affinity for role %d\n", role);
+    }
+}
+
+int affinity_pin_one(int role, int index) {
+    if (role_count[role] == 0) return -1;
+
+    // O index-ésimo core do conjunto, dando a volta quando há mais tarefas do que cores
+    int wanted = index % role_count[role];
+    int cpu = 0;
+    for (int seen = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &role_cpus[role]) && seen++ == wanted) break;
+    }
+
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &one) != 0) {
+        debug("Failed to pin to core %d\n", cpu);
+        return -1;
+    }
+    return cpu;
+}
+
+int affinity_cpu_node(int cpu) {
+    // O sysfs tem uma entrada nodeN na diretoria de cada core
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && sscanf(entry->d_name + 4, "%d", &node) == 1) break;
+    }
+    closedir(dir);
+    return node;
+}
+
+int affinity_pick_node(int role) {
+    if (role_n_nodes[role] == 0) return -1;
+    unsigned int turn = __atomic_fetch_add(&next_node[role], 1, __ATOMIC_RELAXED);
+    return role_nodes[role][turn % role_n_nodes[role]];
+}
+
+void affinity_pin_node(int role, int node) {
+    for (int i = 0; i < role_n_nodes[role]; i++) {
+        if (role_nodes[role][i] != node) continue;
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &role_node_cpus[role][i]) != 0) {
+            debug("Failed to set affinity for role %d on node %d\n", role, node);
+        }
+        return;
+    }
+}
+
+void affinity_place(void *addr, size_t size, int node) {
+    if (node < 0 || node >= AFFINITY_MAX_NODES) return;
+
+    // Só as páginas inteiras do intervalo: as das pontas podem ter memória de outros
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)addr + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)addr + size) & ~(page - 1);
+    if (end <= start) return;
+
+    // Preferido e não obrigatório: com o nó cheio as páginas vão para outro em vez de falhar.
+    // As páginas já tocadas por outra tarefa mudam-se para lá (MPOL_MF_MOVE)
+    unsigned long nodemask = 1UL << node;
+    if (syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, &nodemask, 8 * sizeof(nodemask), MPOL_MF_MOVE) != 0) {
+        debug("Failed to place memory on NUMA node %d\n", node);
+    }
+}
+
+void *affinity_alloc(size_t size, int node) {
+    // Páginas novas, ainda não tocadas: a política aplica-se logo ao primeiro acesso.
+    // O mapeamento é todo de quem pediu, por isso a política cobre-o até ao fim da última página
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t mapped = (size + page - 1) & ~(page - 1);
+    void *ptr = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) return NULL;
+    affinity_place(ptr, mapped, node);
+    return ptr;
+}
+
+void affinity_move(void *ptr, size_t size, int node) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    if (ptr) affinity_place(ptr, (size + page - 1) & ~(page - 1), node);
+}
+
+void affinity_release(void *ptr, size_t size) {
+    if (ptr) munmap(ptr, size);
+}
@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/*Função auxiliar que cria um bloco vazio*/
+static arena_block_t *block_create(size_t capacity) {
+    arena_block_t *block = malloc(sizeof(arena_block_t) + capacity);
+    if (!block) return NULL;
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+/*Função auxiliar que tira size bytes do bloco, NULL se não cabem*/
+static void *block_alloc(arena_block_t *block, size_t size) {
+    uintptr_t addr = (uintptr_t)(block->data + block->used);
+    size_t start = block->used + ((ARENA_ALIGN - addr % ARENA_ALIGN) % ARENA_ALIGN);
+    if (start + size > block->capacity) return NULL;
+    block->used = start + size;
+    return block->data + start;
+}
+
+int arena_init(arena_t *arena, size_t capacity) {
+    arena->block = NULL;
+    arena->overflow = NULL;
+    if (capacity == 0) return 0;
+    arena->block = block_create(capacity);
+    return arena->block ? 0 : -1;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    // 1. No bloco principal, ou no último bloco extra
+    void *ptr = NULL;
+    if (arena->block) ptr = block_alloc(arena->block, size);
+    if (!ptr && arena->overflow) ptr = block_alloc(arena->overflow, size);
+
+    // 2. Não coube: um bloco extra com pelo menos o dobro do pedido
+    if (!ptr) {
+        size_t capacity = (arena->block ? arena->block->capacity : 0) / 4;
+        if (capacity < 2 * size + ARENA_ALIGN) capacity = 2 * size + ARENA_ALIGN;
+        arena_block_t *block = block_create(capacity);
+        if (!block) return NULL;
+        block->next = arena->overflow;
+        arena->overflow = block;
+        ptr = block_alloc(block, size);
+    }
+
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void arena_reset(arena_t *arena) {
+    while (arena->overflow) {
+        arena_block_t *next = arena->overflow->next;
+        free(arena->overflow);
+        arena->overflow = next;
+    }
+    if (arena->block) arena->block->used = 0;
+}
+
+void arena_destroy(arena_t *arena) {
+    arena_reset(arena);
+    free(arena->block);
+    arena->block = NULL;
+}
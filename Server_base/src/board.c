@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h> //snprintf
+#include <string.h>
 #include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
@@ -8,18 +9,28 @@
 
 #include "parser.h"
 #include "debug.h"
-
-// Helper private function to find and kill pacman at specific position
-static int find_and_kill_pacman(board_t* board, int new_x, int new_y) {
-    for (int p = 0; p < board->n_pacmans; p++) {
-        pacman_t* pac = &board->pacmans[p];
-        if (pac->pos_x == new_x && pac->pos_y == new_y && pac->alive) {
-            pac->alive = 0;
-            kill_pacman(board, p);
-            return DEAD_PACMAN;
-        }
-    }
-    return VALID_MOVE;
+#include "flow_field.h"
+#include "ghost_script.h"
+
+// Helper private function that puts an entity (or NO_ENTITY) on a cell
+// and keeps its content, compact code, occupant bits and entity index in sync
+static inline void set_occupant(board_t* board, int index, int entity) {
+    board_pos_t* pos = &board->board[index];
+    char content = (entity == NO_ENTITY) ? ' ' : (entity < MAX_PACMANS) ? 'P' : 'M';
+    pos->content = content;
+    board->occupant[index] = (short)entity;
+
+    if (content == 'M') bit_set(board->ghost_cells, index);
+    else bit_clear(board->ghost_cells, index);
+    if (content == 'P') bit_set(board->pacman_cells, index);
+    else bit_clear(board->pacman_cells, index);
+
+    if (content == 'W') board->cells[index] = CELL_WALL;
+    else if (content == 'P') board->cells[index] = CELL_PACMAN;
+    else if (content == 'M') board->cells[index] = CELL_GHOST;
+    else if (pos->has_portal) board->cells[index] = CELL_PORTAL;
+    else if (pos->has_dot) board->cells[index] = CELL_DOT;
+    else board->cells[index] = CELL_EMPTY;
 }
 
 // Helper private function for getting board position index
@@ -27,6 +38,16 @@ static inline int get_board_index(board_t* board, int x, int y) {
     return y * board->width + x;
 }
 
+// Helper private function to kill the pacman on a position, if there is one
+static int find_and_kill_pacman(board_t* board, int index) {
+    int entity = board->occupant[index];
+    if (entity == NO_ENTITY || entity >= MAX_PACMANS || !board->pacmans[entity].alive) {
+        return VALID_MOVE;
+    }
+    kill_pacman(board, entity);
+    return DEAD_PACMAN;
+}
+
 // Helper private function for checking valid position
 static inline int is_valid_position(board_t* board, int x, int y) {
     return (x >= 0 && x < board->width) && (y >= 0 && y < board->height); // Inside of the board boundaries
@@ -52,7 +73,7 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
 
     if (direction == 'R') {
         char directions[] = {'W', 'S', 'A', 'D'};
-        direction = directions[rand() % 4];
+        direction = directions[rand_r(&board->rng) % 4];
     }
 
     // Calculate new position based on direction
@@ -101,35 +122,44 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
         pthread_mutex_lock(&board->board[old_index].lock);
     }
 
-    char target_content = board->board[new_index].content;
-
-    if (board->board[new_index].has_portal) {
-        board->board[old_index].content = ' ';
-        board->board[new_index].content = 'P';
+    if (bit_test(board->portals, new_index)) {
+        set_occupant(board, old_index, NO_ENTITY);
+        set_occupant(board, new_index, pacman_index);
+        if (old_index < new_index) {
+            pthread_mutex_unlock(&board->board[old_index].lock);
+            pthread_mutex_unlock(&board->board[new_index].lock);
+        }
+        else {
+            pthread_mutex_unlock(&board->board[new_index].lock);
+            pthread_mutex_unlock(&board->board[old_index].lock);
+        }
         return REACHED_PORTAL;
     }
 
-    // Check for walls
-    if (target_content == 'W') {
+    // Check for walls and other pacmans
+    if (bit_test(board->walls, new_index) || bit_test(board->pacman_cells, new_index)) {
         goto move_pacman_invalid;
     }
 
     // Check for ghosts
-    if (target_content == 'M') {
+    if (bit_test(board->ghost_cells, new_index)) {
         kill_pacman(board, pacman_index);
         goto move_pacman_dead;
     }
 
     // Collect points
-    if (board->board[new_index].has_dot) {
+    if (bit_test(board->dots, new_index)) {
         pac->points++;
         board->board[new_index].has_dot = 0;
+        bit_clear(board->dots, new_index);
+        board->dots_left--;
     }
 
-    board->board[old_index].content = ' ';
+    set_occupant(board, old_index, NO_ENTITY);
     pac->pos_x = new_x;
     pac->pos_y = new_y;
-    board->board[new_index].content = 'P';
+    set_occupant(board, new_index, pacman_index);
+    flow_field_invalidate(board);
 
     if (old_index < new_index) {
         pthread_mutex_unlock(&board->board[old_index].lock);
@@ -165,198 +195,127 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
     return DEAD_PACMAN;
 }
 
-int move_ghost_charged(board_t* board, int ghost_index, char direction) {
-    ghost_t* ghost = &board->ghosts[ghost_index];
-    int x = ghost->pos_x;
-    int y = ghost->pos_y;
-    int new_x = x;
-    int new_y = y;
-    int result;
-
-    ghost->charged = 0; //uncharge
-
-    switch (direction) {
-        case 'W':
-            if (y == 0) return INVALID_MOVE;
-
-            for (int i = 0; i <= y; i++) {
-                pthread_mutex_lock(&board->board[i * board->width + x].lock);
-            }
+/*
+A charge stops before the first wall or ghost, or on the first pacman, in its direction.
+Walls never move, so the nearest one comes from the tables built at load; ghosts and pacmans
+are few, so the nearest one in the same line is found by going through their positions.
+Only the cells the ghost leaves and lands on are locked.
+*/
+// Helper private function that masks the ghost and pacman bits of word w to the positions from..to
+static inline uint64_t occupied_bits(const board_t* board, int w, int from, int to) {
+    uint64_t bits = board->ghost_cells[w] | board->pacman_cells[w];
+    if (w == from >> 6) bits &= ~(uint64_t)0 << (from & 63);
+    if (w == to >> 6) bits &= ~(uint64_t)0 >> (63 - (to & 63));
+    return bits;
+}
 
-            new_y = 0; // In case there is no colision
-            for (int i = y - 1; i >= 0; i--) {
-                char target_content = board->board[i * board->width + x].content;
-                if (target_content == 'W' || target_content == 'M') {
-                    new_y = i + 1; // stop before colision
-                    result = VALID_MOVE;
-                    break;
-                }
-                else if (target_content == 'P') {
-                    new_y = i;
-                    result = find_and_kill_pacman(board, new_x, new_y);
-                    break;
-                }
-            }
+// Helper private function: lowest position in from..to with a ghost or pacman (-1 = none)
+static int first_occupied(const board_t* board, int from, int to) {
+    for (int w = from >> 6; w <= to >> 6; w++) {
+        uint64_t bits = occupied_bits(board, w, from, to);
+        if (bits) return w * 64 + __builtin_ctzll(bits);
+    }
+    return -1;
+}
 
-            for (int i = 0; i <= y; i++) {
-                pthread_mutex_unlock(&board->board[i * board->width + x].lock);
-            }
-            break;
-        case 'S':
-            if (y == board->height - 1) return INVALID_MOVE;
+// Helper private function: highest position in from..to with a ghost or pacman (-1 = none)
+static int last_occupied(const board_t* board, int from, int to) {
+    for (int w = to >> 6; w >= from >> 6; w--) {
+        uint64_t bits = occupied_bits(board, w, from, to);
+        if (bits) return w * 64 + 63 - __builtin_clzll(bits);
+    }
+    return -1;
+}
 
-            for (int i = y; i < board->height; i++) {
-                pthread_mutex_lock(&board->board[i * board->width + x].lock);
-            }
+int move_ghost_charged(board_t* board, int ghost_index, char direction) {
+    ghosts_t* ghosts = &board->ghosts;
+    int x = ghosts->pos_x[ghost_index];
+    int y = ghosts->pos_y[ghost_index];
+    int index = get_board_index(board, x, y);
 
-            new_y = board->height - 1; // In case there is no colision
-            for (int i = y + 1; i < board->height; i++) {
-                char target_content = board->board[i * board->width + x].content;
-                if (target_content == 'W' || target_content == 'M') {
-                    new_y = i - 1; // stop before colision
-                    result = VALID_MOVE;
-                    break;
-                }
-                else if (target_content == 'P') {
-                    new_y = i;
-                    result = find_and_kill_pacman(board, new_x, new_y);
-                    break;
-                }
-            }
+    ghosts->charged[ghost_index] = 0; //uncharge
 
-            for (int i = y; i < board->height; i++) {
-                pthread_mutex_unlock(&board->board[i * board->width + x].lock);
-            }
-            break;
-        case 'A':
-            if (x == 0) return INVALID_MOVE;
+    // Axis of the charge: pos is the coordinate that changes, step its sign
+    int step, pos, limit;
+    switch (direction) {
+        case 'W': step = -1; pos = y; limit = board->wall_up[index]; break;
+        case 'S': step = 1;  pos = y; limit = board->wall_down[index]; break;
+        case 'A': step = -1; pos = x; limit = board->wall_left[index]; break;
+        case 'D': step = 1;  pos = x; limit = board->wall_right[index]; break;
+        default:
+            debug("DEFAULT CHARGED MOVE - direction = %c\n", direction);
+            return INVALID_MOVE;
+    }
+    int vertical = (direction == 'W' || direction == 'S');
+    if (limit == pos + step && (limit < 0 || limit >= (vertical ? board->height : board->width))) {
+        return INVALID_MOVE; // already at the edge of the board
+    }
 
-            for (int j = 0; j <= x; j++) {
-                pthread_mutex_lock(&board->board[y * board->width + j].lock);
-            }
+    // 1. Nearest wall: stop right before it (or at the edge)
+    int stop = limit - step;
+    int pacman_hit = -1;
 
-            new_x = 0; // In case there is no colision
-            for (int j = x - 1; j >= 0; j--) {
-                char target_content = board->board[y * board->width + j].content;
-                if (target_content == 'W' || target_content == 'M') {
-                    new_x = j + 1; // stop before colision
-                    result = VALID_MOVE;
-                    break;
-                }
-                else if (target_content == 'P') {
-                    new_x = j;
-                    result = find_and_kill_pacman(board, new_x, new_y);
+    // 2. Nearest ghost or live pacman between the ghost and that wall, from the occupant bitboards:
+    // a row is contiguous, so whole words at a time; a column is one bit per row
+    int hit = -1;
+    if (stop != pos) {
+        if (!vertical) {
+            hit = (step > 0) ? first_occupied(board, index + 1, index + (stop - x))
+                             : last_occupied(board, index - (x - stop), index - 1);
+        }
+        else {
+            for (int p = pos + step; p != limit; p += step) {
+                int i = get_board_index(board, x, p);
+                if (bit_test(board->ghost_cells, i) || bit_test(board->pacman_cells, i)) {
+                    hit = i;
                     break;
                 }
             }
+        }
+    }
+    if (hit != -1) {
+        int entity = board->occupant[hit];
+        int hit_pos = vertical ? hit / board->width : hit % board->width;
+        if (entity >= MAX_PACMANS) {
+            stop = hit_pos - step; // right before the ghost
+        }
+        else {
+            stop = hit_pos; // onto the pacman, which dies
+            pacman_hit = entity;
+        }
+    }
 
-            for (int j = 0; j <= x; j++) {
-                pthread_mutex_unlock(&board->board[y * board->width + j].lock);
-            }
-            break;
-        case 'D':
-            if (x == board->width - 1) return INVALID_MOVE;
-
-            for (int j = x; j < board->width; j++) {
-                pthread_mutex_lock(&board->board[y * board->width + j].lock);
-            }
+    int new_x = vertical ? x : stop;
+    int new_y = vertical ? stop : y;
+    int new_index = get_board_index(board, new_x, new_y);
 
-            new_x = board->width - 1; // In case there is no colision
-            for (int j = x + 1; j < board->width; j++) {
-                char target_content = board->board[y * board->width + j].content;
-                if (target_content == 'W' || target_content == 'M') {
-                    new_x = j - 1; // stop before colision
-                    result = VALID_MOVE;
-                    break;
-                }
-                else if (target_content == 'P') {
-                    new_x = j;
-                    result = find_and_kill_pacman(board, new_x, new_y);
-                    break;
-                }
-            }
+    // 3. Move, locking only the two cells in index order
+    int first = (index < new_index) ? index : new_index;
+    int second = (index < new_index) ? new_index : index;
+    pthread_mutex_lock(&board->board[first].lock);
+    if (second != first) pthread_mutex_lock(&board->board[second].lock);
 
-            for (int j = x; j < board->width; j++) {
-                pthread_mutex_unlock(&board->board[y * board->width + j].lock);
-            }
-            break;
-        default:
-            debug("DEFAULT CHARGED MOVE - direction = %c\n", direction);
-            return INVALID_MOVE;
-    }
+    int result = VALID_MOVE;
+    if (pacman_hit != -1) result = find_and_kill_pacman(board, new_index);
 
-    board->board[y * board->width + x].content = ' '; // Or restore the dot if ghost was on one
+    set_occupant(board, index, NO_ENTITY); // Or restore the dot if ghost was on one
 
     // Update ghost position
-    ghost->pos_x = new_x;
-    ghost->pos_y = new_y;
+    ghosts->pos_x[ghost_index] = new_x;
+    ghosts->pos_y[ghost_index] = new_y;
 
     // Update board - set new position
-    board->board[new_y * board->width + new_x].content = 'M';
+    set_occupant(board, new_index, GHOST_ENTITY(ghost_index));
+
+    if (second != first) pthread_mutex_unlock(&board->board[second].lock);
+    pthread_mutex_unlock(&board->board[first].lock);
     return result;
 }
 
-int move_ghost(board_t* board, int ghost_index, command_t* command) {
-    ghost_t* ghost = &board->ghosts[ghost_index];
-    int new_x = ghost->pos_x;
-    int new_y = ghost->pos_y;
-
-    // check passo
-    if (ghost->waiting > 0) {
-        ghost->waiting -= 1;
-        return VALID_MOVE;
-    }
-    ghost->waiting = ghost->passo;
-
-    char direction = command->command;
-
-    if (direction == 'R') {
-        char directions[] = {'W', 'S', 'A', 'D'};
-        direction = directions[rand() % 4];
-    }
-
-    // Calculate new position based on direction
-    switch (direction) {
-        case 'W': // Up
-            new_y--;
-            break;
-        case 'S': // Down
-            new_y++;
-            break;
-        case 'A': // Left
-            new_x--;
-            break;
-        case 'D': // Right
-            new_x++;
-            break;
-        case 'C': // Charge
-            ghost->current_move += 1;
-            ghost->charged = 1;
-            return VALID_MOVE;
-        case 'T': // Wait
-            if (command->turns_left == 1) {
-                ghost->current_move += 1; // move on
-                command->turns_left = command->turns;
-            }
-            else command->turns_left -= 1;
-            return VALID_MOVE;
-        default:
-            return INVALID_MOVE; // Invalid direction
-    }
-
-    // Logic for the WASD movement
-    ghost->current_move++;
-    if (ghost->charged)
-        return move_ghost_charged(board, ghost_index, direction);
-
-    // Check boundaries
-    if (!is_valid_position(board, new_x, new_y)) {
-        return INVALID_MOVE;
-    }
-
-    // Check board position
-    int new_index = new_y * board->width + new_x;
-    int old_index = ghost->pos_y * board->width + ghost->pos_x;
+// Helper private function that moves a ghost one cell to new_index (inside the board), blocked by walls and ghosts
+static int move_ghost_to(board_t* board, int ghost_index, int new_index) {
+    ghosts_t* ghosts = &board->ghosts;
+    int old_index = ghosts->pos_y[ghost_index] * board->width + ghosts->pos_x[ghost_index];
 
     // locks
     if (old_index < new_index) {
@@ -368,39 +327,24 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
         pthread_mutex_lock(&board->board[old_index].lock);
     }
 
-    char target_content = board->board[new_index].content;
-
-    // Check for walls
-    if (target_content == 'W') {
-        goto move_ghost_invalid;
-    }
-
-    // Check for ghosts
-    if (target_content == 'M') {
+    // Check for walls and ghosts
+    if (bit_test(board->walls, new_index) || bit_test(board->ghost_cells, new_index)) {
         goto move_ghost_invalid;
     }
 
     int result = VALID_MOVE;
     // Check for pacman
-    if (target_content == 'P') {
-        for (int i = 0; i < board->n_pacmans; i++) {
-            pacman_t* pac = &board->pacmans[i];
-            if (pac->pos_x == new_x && pac->pos_y == new_y && pac->alive) {
-                pac->alive = 0; // Pacman dies
-                kill_pacman(board, i);
-                result = DEAD_PACMAN;
-                break;
-            }
-        }
+    if (bit_test(board->pacman_cells, new_index)) {
+        result = find_and_kill_pacman(board, new_index);
     }
 
     // Update board - clear old position (restore what was there)
-    board->board[old_index].content = ' '; // Or restore the dot if ghost was on one
+    set_occupant(board, old_index, NO_ENTITY); // Or restore the dot if ghost was on one
     // Update ghost position
-    ghost->pos_x = new_x;
-    ghost->pos_y = new_y;
+    ghosts->pos_x[ghost_index] = new_index % board->width;
+    ghosts->pos_y[ghost_index] = new_index / board->width;
     // Update board - set new position
-    board->board[new_index].content = 'M';
+    set_occupant(board, new_index, GHOST_ENTITY(ghost_index));
 
     if (old_index < new_index) {
         pthread_mutex_unlock(&board->board[old_index].lock);
@@ -425,67 +369,279 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
     return INVALID_MOVE;
 }
 
+// Helper private function that maps a direction ('W', 'S', 'A', 'D') to GOP_UP..GOP_RIGHT, -1 for none
+static int direction_op(char direction) {
+    switch (direction) {
+        case 'W': return GOP_UP;
+        case 'S': return GOP_DOWN;
+        case 'A': return GOP_LEFT;
+        case 'D': return GOP_RIGHT;
+        default: return -1;
+    }
+}
+
+/*
+The batch runs in phases over the ghost arrays: the passo countdown and the target cells are
+branch-free loops over the whole batch, only the script fetch branches per ghost. Moves are then
+applied in ghost order, so a ghost that ends up blocked by one moved earlier in the same
+batch stays put, exactly as if the ghosts had been moved one by one.
+*/
+void move_ghosts(board_t* board, const unsigned char* due) {
+    static const char directions[] = {'W', 'S', 'A', 'D'}; // indexed by GOP_UP..GOP_RIGHT
+    static const int step_x[] = {0, 0, -1, 1};
+    static const int step_y[] = {-1, 1, 0, 0};
+
+    ghosts_t* ghosts = &board->ghosts;
+    int n = board->n_ghosts;
+    int* restrict waiting = ghosts->waiting;
+    const int* restrict passo = ghosts->passo;
+    const int* pos_x = ghosts->pos_x; // also written by the moves in step 4
+    const int* pos_y = ghosts->pos_y;
+    unsigned char active[MAX_GHOSTS];
+    signed char op[MAX_GHOSTS]; // direction (GOP_UP..GOP_RIGHT) or -1 to stay
+    unsigned char chasing[MAX_GHOSTS];
+    int target[MAX_GHOSTS];
+    unsigned char inside[MAX_GHOSTS];
+
+    unsigned char all[MAX_GHOSTS];
+    if (!due) {
+        memset(all, 1, sizeof(all));
+        due = all;
+    }
+
+    // 1. Check passo: a ghost whose turn it is waits while waiting > 0, otherwise plays and starts over
+    for (int i = 0; i < n; i++) {
+        int turn = due[i] != 0;
+        int play = turn & (waiting[i] == 0);
+        active[i] = (unsigned char)play;
+        waiting[i] = waiting[i] - turn + play * (passo[i] + 1); // playing: 0 - 1 + passo + 1
+    }
+
+    // 2. Next command of each script (waits, loops, charges and random directions are resolved here)
+    for (int i = 0; i < n; i++) {
+        op[i] = -1;
+        chasing[i] = 0;
+        if (!active[i]) continue;
+        int command = ghost_script_next(ghosts, i);
+        if (command == GOP_RANDOM) command = rand_r(&board->rng) % 4;
+
+        if (command == GOP_CHARGE) ghosts->charged[i] = 1;
+        else if (command == GOP_CHASE) {
+            // one step down the shared distance field, or stay if no pacman can be reached
+            command = direction_op(flow_field_step(board, pos_x[i], pos_y[i]));
+            chasing[i] = 1;
+        }
+        if (command <= GOP_RIGHT) op[i] = (signed char)command;
+    }
+
+    // 3. Target cell of every ghost that moves one cell (the others get their own position)
+    int width = board->width, height = board->height;
+    for (int i = 0; i < n; i++) {
+        int d = op[i];
+        int x = pos_x[i] + (d == GOP_RIGHT) - (d == GOP_LEFT);
+        int y = pos_y[i] + (d == GOP_DOWN) - (d == GOP_UP);
+        inside[i] = (unsigned char)(((unsigned)x < (unsigned)width) & ((unsigned)y < (unsigned)height));
+        target[i] = y * width + x;
+    }
+
+    // 4. Apply the moves in ghost order; a pacman killed on the way changes where the chasers go
+    int killed = 0;
+    for (int i = 0; i < n; i++) {
+        if (op[i] < 0) continue;
+        int d = op[i];
+        if (killed && chasing[i]) {
+            d = direction_op(flow_field_step(board, pos_x[i], pos_y[i]));
+            if (d < 0) continue;
+            int x = pos_x[i] + step_x[d];
+            int y = pos_y[i] + step_y[d];
+            inside[i] = is_valid_position(board, x, y);
+            target[i] = y * board->width + x;
+        }
+
+        int result;
+        if (ghosts->charged[i]) result = move_ghost_charged(board, i, directions[d]);
+        else if (!inside[i]) result = INVALID_MOVE;
+        else result = move_ghost_to(board, i, target[i]);
+        if (result == DEAD_PACMAN) killed = 1;
+    }
+}
+
 void kill_pacman(board_t* board, int pacman_index) {
     debug("Killing %d pacman\n\n", pacman_index);
     pacman_t* pac = &board->pacmans[pacman_index];
     int index = pac->pos_y * board->width + pac->pos_x;
 
     // Remove pacman from the board
-    board->board[index].content = ' ';
+    set_occupant(board, index, NO_ENTITY);
 
     // Mark pacman as dead
     pac->alive = 0;
+    flow_field_invalidate(board);
 }
 
 // Static Loading
-int load_pacman(board_t* board, GameSession *session, int points) {
-    int x = 0, y = 0;
-    int idx = 0;
-    int found = 0;
-
-    for(y = 0; y < board->height; y++) {
-        for(x = 0; x < board->width; x++) {
-            idx = get_board_index(board, x, y);
-            if (session->grid[idx] == '.' ) {
-                found = 1;
-                break;
-            }
+// Helper private function that puts a pacman on a free position
+static void place_pacman(board_t* board, int pacman_index, int points, int idx) {
+    pacman_t* pac = &board->pacmans[pacman_index];
+    int x = idx % board->width;
+    int y = idx / board->width;
+    set_occupant(board, idx, pacman_index); // Pacman
+    pac->pos_x = x;
+    pac->pos_y = y;
+    pac->alive = 1;
+    pac->points = points;
+    pac->waiting = pac->passo;
+    flow_field_invalidate(board);
+
+    debug("Pacman %d loaded at (%d, %d) with %d points\n", pacman_index, x, y, points);
+}
+
+int load_pacman(board_t* board, int pacman_index, int points) {
+    int idx = -1;
+
+    // First dot with nobody on it, 64 positions at a time
+    for (int w = 0; w < board->bitboard_words; w++) {
+        uint64_t free_dots = board->dots[w] & ~board->walls[w] & ~board->ghost_cells[w] & ~board->pacman_cells[w];
+        if (free_dots) {
+            idx = w * 64 + __builtin_ctzll(free_dots);
+            break;
         }
-        if (found) break;
     }
 
-    if (!found) {
+    if (idx == -1) {
         debug("Error: No valid position found for Pacman\n");
         return -1;
     }
 
-    board->board[idx].content = 'P'; // Pacman
-    board->pacmans[0].pos_x = x;
-    board->pacmans[0].pos_y = y;
-    board->pacmans[0].alive = 1;
-    board->pacmans[0].points = points;
+    place_pacman(board, pacman_index, points, idx);
+    return 0;
+}
+
+int load_pacman_at(board_t* board, int pacman_index, int points, int x, int y) {
+    if (!is_valid_position(board, x, y)) return load_pacman(board, pacman_index, points);
+
+    int idx = get_board_index(board, x, y);
+    if (bit_test(board->walls, idx) || board->occupant[idx] != NO_ENTITY) {
+        debug("Pacman position (%d, %d) taken, using the first free dot\n", x, y);
+        return load_pacman(board, pacman_index, points);
+    }
+    place_pacman(board, pacman_index, points, idx);
+    return 0;
+}
 
-    session->grid[idx] = 'C';
-    session->pacman_x = x;
-    session->pacman_y = y;
-    session->score = points;
+// Helper private function that builds the bitboards from the loaded positions
+static int build_bitboards(board_t* board) {
+    int cells = board->width * board->height;
+    int words = (cells + 63) / 64;
+    board->bitboard_words = words;
+    board->walls = level_alloc(board, words, sizeof(uint64_t));
+    board->dots = level_alloc(board, words, sizeof(uint64_t));
+    board->portals = level_alloc(board, words, sizeof(uint64_t));
+    board->ghost_cells = level_alloc(board, words, sizeof(uint64_t));
+    board->pacman_cells = level_alloc(board, words, sizeof(uint64_t));
+    board->occupant = level_alloc(board, cells, sizeof(short));
+    if (!board->walls || !board->dots || !board->portals || !board->ghost_cells || !board->pacman_cells ||
+        !board->occupant) return -1;
+
+    for (int i = 0; i < cells; i++) {
+        board_pos_t* pos = &board->board[i];
+        if (pos->content == 'W') bit_set(board->walls, i);
+        if (pos->has_dot) bit_set(board->dots, i);
+        if (pos->has_portal) bit_set(board->portals, i);
+        board->occupant[i] = NO_ENTITY;
+    }
+    for (int g = 0; g < board->n_ghosts; g++) {
+        int idx = get_board_index(board, board->ghosts.pos_x[g], board->ghosts.pos_y[g]);
+        bit_set(board->ghost_cells, idx);
+        board->occupant[idx] = (short)GHOST_ENTITY(g);
+    }
+
+    board->dots_left = 0;
+    for (int w = 0; w < words; w++) {
+        board->dots_left += __builtin_popcountll(board->dots[w]);
+    }
+    return 0;
+}
 
-    debug("Pacman loaded at (%d, %d) with %d points\n", x, y, points);
+// Helper private function that builds the nearest-wall tables used by charged ghosts
+static int build_wall_tables(board_t* board) {
+    int cells = board->width * board->height;
+    board->wall_left = level_alloc(board, cells, sizeof(int));
+    board->wall_right = level_alloc(board, cells, sizeof(int));
+    board->wall_up = level_alloc(board, cells, sizeof(int));
+    board->wall_down = level_alloc(board, cells, sizeof(int));
+    if (!board->wall_left || !board->wall_right || !board->wall_up || !board->wall_down) return -1;
+
+    // One pass per direction, carrying the last wall seen
+    for (int y = 0; y < board->height; y++) {
+        int wall = -1;
+        for (int x = 0; x < board->width; x++) {
+            int idx = get_board_index(board, x, y);
+            board->wall_left[idx] = wall;
+            if (bit_test(board->walls, idx)) wall = x;
+        }
+        wall = board->width;
+        for (int x = board->width - 1; x >= 0; x--) {
+            int idx = get_board_index(board, x, y);
+            board->wall_right[idx] = wall;
+            if (bit_test(board->walls, idx)) wall = x;
+        }
+    }
+    for (int x = 0; x < board->width; x++) {
+        int wall = -1;
+        for (int y = 0; y < board->height; y++) {
+            int idx = get_board_index(board, x, y);
+            board->wall_up[idx] = wall;
+            if (bit_test(board->walls, idx)) wall = y;
+        }
+        wall = board->height;
+        for (int y = board->height - 1; y >= 0; y--) {
+            int idx = get_board_index(board, x, y);
+            board->wall_down[idx] = wall;
+            if (bit_test(board->walls, idx)) wall = y;
+        }
+    }
     return 0;
 }
 
-int load_level(board_t *board, GameSession *session, char *filename, char* dirname, int acc_points) {
+// Helper private function that drops the level's references to the shared ghost scripts
+static void release_ghost_scripts(board_t* board) {
+    for (int i = 0; board->ghosts.script && i < board->n_ghosts; i++) {
+        ghost_script_release(board->ghosts.script[i]);
+        board->ghosts.script[i] = NULL;
+    }
+}
+
+int load_level(board_t *board, char *filename, char* dirname) {
+    board->rng = (unsigned int)rand(); // each level draws its own sequence, callers may reseed it
 
-    if (read_level(board, session, filename, dirname) < 0) {
+    if (read_level(board, filename, dirname) < 0) {
         debug("Failed to load level\n");
         return -1;
     }
-    
-    load_pacman(board, session, acc_points);
 
     if (read_ghosts(board) < 0) {
         debug("Failed to read ghosts\n");
-        return -1;
+        goto load_level_failed;
+    }
+
+    if (build_bitboards(board) < 0) {
+        debug("Failed to build bitboards\n");
+        goto load_level_failed;
+    }
+
+    if (build_wall_tables(board) < 0) {
+        debug("Failed to build wall tables\n");
+        goto load_level_failed;
+    }
+
+    // The distance field is only kept when some ghost chases
+    for (int g = 0; g < board->n_ghosts && !board->flow; g++) {
+        if (!board->ghosts.script[g]->has_chase) continue;
+        if (flow_field_init(board) < 0) {
+            debug("Failed to build distance field\n");
+            goto load_level_failed;
+        }
     }
 
     pthread_rwlock_init(&board->state_lock, NULL);
@@ -495,6 +651,74 @@ int load_level(board_t *board, GameSession *session, char *filename, char* dirna
     }
 
     return 0;
+
+    load_level_failed:
+    release_ghost_scripts(board);
+    return -1;
+}
+
+int copy_level(board_t *board, const board_t *from) {
+    arena_t *arena = board->arena;
+    *board = *from; // sizes, names and counters, the arrays are replaced below
+    board->arena = arena;
+    board->flow = NULL;
+    board->rng = (unsigned int)rand();
+
+    int cells = from->width * from->height;
+    int words = from->bitboard_words;
+    board->board = level_alloc(board, cells, sizeof(board_pos_t));
+    board->cells = level_alloc(board, cells, sizeof(unsigned char));
+    board->pacmans = level_alloc(board, board->n_pacmans, sizeof(pacman_t));
+    board->walls = level_alloc(board, words, sizeof(uint64_t));
+    board->dots = level_alloc(board, words, sizeof(uint64_t));
+    board->portals = level_alloc(board, words, sizeof(uint64_t));
+    board->ghost_cells = level_alloc(board, words, sizeof(uint64_t));
+    board->pacman_cells = level_alloc(board, words, sizeof(uint64_t));
+    board->occupant = level_alloc(board, cells, sizeof(short));
+    board->wall_left = level_alloc(board, cells, sizeof(int));
+    board->wall_right = level_alloc(board, cells, sizeof(int));
+    board->wall_up = level_alloc(board, cells, sizeof(int));
+    board->wall_down = level_alloc(board, cells, sizeof(int));
+    // The scripts are only retained once everything is copied, a failure leaves the original's alone
+    if (!board->board || !board->cells || !board->pacmans || !board->walls || !board->dots || !board->portals ||
+        !board->ghost_cells || !board->pacman_cells || !board->occupant || !board->wall_left ||
+        !board->wall_right || !board->wall_up || !board->wall_down || alloc_ghosts(board) < 0) {
+        debug("Failed to allocate level copy\n");
+        board->ghosts.script = NULL;
+        return -1;
+    }
+
+    memcpy(board->board, from->board, cells * sizeof(board_pos_t));
+    memcpy(board->cells, from->cells, cells * sizeof(unsigned char));
+    memcpy(board->pacmans, from->pacmans, board->n_pacmans * sizeof(pacman_t));
+    memcpy(board->walls, from->walls, words * sizeof(uint64_t));
+    memcpy(board->dots, from->dots, words * sizeof(uint64_t));
+    memcpy(board->portals, from->portals, words * sizeof(uint64_t));
+    memcpy(board->ghost_cells, from->ghost_cells, words * sizeof(uint64_t));
+    memcpy(board->pacman_cells, from->pacman_cells, words * sizeof(uint64_t));
+    memcpy(board->occupant, from->occupant, cells * sizeof(short));
+    memcpy(board->wall_left, from->wall_left, cells * sizeof(int));
+    memcpy(board->wall_right, from->wall_right, cells * sizeof(int));
+    memcpy(board->wall_up, from->wall_up, cells * sizeof(int));
+    memcpy(board->wall_down, from->wall_down, cells * sizeof(int));
+    memcpy(board->ghosts.script, from->ghosts.script, board->n_ghosts * GHOST_STATE_SIZE); // same layout, one block
+
+    for (int g = 0; g < board->n_ghosts; g++) {
+        ghost_script_retain(board->ghosts.script[g]);
+    }
+
+    // The distance field follows the pacmans, each copy starts its own (stale until a ghost chases)
+    if (from->flow && flow_field_init(board) < 0) {
+        debug("Failed to build distance field\n");
+        release_ghost_scripts(board);
+        return -1;
+    }
+
+    pthread_rwlock_init(&board->state_lock, NULL);
+    for (int i = 0; i < cells; i++) {
+        pthread_mutex_init(&board->board[i].lock, NULL);
+    }
+    return 0;
 }
 
 void unload_level(board_t * board) {
@@ -502,7 +726,61 @@ void unload_level(board_t * board) {
     for (int i = 0; i < board->height * board->width; i++) {
         pthread_mutex_destroy(&board->board[i].lock);
     }
+    release_ghost_scripts(board); // shared, they outlive the arena
+    if (board->arena) return; // a arena é devolvida de uma vez por quem a tem
     free(board->board);
+    free(board->cells);
     free(board->pacmans);
-    free(board->ghosts);
+    free(board->ghosts.script); // all the ghost arrays are one block
+    free(board->walls);
+    free(board->dots);
+    free(board->portals);
+    free(board->ghost_cells);
+    free(board->pacman_cells);
+    free(board->occupant);
+    free(board->wall_left);
+    free(board->wall_right);
+    free(board->wall_up);
+    free(board->wall_down);
+    if (board->flow) {
+        free(board->flow->dist);
+        free(board->flow->queue);
+        free(board->flow);
+    }
+}
+
+size_t level_memory_size(int width, int height) {
+    size_t cells = (size_t)width * height;
+    size_t words = (cells + 63) / 64;
+    return sizeof(board_t) + cells * sizeof(board_pos_t) + cells + 4 * cells * sizeof(int)
+         + 5 * words * sizeof(uint64_t) + cells * sizeof(short)
+         + MAX_PACMANS * sizeof(pacman_t) + MAX_GHOSTS * GHOST_STATE_SIZE
+         + flow_field_size(width, height) // só usado se algum monstro persegue, mas reservado não custa
+         + 15 * ARENA_ALIGN; // alinhamento de cada uma das alocações
+}
+
+int alloc_ghosts(board_t *board) {
+    // One block, the script pointers first so that every array stays aligned
+    int n = board->n_ghosts;
+    char *block = level_alloc(board, n > 0 ? n : 1, GHOST_STATE_SIZE);
+    if (!block) return -1;
+
+    ghosts_t *ghosts = &board->ghosts;
+    ghosts->script = (struct ghost_script **)block;
+    int *ints = (int *)(block + n * sizeof(struct ghost_script *));
+    ghosts->pos_x = ints;
+    ghosts->pos_y = ints + n;
+    ghosts->passo = ints + 2 * n;
+    ghosts->waiting = ints + 3 * n;
+    ghosts->charged = ints + 4 * n;
+    ghosts->pc = ints + 5 * n;
+    ghosts->wait_left = ints + 6 * n;
+    ghosts->loop_depth = ints + 7 * n;
+    ghosts->loop_left = ints + 8 * n;
+    return 0;
+}
+
+void *level_alloc(board_t *board, size_t count, size_t size) {
+    if (board->arena) return arena_alloc(board->arena, count * size);
+    return calloc(count, size);
 }
@@ -0,0 +1,501 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "coroutine.h"
+#include "debug.h"
+
+typedef struct coroutine {
+    ucontext_t context;
+    void (*fn)(void *);
+    void *arg;
+    char *stack;         // mmap com uma página de guarda no fundo
+    int parked;          // cedeu para esperar (por tempo ou por fd), não só para passar a vez
+    long long wake_ms;   // fim da espera, -1 = sem limite
+    int fd;              // fd esperado, -1 = só tempo
+    short events;
+    short revents;
+    int poll_index;      // posição do fd no poll do escalonador
+    int done;
+    struct coroutine *next;
+    struct scheduler *sched;       // escalonador onde corre, acordado pelo wake_pipe
+    void *park_addr;               // lock ou contador por que espera numa fila de park_buckets
+    int woken;                     // tirado da fila por quem largou o lock ou mudou o contador
+    struct coroutine *park_next;
+} coroutine_t;
+
+typedef struct scheduler {
+    pthread_t tid;
+    ucontext_t main_context;    // ciclo do escalonador, para onde as corrotinas cedem
+    coroutine_t *current;
+    coroutine_t *ready;         // prontas a correr (só o próprio escalonador mexe nas listas)
+    coroutine_t *ready_tail;
+    coroutine_t *waiting;       // à espera de tempo ou de um fd
+    pthread_mutex_t inbox_lock; // protege inbox
+    coroutine_t *inbox;         // criadas por outras tarefas
+    int wake_pipe[2];           // acorda o poll quando chega uma corrotina ao inbox
+} scheduler_t;
+
+static scheduler_t *schedulers = NULL;
+static int n_schedulers = 0;
+static unsigned int next_scheduler = 0;
+static sigset_t coro_sigmask;   // máscara de sinais de quem arrancou os escalonadores
+static size_t page_size;
+
+static _Thread_local scheduler_t *this_scheduler = NULL;
+
+/*
+Filas de espera por endereço (de um lock ou de um contador), partilhadas por todos os escalonadores.
+Uma corrotina que não consegue o lock entra na fila e sai do escalonador até quem o larga
+(coro_mutex_unlock / coro_rwlock_unlock) ou muda o contador (coro_wake) a acordar.
+waiters conta também as tarefas à espera de um contador no futex, para quem acorda só tocar
+no bucket se houver alguém
+*/
+#define PARK_BUCKETS 64
+
+typedef struct {
+    pthread_mutex_t lock;
+    coroutine_t *head;
+    int waiters;
+} park_bucket_t;
+
+static park_bucket_t park_buckets[PARK_BUCKETS] = {
+    [0 ... PARK_BUCKETS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+
+static park_bucket_t *bucket_of(void *addr) {
+    uintptr_t key = (uintptr_t)addr;
+    return &park_buckets[(key >> 4 ^ key >> 10) % PARK_BUCKETS];
+}
+
+/*Função auxiliar para o tempo monotónico em milissegundos*/
+static long long monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void push_ready(scheduler_t *sched, coroutine_t *co) {
+    co->next = NULL;
+    if (sched->ready_tail) sched->ready_tail->next = co;
+    else sched->ready = co;
+    sched->ready_tail = co;
+}
+
+static void coroutine_free(coroutine_t *co) {
+    munmap(co->stack, CORO_STACK_SIZE);
+    free(co);
+}
+
+/*Primeira função de cada corrotina, ao terminar volta ao ciclo do escalonador (uc_link)*/
+static void coro_entry(void) {
+    coroutine_t *co = this_scheduler->current;
+    co->fn(co->arg);
+    co->done = 1;
+}
+
+/*Função auxiliar que devolve o controlo ao escalonador*/
+static void coro_switch_out(void) {
+    scheduler_t *sched = this_scheduler;
+    swapcontext(&sched->current->context, &sched->main_context);
+}
+
+/*Tarefa de cada escalonador: corre as corrotinas prontas e espera pelos tempos e fds das restantes*/
+static void *scheduler_thread(void *arg) {
+    scheduler_t *sched = (scheduler_t *)arg;
+    this_scheduler = sched;
+
+    struct pollfd *pfds = NULL;
+    int pfds_capacity = 0;
+
+    while (1) {
+        // 1. Receber as corrotinas criadas por outras tarefas
+        pthread_mutex_lock(&sched->inbox_lock);
+        coroutine_t *inbox = sched->inbox;
+        sched->inbox = NULL;
+        pthread_mutex_unlock(&sched->inbox_lock);
+        while (inbox) {
+            coroutine_t *next = inbox->next;
+            push_ready(sched, inbox);
+            inbox = next;
+        }
+
+        // 2. Correr cada corrotina pronta até ceder (as que voltam a ficar prontas correm na próxima volta)
+        coroutine_t *ready = sched->ready;
+        sched->ready = sched->ready_tail = NULL;
+        while (ready) {
+            coroutine_t *co = ready;
+            ready = co->next;
+
+            sched->current = co;
+            swapcontext(&sched->main_context, &co->context);
+            sched->current = NULL;
+
+            if (co->done) {
+                coroutine_free(co);
+            }
+            else if (co->parked && __atomic_load_n(&co->woken, __ATOMIC_ACQUIRE)) {
+                co->parked = 0; // acordada antes de sair do escalonador
+                push_ready(sched, co);
+            }
+            else if (co->parked) {
+                co->next = sched->waiting;
+                sched->waiting = co;
+            }
+            else {
+                push_ready(sched, co);
+            }
+        }
+
+        // 3. Juntar os fds esperados e o fim de espera mais próximo (sem esperar se há corrotinas prontas)
+        if (pfds_capacity == 0) {
+            pfds = malloc(64 * sizeof(struct pollfd));
+            if (!pfds) continue;
+            pfds_capacity = 64;
+        }
+        long long now = monotonic_ms();
+        int timeout = sched->ready ? 0 : -1;
+        int n = 1;
+        for (coroutine_t *co = sched->waiting; co; co = co->next) {
+            if (co->wake_ms != -1) {
+                int left = (co->wake_ms > now) ? (int)(co->wake_ms - now) : 0;
+                if (timeout == -1 || left < timeout) timeout = left;
+            }
+            co->poll_index = -1;
+            if (co->fd == -1) continue;
+
+            if (n >= pfds_capacity) {
+                int capacity = pfds_capacity ? 2 * pfds_capacity : 64;
+                struct pollfd *grown = realloc(pfds, capacity * sizeof(struct pollfd));
+                if (!grown) continue; // fica só com o tempo, volta a tentar na próxima volta
+                pfds = grown;
+                pfds_capacity = capacity;
+            }
+            pfds[n].fd = co->fd;
+            pfds[n].events = co->events;
+            co->poll_index = n++;
+        }
+        pfds[0].fd = sched->wake_pipe[0];
+        pfds[0].events = POLLIN;
+        if (poll(pfds, n, timeout) == -1) continue;
+
+        if (pfds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(sched->wake_pipe[0], drain, sizeof(drain)) > 0);
+        }
+
+        // 4. Acordar as corrotinas com o fd pronto ou com o tempo acabado
+        now = monotonic_ms();
+        for (coroutine_t **it = &sched->waiting; *it;) {
+            coroutine_t *co = *it;
+            short revents = (co->poll_index > 0) ? pfds[co->poll_index].revents : 0;
+            int woken = __atomic_load_n(&co->woken, __ATOMIC_ACQUIRE);
+            if (revents == 0 && !woken && (co->wake_ms == -1 || now < co->wake_ms)) {
+                it = &co->next;
+                continue;
+            }
+            *it = co->next;
+            co->revents = revents;
+            co->parked = 0;
+            push_ready(sched, co);
+        }
+    }
+    return NULL;
+}
+
+int coro_start(int n_threads) {
+    if (n_threads <= 0) n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads <= 0) n_threads = 1;
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+    pthread_sigmask(SIG_SETMASK, NULL, &coro_sigmask);
+
+    schedulers = calloc(n_threads, sizeof(scheduler_t));
+    if (!schedulers) return -1;
+
+    for (int i = 0; i < n_threads; i++) {
+        scheduler_t *sched = &schedulers[i];
+        pthread_mutex_init(&sched->inbox_lock, NULL);
+        if (pipe(sched->wake_pipe) == -1) break;
+        fcntl(sched->wake_pipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(sched->wake_pipe[1], F_SETFL, O_NONBLOCK);
+        if (pthread_create(&sched->tid, NULL, scheduler_thread, sched) != 0) {
+            close(sched->wake_pipe[0]);
+            close(sched->wake_pipe[1]);
+            break;
+        }
+        pthread_detach(sched->tid);
+        n_schedulers++;
+    }
+    debug("Coroutine schedulers started: %d\n", n_schedulers);
+    return n_schedulers > 0 ? 0 : -1;
+}
+
+int coro_spawn(void (*fn)(void *), void *arg) {
+    if (n_schedulers == 0) return -1;
+
+    // 1. Pilha reservada sem ocupar memória, com uma página de guarda para um overflow não passar despercebido
+    coroutine_t *co = calloc(1, sizeof(coroutine_t));
+    if (!co) return -1;
+    co->stack = mmap(NULL, CORO_STACK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (co->stack == MAP_FAILED) {
+        free(co);
+        return -1;
+    }
+    mprotect(co->stack, page_size, PROT_NONE);
+
+    // 2. Escolher o escalonador à vez
+    unsigned int index = __atomic_fetch_add(&next_scheduler, 1, __ATOMIC_RELAXED) % n_schedulers;
+    scheduler_t *sched = &schedulers[index];
+
+    co->fn = fn;
+    co->arg = arg;
+    co->sched = sched;
+    co->fd = -1;
+    co->wake_ms = -1;
+    getcontext(&co->context);
+    co->context.uc_stack.ss_sp = co->stack + page_size;
+    co->context.uc_stack.ss_size = CORO_STACK_SIZE - page_size;
+    co->context.uc_link = &sched->main_context;
+    co->context.uc_sigmask = coro_sigmask; // não a de quem cria, que pode esperar sinais
+    makecontext(&co->context, coro_entry, 0);
+
+    // 3. Entregar ao escalonador e acordá-lo
+    pthread_mutex_lock(&sched->inbox_lock);
+    co->next = sched->inbox;
+    sched->inbox = co;
+    pthread_mutex_unlock(&sched->inbox_lock);
+    if (write(sched->wake_pipe[1], "", 1) == -1) {
+        // Pipe cheio: o escalonador já tem acordares pendentes
+    }
+    return 0;
+}
+
+int coro_running(void) {
+    return this_scheduler != NULL && this_scheduler->current != NULL;
+}
+
+void coro_yield(void) {
+    if (!coro_running()) return;
+    this_scheduler->current->parked = 0;
+    coro_switch_out();
+}
+
+void coro_sleep_ms(int milliseconds) {
+    if (!coro_running()) {
+        sleep_ms(milliseconds);
+        return;
+    }
+    coroutine_t *co = this_scheduler->current;
+    co->fd = -1;
+    co->wake_ms = monotonic_ms() + milliseconds;
+    co->parked = 1;
+    coro_switch_out();
+}
+
+void coro_sleep_until_ms(long long deadline_ms) {
+    if (!coro_running()) {
+        struct timespec deadline = { .tv_sec = deadline_ms / 1000, .tv_nsec = (deadline_ms % 1000) * 1000000L };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+        return;
+    }
+    coroutine_t *co = this_scheduler->current;
+    co->fd = -1;
+    co->wake_ms = deadline_ms;
+    co->parked = 1;
+    coro_switch_out();
+}
+
+int coro_poll(int fd, short events, int timeout_ms) {
+    if (!coro_running()) {
+        struct pollfd pfd = { .fd = fd, .events = events };
+        int n = poll(&pfd, 1, timeout_ms);
+        return (n > 0) ? pfd.revents : n;
+    }
+    coroutine_t *co = this_scheduler->current;
+    co->fd = fd;
+    co->events = events;
+    co->revents = 0;
+    co->wake_ms = (timeout_ms < 0) ? -1 : monotonic_ms() + timeout_ms;
+    co->parked = 1;
+    coro_switch_out();
+    co->fd = -1;
+    return co->revents;
+}
+
+/*Função auxiliar que põe a corrotina na fila de addr e sai do escalonador até ser acordada ou passar
+timeout_ms (-1 = sem limite). ready é tentada já com o bucket trancado: se der 1 não espera.
+Devolve o que ready deu*/
+static int park(void *addr, int (*ready)(void *addr, void *arg), void *arg, int timeout_ms) {
+    coroutine_t *co = this_scheduler->current;
+    park_bucket_t *bucket = bucket_of(addr);
+
+    // 1. Anunciar a espera antes da última tentativa: quem larga o lock depois vê-a em waiters
+    pthread_mutex_lock(&bucket->lock);
+    __atomic_add_fetch(&bucket->waiters, 1, __ATOMIC_SEQ_CST);
+    if (ready(addr, arg)) {
+        __atomic_sub_fetch(&bucket->waiters, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&bucket->lock);
+        return 1;
+    }
+    co->park_addr = addr;
+    __atomic_store_n(&co->woken, 0, __ATOMIC_RELAXED);
+    co->park_next = bucket->head;
+    bucket->head = co;
+    pthread_mutex_unlock(&bucket->lock);
+
+    // 2. Esperar sem fd, só pelo acordar ou pelo tempo
+    co->fd = -1;
+    co->wake_ms = (timeout_ms < 0) ? -1 : monotonic_ms() + timeout_ms;
+    co->parked = 1;
+    coro_switch_out();
+
+    // 3. Acordada pelo tempo: ainda está na fila
+    pthread_mutex_lock(&bucket->lock);
+    if (!__atomic_load_n(&co->woken, __ATOMIC_ACQUIRE)) {
+        for (coroutine_t **it = &bucket->head; *it; it = &(*it)->park_next) {
+            if (*it != co) continue;
+            *it = co->park_next;
+            __atomic_sub_fetch(&bucket->waiters, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    __atomic_store_n(&co->woken, 0, __ATOMIC_RELAXED); // fora da fila, as próximas esperas não a veem
+    pthread_mutex_unlock(&bucket->lock);
+    return 0;
+}
+
+/*Função auxiliar que acorda as corrotinas na fila de addr (só a primeira com one)*/
+static void unpark(void *addr, int one) {
+    park_bucket_t *bucket = bucket_of(addr);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // o lock largado ou o contador mudado antes de ler waiters
+    if (__atomic_load_n(&bucket->waiters, __ATOMIC_SEQ_CST) == 0) return;
+
+    pthread_mutex_lock(&bucket->lock);
+    for (coroutine_t **it = &bucket->head; *it;) {
+        coroutine_t *co = *it;
+        if (co->park_addr != addr) {
+            it = &co->park_next;
+            continue;
+        }
+        *it = co->park_next;
+        __atomic_sub_fetch(&bucket->waiters, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&co->woken, 1, __ATOMIC_RELEASE);
+        if (write(co->sched->wake_pipe[1], "", 1) == -1) {
+            // Pipe cheio: o escalonador já tem acordares pendentes
+        }
+        if (one) break;
+    }
+    pthread_mutex_unlock(&bucket->lock);
+}
+
+static int try_mutex(void *addr, void *arg) {
+    (void)arg;
+    return pthread_mutex_trylock((pthread_mutex_t *)addr) == 0;
+}
+
+static int try_rdlock(void *addr, void *arg) {
+    (void)arg;
+    return pthread_rwlock_tryrdlock((pthread_rwlock_t *)addr) == 0;
+}
+
+static int try_wrlock(void *addr, void *arg) {
+    (void)arg;
+    return pthread_rwlock_trywrlock((pthread_rwlock_t *)addr) == 0;
+}
+
+void coro_mutex_lock(pthread_mutex_t *mutex) {
+    if (!coro_running()) {
+        pthread_mutex_lock(mutex);
+        return;
+    }
+    if (pthread_mutex_trylock(mutex) == 0) return;
+    while (!park(mutex, try_mutex, NULL, -1));
+}
+
+void coro_mutex_unlock(pthread_mutex_t *mutex) {
+    pthread_mutex_unlock(mutex);
+    unpark(mutex, 1);
+}
+
+void coro_rwlock_rdlock(pthread_rwlock_t *lock) {
+    if (!coro_running()) {
+        pthread_rwlock_rdlock(lock);
+        return;
+    }
+    if (pthread_rwlock_tryrdlock(lock) == 0) return;
+    while (!park(lock, try_rdlock, NULL, -1));
+}
+
+void coro_rwlock_wrlock(pthread_rwlock_t *lock) {
+    if (!coro_running()) {
+        pthread_rwlock_wrlock(lock);
+        return;
+    }
+    if (pthread_rwlock_trywrlock(lock) == 0) return;
+    while (!park(lock, try_wrlock, NULL, -1));
+}
+
+void coro_rwlock_unlock(pthread_rwlock_t *lock) {
+    pthread_rwlock_unlock(lock);
+    unpark(lock, 0); // leitores podem entrar todos, um escritor que perca volta para a fila
+}
+
+static int word_changed(void *addr, void *arg) {
+    return __atomic_load_n((int *)addr, __ATOMIC_SEQ_CST) != *(int *)arg;
+}
+
+int coro_wait(int *word, int value, int timeout_ms) {
+    if (coro_running()) {
+        park(word, word_changed, &value, timeout_ms);
+        return word_changed(word, &value);
+    }
+
+    // Fora de uma corrotina: futex, contado em waiters para coro_wake saber que tem de o acordar
+    park_bucket_t *bucket = bucket_of(word);
+    __atomic_add_fetch(&bucket->waiters, 1, __ATOMIC_SEQ_CST);
+    struct timespec ts = { .tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L };
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, (timeout_ms >= 0) ? &ts : NULL, NULL, 0);
+    __atomic_sub_fetch(&bucket->waiters, 1, __ATOMIC_RELAXED);
+    return word_changed(word, &value);
+}
+
+void coro_wake(int *word) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&bucket_of(word)->waiters, __ATOMIC_SEQ_CST) == 0) return;
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    unpark(word, 0);
+}
+
+ssize_t coro_write(int fd, const void *buf, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, (const char *)buf + done, size - done);
+        if (n > 0) {
+            done += n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Cliente sem espaço para mais: só esta corrotina espera
+            int revents = coro_poll(fd, POLLOUT, -1);
+            if (revents < 0 || (revents & (POLLERR | POLLHUP | POLLNVAL))) return -1;
+            continue;
+        }
+        return -1;
+    }
+    return (ssize_t)size;
+}
@@ -0,0 +1,147 @@
+#include <string.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include "encoder.h"
+#include "debug.h"
+
+// Tabela de 16 entradas para o pshufb, as posições sem código ficam a '?'
+static const char cell_symbols[16] = BOARD_SYMBOLS "?????????";
+
+int encoded_size(int n_cells, int encoding) {
+    if (encoding == BOARD_ENCODING_PACKED4) return (n_cells + 1) / 2;
+    return n_cells;
+}
+
+/*Traduz cada código para o símbolo que o cliente desenha*/
+static int encode_raw_scalar(const unsigned char *cells, int n_cells, char *out) {
+    for (int i = 0; i < n_cells; i++) {
+        out[i] = cell_symbols[cells[i] & 0x0F];
+    }
+    return n_cells;
+}
+
+#ifdef __SSE2__
+/*Mesma tradução, 16 células de cada vez: os códigos são índices na tabela do pshufb*/
+__attribute__((target("ssse3")))
+static int encode_raw_ssse3(const unsigned char *cells, int n_cells, char *out) {
+    const __m128i table = _mm_loadu_si128((const __m128i *)cell_symbols);
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+    int i = 0;
+    for (; i + 16 <= n_cells; i += 16) {
+        __m128i codes = _mm_and_si128(_mm_loadu_si128((const __m128i *)(cells + i)), low_nibble);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_shuffle_epi8(table, codes));
+    }
+    encode_raw_scalar(cells + i, n_cells - i, out + i);
+    return n_cells;
+}
+
+/*Mesma tradução, 32 células de cada vez (o vpshufb procura em cada metade de 128 bits)*/
+__attribute__((target("avx2")))
+static int encode_raw_avx2(const unsigned char *cells, int n_cells, char *out) {
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)cell_symbols));
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    int i = 0;
+    for (; i + 32 <= n_cells; i += 32) {
+        __m256i codes = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(cells + i)), low_nibble);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_shuffle_epi8(table, codes));
+    }
+    encode_raw_scalar(cells + i, n_cells - i, out + i);
+    return n_cells;
+}
+#endif
+
+/*Junta duas células por byte: célula par no nibble baixo, ímpar no nibble alto*/
+static int encode_packed4_scalar(const unsigned char *cells, int n_cells, char *out) {
+    int i = 0;
+    for (; i + 1 < n_cells; i += 2) {
+        out[i / 2] = (char)((cells[i] & 0x0F) | (cells[i + 1] << 4));
+    }
+    if (i < n_cells) {
+        out[i / 2] = (char)(cells[i] & 0x0F);
+    }
+    return (n_cells + 1) / 2;
+}
+
+#ifdef __SSE2__
+/*Mesma junção, 32 células por iteração: em cada palavra de 16 bits (par | ímpar << 8) já sem os
+nibbles altos, (w | w >> 4) & 0xFF dá par | ímpar << 4, e packus junta as palavras em bytes*/
+static int encode_packed4_sse2(const unsigned char *cells, int n_cells, char *out) {
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+    const __m128i low_byte = _mm_set1_epi16(0x00FF);
+    int i = 0;
+    for (; i + 32 <= n_cells; i += 32) {
+        __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i *)(cells + i)), low_nibble);
+        __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i *)(cells + i + 16)), low_nibble);
+        a = _mm_and_si128(_mm_or_si128(a, _mm_srli_epi16(a, 4)), low_byte);
+        b = _mm_and_si128(_mm_or_si128(b, _mm_srli_epi16(b, 4)), low_byte);
+        _mm_storeu_si128((__m128i *)(out + i / 2), _mm_packus_epi16(a, b));
+    }
+    encode_packed4_scalar(cells + i, n_cells - i, out + i / 2);
+    return (n_cells + 1) / 2;
+}
+
+/*Mesma junção, 64 células por iteração. O packus trabalha em cada metade de 128 bits,
+o permute volta a pôr os quatro blocos de 8 bytes por ordem*/
+__attribute__((target("avx2")))
+static int encode_packed4_avx2(const unsigned char *cells, int n_cells, char *out) {
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    const __m256i low_byte = _mm256_set1_epi16(0x00FF);
+    int i = 0;
+    for (; i + 64 <= n_cells; i += 64) {
+        __m256i a = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(cells + i)), low_nibble);
+        __m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(cells + i + 32)), low_nibble);
+        a = _mm256_and_si256(_mm256_or_si256(a, _mm256_srli_epi16(a, 4)), low_byte);
+        b = _mm256_and_si256(_mm256_or_si256(b, _mm256_srli_epi16(b, 4)), low_byte);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i *)(out + i / 2), packed);
+    }
+    encode_packed4_scalar(cells + i, n_cells - i, out + i / 2);
+    return (n_cells + 1) / 2;
+}
+#endif
+
+// Versões escolhidas em runtime por encoder_init, as escalares servem em qualquer CPU
+static int (*encode_raw)(const unsigned char *, int, char *) = encode_raw_scalar;
+static int (*encode_packed4)(const unsigned char *, int, char *) = encode_packed4_scalar;
+
+int encoder_use(int isa) {
+    switch (isa) {
+    case ENCODER_SCALAR:
+        encode_raw = encode_raw_scalar;
+        encode_packed4 = encode_packed4_scalar;
+        return 0;
+#ifdef __SSE2__
+    case ENCODER_SSSE3:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("ssse3")) return -1;
+        encode_raw = encode_raw_ssse3;
+        encode_packed4 = encode_packed4_sse2;
+        return 0;
+    case ENCODER_AVX2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2")) return -1;
+        encode_raw = encode_raw_avx2;
+        encode_packed4 = encode_packed4_avx2;
+        return 0;
+#endif
+    default:
+        return -1;
+    }
+}
+
+void encoder_init(void) {
+    static const char *names[ENCODER_ISAS] = {"scalar", "SSSE3", "AVX2"};
+    for (int isa = ENCODER_ISAS - 1; isa >= 0; isa--) {
+        if (encoder_use(isa) == 0) {
+            debug("Encoder: using %s symbol lookup and packing\n", names[isa]);
+            return;
+        }
+    }
+}
+
+int encode_cells(const unsigned char *cells, int n_cells, int encoding, char *out) {
+    if (encoding == BOARD_ENCODING_PACKED4) return encode_packed4(cells, n_cells, out);
+    return encode_raw(cells, n_cells, out);
+}
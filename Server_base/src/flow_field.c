@@ -0,0 +1,90 @@
+#include <stdlib.h>
+
+#include "flow_field.h"
+#include "debug.h"
+
+static const int step_dx[4] = { 0, -1, 0, 1 };
+static const int step_dy[4] = { -1, 0, 1, 0 };
+static const char step_dir[4] = { 'W', 'A', 'S', 'D' };
+
+/*Função auxiliar que diz se se pode andar para (x, y)*/
+static inline int open_position(board_t *board, int x, int y) {
+    if (x < 0 || x >= board->width || y < 0 || y >= board->height) return 0;
+    int idx = y * board->width + x;
+    return !((board->walls[idx >> 6] >> (idx & 63)) & 1);
+}
+
+int flow_field_init(board_t *board) {
+    int cells = board->width * board->height;
+    flow_field_t *flow = level_alloc(board, 1, sizeof(flow_field_t));
+    if (!flow) return -1;
+    flow->dist = level_alloc(board, cells, sizeof(int));
+    flow->queue = level_alloc(board, cells, sizeof(int));
+    if (!flow->dist || !flow->queue) return -1;
+
+    flow->stale = 1;
+    board->flow = flow;
+    return 0;
+}
+
+void flow_field_invalidate(board_t *board) {
+    if (board->flow) board->flow->stale = 1;
+}
+
+/*Função auxiliar que refaz o campo com um BFS a partir de todos os pacmans vivos*/
+static void flow_field_rebuild(board_t *board) {
+    flow_field_t *flow = board->flow;
+    int width = board->width, cells = board->width * board->height;
+    int *dist = flow->dist;
+
+    // 1. Sementes: as posições dos pacmans vivos, a distância 0
+    for (int i = 0; i < cells; i++) dist[i] = FLOW_UNREACHABLE;
+    int head = 0, tail = 0;
+    for (int p = 0; p < board->n_pacmans; p++) {
+        pacman_t *pac = &board->pacmans[p];
+        if (!pac->alive) continue;
+        int source = pac->pos_y * width + pac->pos_x;
+        if (dist[source] == 0) continue;
+        dist[source] = 0;
+        flow->queue[tail++] = source;
+    }
+
+    // 2. Propagar por ordem de distância
+    while (head < tail) {
+        int v = flow->queue[head++];
+        int x = v % width, y = v / width;
+        for (int d = 0; d < 4; d++) {
+            int nx = x + step_dx[d], ny = y + step_dy[d];
+            if (!open_position(board, nx, ny)) continue;
+            int n = ny * width + nx;
+            if (dist[n] != FLOW_UNREACHABLE) continue;
+            dist[n] = dist[v] + 1;
+            flow->queue[tail++] = n;
+        }
+    }
+    flow->stale = 0;
+}
+
+char flow_field_step(board_t *board, int x, int y) {
+    flow_field_t *flow = board->flow;
+    if (!flow) return 0;
+    if (flow->stale) flow_field_rebuild(board);
+
+    int best = flow->dist[y * board->width + x];
+    char direction = 0;
+    for (int d = 0; d < 4; d++) {
+        int nx = x + step_dx[d], ny = y + step_dy[d];
+        if (!open_position(board, nx, ny)) continue;
+        int n = ny * board->width + nx;
+        if (flow->dist[n] < best) {
+            best = flow->dist[n];
+            direction = step_dir[d];
+        }
+    }
+    return direction;
+}
+
+size_t flow_field_size(int width, int height) {
+    size_t cells = (size_t)width * height;
+    return sizeof(flow_field_t) + cells * (sizeof(int) + sizeof(int)) + 3 * ARENA_ALIGN;
+}
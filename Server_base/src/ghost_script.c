@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ghost_script.h"
+#include "parser.h"
+#include "debug.h"
+
+#define OPERAND_SIZE ((int)sizeof(int))
+
+static pthread_mutex_t scripts_lock = PTHREAD_MUTEX_INITIALIZER;
+static ghost_script_t *scripts = NULL; // programas partilhados em uso
+
+/*Função auxiliar que lê o operando de uma instrução*/
+static int operand(const unsigned char *instruction) {
+    int value;
+    memcpy(&value, instruction + 1, OPERAND_SIZE);
+    return value;
+}
+
+/*Função auxiliar que acrescenta uma instrução ao programa (operando só se has_operand)*/
+static void emit(ghost_script_builder_t *builder, int op, int has_operand, int value) {
+    int needed = builder->size + 1 + (has_operand ? OPERAND_SIZE : 0);
+    if (needed > builder->capacity) {
+        int capacity = builder->capacity ? 2 * builder->capacity : 64;
+        while (capacity < needed) capacity *= 2;
+        unsigned char *grown = realloc(builder->code, capacity);
+        if (!grown) {
+            builder->failed = 1;
+            return;
+        }
+        builder->code = grown;
+        builder->capacity = capacity;
+    }
+    builder->code[builder->size] = (unsigned char)op;
+    if (has_operand) memcpy(builder->code + builder->size + 1, &value, OPERAND_SIZE);
+    builder->size = needed;
+}
+
+/*Função auxiliar que fecha o REPEAT mais interior; um bloco sem movimentos é retirado*/
+static void close_loop(ghost_script_builder_t *builder) {
+    builder->depth--;
+    int start = builder->loops[builder->depth];
+    if (builder->moves == builder->loop_moves[builder->depth]) {
+        builder->size = start; // sem isto o monstro ficava preso a dar voltas sem gastar turnos
+        return;
+    }
+    emit(builder, GOP_END, 1, start + 1 + OPERAND_SIZE);
+}
+
+void ghost_script_begin(ghost_script_builder_t *builder) {
+    memset(builder, 0, sizeof(*builder));
+}
+
+int ghost_script_add_line(ghost_script_builder_t *builder, const char *line) {
+    char fields[MAX_COMMAND_LENGTH];
+    strncpy(fields, line, sizeof(fields) - 1);
+    fields[sizeof(fields) - 1] = '\0';
+
+    char *save;
+    char *word = strtok_r(fields, " \t\r\n", &save);
+    if (!word) return -1;
+    char *arg = strtok_r(NULL, " \t\r\n", &save);
+
+    if (strcmp(word, "REPEAT") == 0) {
+        int times = arg ? atoi(arg) : 0;
+        if (times <= 0 || builder->depth == GHOST_LOOP_DEPTH || builder->skipped) {
+            builder->skipped++; // o bloco corre uma vez, sem repetir
+            return 0;
+        }
+        builder->loops[builder->depth] = builder->size;
+        builder->loop_moves[builder->depth] = builder->moves;
+        builder->depth++;
+        emit(builder, GOP_REPEAT, 1, times);
+        return 0;
+    }
+    if (strcmp(word, "END") == 0) {
+        if (builder->skipped) builder->skipped--;
+        else if (builder->depth > 0) close_loop(builder);
+        else return -1;
+        return 0;
+    }
+    if (word[0] == 'T' && word[1] == '\0') {
+        int turns = arg ? atoi(arg) : 0;
+        if (turns <= 0) return -1;
+        emit(builder, GOP_WAIT, 1, turns);
+        builder->moves++;
+        return 0;
+    }
+
+    int op;
+    switch (word[0]) {
+        case 'W': op = GOP_UP; break;
+        case 'S': op = GOP_DOWN; break;
+        case 'A': op = GOP_LEFT; break;
+        case 'D': op = GOP_RIGHT; break;
+        case 'R': op = GOP_RANDOM; break;
+        case 'C': op = GOP_CHARGE; break;
+        case 'H': op = GOP_CHASE; break;
+        default: return -1;
+    }
+    emit(builder, op, 0, 0);
+    builder->moves++;
+    return 0;
+}
+
+ghost_script_t *ghost_script_finish(ghost_script_builder_t *builder) {
+    // 1. Fechar os blocos que o ficheiro deixou abertos
+    while (builder->depth > 0) close_loop(builder);
+    if (builder->failed) {
+        free(builder->code);
+        return NULL;
+    }
+
+    // 2. Resumo do programa (FNV-1a) e se persegue algum pacman
+    unsigned int hash = 2166136261u;
+    int has_chase = 0;
+    for (int pc = 0; pc < builder->size;) {
+        int op = builder->code[pc];
+        if (op == GOP_CHASE) has_chase = 1;
+        pc += (op >= GOP_WAIT) ? 1 + OPERAND_SIZE : 1;
+    }
+    for (int i = 0; i < builder->size; i++) {
+        hash = (hash ^ builder->code[i]) * 16777619u;
+    }
+
+    // 3. Reaproveitar um programa igual já carregado, ou guardar este
+    pthread_mutex_lock(&scripts_lock);
+    ghost_script_t *script = scripts;
+    while (script && (script->hash != hash || script->size != builder->size ||
+                      memcmp(script->code, builder->code, builder->size) != 0)) {
+        script = script->next;
+    }
+    if (script) {
+        script->refcount++;
+    }
+    else if ((script = malloc(sizeof(ghost_script_t) + builder->size)) != NULL) {
+        script->hash = hash;
+        script->refcount = 1;
+        script->has_chase = has_chase;
+        script->size = builder->size;
+        if (builder->size > 0) memcpy(script->code, builder->code, builder->size);
+        script->next = scripts;
+        scripts = script;
+        debug("Ghost script compiled: %d bytes\n", script->size);
+    }
+    pthread_mutex_unlock(&scripts_lock);
+
+    free(builder->code);
+    return script;
+}
+
+void ghost_script_retain(ghost_script_t *script) {
+    if (!script) return;
+
+    pthread_mutex_lock(&scripts_lock);
+    script->refcount++;
+    pthread_mutex_unlock(&scripts_lock);
+}
+
+void ghost_script_release(ghost_script_t *script) {
+    if (!script) return;
+
+    pthread_mutex_lock(&scripts_lock);
+    if (--script->refcount == 0) {
+        ghost_script_t **it = &scripts;
+        while (*it != script) it = &(*it)->next;
+        *it = script->next;
+        free(script);
+    }
+    pthread_mutex_unlock(&scripts_lock);
+}
+
+int ghost_script_step(const ghost_script_t *script, int *pc_state, int *wait_left, int *loop_depth, int *loop_left) {
+    if (!script || script->size == 0) return GOP_WAIT;
+
+    int pc = *pc_state;
+    int depth = *loop_depth;
+    int op;
+
+    // Os blocos não gastam turnos; todos têm um movimento, por isso o ciclo acaba
+    while (1) {
+        if (pc >= script->size) {
+            pc = 0;
+            depth = 0;
+        }
+        const unsigned char *instruction = script->code + pc;
+        op = instruction[0];
+        if (op == GOP_REPEAT) {
+            loop_left[depth++] = operand(instruction);
+            pc += 1 + OPERAND_SIZE;
+        }
+        else if (op == GOP_END) {
+            if (--loop_left[depth - 1] > 0) {
+                pc = operand(instruction);
+            }
+            else {
+                depth--;
+                pc += 1 + OPERAND_SIZE;
+            }
+        }
+        else if (op == GOP_WAIT) {
+            if (*wait_left == 0) *wait_left = operand(instruction);
+            if (--*wait_left == 0) pc += 1 + OPERAND_SIZE;
+            break;
+        }
+        else {
+            pc += 1;
+            break;
+        }
+    }
+
+    *pc_state = pc;
+    *loop_depth = depth;
+    return op;
+}
+
+int ghost_script_next(ghosts_t *ghosts, int ghost_index) {
+    return ghost_script_step(ghosts->script[ghost_index], &ghosts->pc[ghost_index], &ghosts->wait_left[ghost_index],
+                             &ghosts->loop_depth[ghost_index], ghosts->loop_left + ghost_index * GHOST_LOOP_DEPTH);
+}
@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "headless.h"
+#include "parser.h"
+#include "debug.h"
+
+char script_policy(board_t *board, int pacman_index, void *state) {
+    (void)board;
+    (void)pacman_index;
+    script_policy_t *policy = (script_policy_t *)state;
+    int op = ghost_script_step(policy->script, &policy->pc, &policy->wait_left, &policy->loop_depth, policy->loop_left);
+    return (op <= GOP_RANDOM) ? "WSADR"[op] : 0;
+}
+
+void headless_read_pacman(board_t *board, headless_pacman_t *pacman) {
+    pacman_t start = { .pos_x = -1, .pos_y = -1 };
+    pacman->script = board->pacman_file[0] ? read_pacman(board, &start) : NULL;
+    pacman->pos_x = start.pos_x;
+    pacman->pos_y = start.pos_y;
+    pacman->passo = start.passo;
+}
+
+void headless_free_pacman(headless_pacman_t *pacman) {
+    ghost_script_release(pacman->script);
+    pacman->script = NULL;
+}
+
+int headless_place_pacman(board_t *board, int points, const headless_pacman_t *pacman, script_policy_t *policy) {
+    memset(policy, 0, sizeof(*policy));
+    policy->script = pacman->script;
+
+    board->pacmans[0].passo = pacman->passo;
+    return load_pacman_at(board, 0, points, pacman->pos_x, pacman->pos_y);
+}
+
+int headless_play_level(board_t *board, pacman_policy_t policy, void *state, long long max_ticks, long long *ticks) {
+    pacman_t *pac = &board->pacmans[0];
+    unsigned char due[MAX_GHOSTS];
+    int result = VALID_MOVE;
+    long long tick = 0;
+
+    while (result == VALID_MOVE && tick < max_ticks) {
+        tick++;
+
+        // 1. Jogada do pacman, só depois da espera do passo: durante a espera a política não avança
+        char command = 0;
+        if (pac->waiting > 0) pac->waiting--;
+        else command = policy(board, 0, state);
+        if (command) {
+            command_t play = { .command = command, .turns = 1 };
+            if (move_pacman(board, 0, &play) == REACHED_PORTAL) {
+                result = REACHED_PORTAL;
+                break;
+            }
+        }
+
+        // 2. Monstros com a vez neste tick
+        for (int i = 0; i < board->n_ghosts; i++) {
+            due[i] = (tick % (1 + board->ghosts.passo[i]) == 0);
+        }
+        move_ghosts(board, due);
+        if (!pac->alive) result = DEAD_PACMAN;
+    }
+
+    *ticks += tick;
+    return result;
+}
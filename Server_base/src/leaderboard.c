@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "leaderboard.h"
+#include "debug.h"
+#include "affinity.h"
+#include "coroutine.h"
+
+#define INDEX_MAGIC "PACIDX1"
+
+/*
+Formato do ficheiro de índice (gerado apenas pela compactação):
+    index_header_t
+    leaderboard_record_t by_score[count]  -> ordenado por pontos (desc)
+    int by_player[count]                  -> posições em by_score ordenadas por (client_id, posição)
+Como by_score já está ordenado, os jogos de cada jogador ficam seguidos e por ordem de pontos.
+*/
+typedef struct {
+    char magic[8];
+    int count;        // número de registos no índice
+    int log_records;  // quantos registos do log já estão no índice
+} index_header_t;
+
+// Índice mapeado em memória (protegido por index_lock)
+static pthread_rwlock_t index_lock = PTHREAD_RWLOCK_INITIALIZER;
+static void *index_map = NULL;
+static size_t index_map_size = 0;
+static const index_header_t *index_header = NULL;
+static const leaderboard_record_t *index_scores = NULL;
+static const int *index_players = NULL;
+
+// Registos já escritos no log mas ainda fora do índice (também protegidos por index_lock)
+static leaderboard_record_t *delta = NULL;
+static int delta_count = 0;
+static int delta_capacity = 0;
+
+// Fila produtor-consumidor entre as sessões e a tarefa de escrita
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int queue_changes = 0; // jogos entregues ou fecho, esperados pela tarefa de escrita (coro_wait)
+static leaderboard_record_t queue[LEADERBOARD_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static int writer_running = 0;
+
+static int log_fd = -1;
+static int log_records = 0;
+static int covered_records = 0; // prefixo do log que está no índice ou no delta (só a tarefa de escrita o muda)
+static pthread_t writer_tid;
+
+/*Ordem do leaderboard: mais pontos, depois jogo mais curto, depois o mais antigo*/
+static int compare_score(const void *a, const void *b) {
+    const leaderboard_record_t *ra = a, *rb = b;
+    if (ra->points != rb->points) return (ra->points < rb->points) ? 1 : -1;
+    if (ra->duration_ms != rb->duration_ms) return (ra->duration_ms > rb->duration_ms) ? 1 : -1;
+    if (ra->finished_at != rb->finished_at) return (ra->finished_at > rb->finished_at) ? 1 : -1;
+    return 0;
+}
+
+// Só a tarefa de escrita ordena by_player, por isso basta um ponteiro estático
+static const leaderboard_record_t *sorting_scores = NULL;
+
+static int compare_player(const void *a, const void *b) {
+    int pa = *(const int *)a, pb = *(const int *)b;
+    int c = strncmp(sorting_scores[pa].client_id, sorting_scores[pb].client_id, LEADERBOARD_ID_LENGTH);
+    if (c != 0) return c;
+    return pa - pb;
+}
+
+/*Mapeia o ficheiro de índice, devolve 0 se o índice for válido*/
+static int map_index(void **map, size_t *size) {
+    int fd = open(LEADERBOARD_INDEX_FILE, O_RDONLY);
+    if (fd == -1) return 1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(index_header_t)) {
+        close(fd);
+        return 1;
+    }
+
+    void *m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return 1;
+
+    const index_header_t *h = m;
+    size_t expected = sizeof(index_header_t) + (size_t)h->count * (sizeof(leaderboard_record_t) + sizeof(int));
+    if (memcmp(h->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || h->count < 0 ||
+        (size_t)st.st_size != expected) {
+        munmap(m, st.st_size);
+        return 1;
+    }
+
+    *map = m;
+    *size = st.st_size;
+    return 0;
+}
+
+static void set_index(void *map, size_t size) {
+    index_map = map;
+    index_map_size = size;
+    index_header = map;
+    index_scores = (const leaderboard_record_t *)((const char *)map + sizeof(index_header_t));
+    index_players = (const int *)(index_scores + index_header->count);
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = write(fd, (const char *)buf + total, len - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        total += n;
+    }
+    return 0;
+}
+
+static int delta_append(const leaderboard_record_t *records, int n) {
+    if (delta_count + n > delta_capacity) {
+        int capacity = delta_capacity ? delta_capacity : LEADERBOARD_COMPACT_THRESHOLD;
+        while (capacity < delta_count + n) capacity *= 2;
+        leaderboard_record_t *grown = realloc(delta, capacity * sizeof(leaderboard_record_t));
+        if (!grown) return 1;
+        delta = grown;
+        delta_capacity = capacity;
+    }
+    memcpy(delta + delta_count, records, n * sizeof(leaderboard_record_t));
+    delta_count += n;
+    return 0;
+}
+
+/*Funde o delta no índice e substitui o ficheiro de índice (só corre na tarefa de escrita)*/
+static void compact_index(void) {
+    // 1. O delta só é alterado por esta tarefa, logo pode ser lido sem lock
+    int old_count = index_header ? index_header->count : 0;
+    int n_delta = delta_count;
+    int count = old_count + n_delta;
+    if (n_delta == 0) return;
+
+    leaderboard_record_t *sorted_delta = malloc(n_delta * sizeof(leaderboard_record_t));
+    leaderboard_record_t *scores = malloc(count * sizeof(leaderboard_record_t));
+    int *players = malloc(count * sizeof(int));
+    if (!sorted_delta || !scores || !players) {
+        debug("Leaderboard: no memory to compact index\n");
+        goto compact_end;
+    }
+    memcpy(sorted_delta, delta, n_delta * sizeof(leaderboard_record_t));
+    qsort(sorted_delta, n_delta, sizeof(leaderboard_record_t), compare_score);
+
+    // 2. Merge do índice antigo (já ordenado) com o delta ordenado
+    int i = 0, j = 0, k = 0;
+    while (i < old_count && j < n_delta) {
+        if (compare_score(&index_scores[i], &sorted_delta[j]) <= 0) scores[k++] = index_scores[i++];
+        else scores[k++] = sorted_delta[j++];
+    }
+    while (i < old_count) scores[k++] = index_scores[i++];
+    while (j < n_delta) scores[k++] = sorted_delta[j++];
+
+    for (int p = 0; p < count; p++) players[p] = p;
+    sorting_scores = scores;
+    qsort(players, count, sizeof(int), compare_player);
+
+    // 3. Escrever num ficheiro temporário e trocar atomicamente com rename
+    index_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.count = count;
+    header.log_records = covered_records; // não o log inteiro: o que falhou o delta é relido ao abrir
+
+    char tmp_path[] = LEADERBOARD_INDEX_FILE ".tmp";
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        debug("Leaderboard: failed to create %s\n", tmp_path);
+        goto compact_end;
+    }
+    if (write_all(fd, &header, sizeof(header)) ||
+        write_all(fd, scores, count * sizeof(leaderboard_record_t)) ||
+        write_all(fd, players, count * sizeof(int)) ||
+        fsync(fd) == -1) {
+        debug("Leaderboard: failed to write index\n");
+        close(fd);
+        unlink(tmp_path);
+        goto compact_end;
+    }
+    close(fd);
+
+    if (rename(tmp_path, LEADERBOARD_INDEX_FILE) == -1) {
+        debug("Leaderboard: failed to replace index\n");
+        unlink(tmp_path);
+        goto compact_end;
+    }
+
+    void *map;
+    size_t size;
+    if (map_index(&map, &size) != 0) {
+        debug("Leaderboard: failed to map new index\n");
+        goto compact_end;
+    }
+
+    // 4. Trocar o mapeamento e descartar o delta já incluído
+    pthread_rwlock_wrlock(&index_lock);
+    void *old_map = index_map;
+    size_t old_size = index_map_size;
+    set_index(map, size);
+    memmove(delta, delta + n_delta, (delta_count - n_delta) * sizeof(leaderboard_record_t));
+    delta_count -= n_delta;
+    coro_rwlock_unlock(&index_lock);
+
+    if (old_map) munmap(old_map, old_size);
+    debug("Leaderboard: index compacted with %d games\n", count);
+
+    compact_end:
+    free(sorted_delta);
+    free(scores);
+    free(players);
+}
+
+/*Função auxiliar que junta ao delta os registos do log que ainda lá não estão (com index_lock).
+O lote acabado de escrever é o fim do log; o que ficou para trás (sem memória) é relido do ficheiro*/
+static void delta_catch_up(const leaderboard_record_t *batch, int n) {
+    int missing = log_records - covered_records - n;
+    if (missing > 0) {
+        leaderboard_record_t *gap = malloc(missing * sizeof(leaderboard_record_t));
+        ssize_t size = missing * sizeof(leaderboard_record_t);
+        int read_ok = gap && pread(log_fd, gap, size, (off_t)covered_records * sizeof(leaderboard_record_t)) == size;
+        int appended = read_ok && delta_append(gap, missing) == 0;
+        free(gap);
+        if (!appended) return;
+        covered_records += missing;
+    }
+    if (delta_append(batch, n) != 0) return;
+    covered_records += n;
+}
+
+/*Escreve no log um lote de jogos e torna-os visíveis às consultas*/
+static void append_batch(leaderboard_record_t *batch, int n) {
+    // 1. Um lote escrito a meio é cortado, para o próximo não ficar desalinhado dos registos
+    if (write_all(log_fd, batch, n * sizeof(leaderboard_record_t)) || fdatasync(log_fd) == -1) {
+        debug("Leaderboard: failed to append %d games to log\n", n);
+        if (ftruncate(log_fd, (off_t)log_records * sizeof(leaderboard_record_t)) == -1) {
+            debug("Leaderboard: failed to drop partial batch from log\n");
+        }
+        return;
+    }
+    log_records += n;
+
+    // 2. Sem memória para o delta, o índice não passa destes registos: ficam para a próxima vez, ou para a abertura
+    pthread_rwlock_wrlock(&index_lock);
+    delta_catch_up(batch, n);
+    if (covered_records != log_records) {
+        debug("Leaderboard: no memory for pending games\n");
+    }
+    coro_rwlock_unlock(&index_lock);
+}
+
+/*Tarefa responsável por toda a escrita em disco do leaderboard*/
+static void *leaderboard_thread(void *arg) {
+    (void)arg;
+    leaderboard_record_t batch[LEADERBOARD_QUEUE_SIZE];
+    affinity_pin(AFFINITY_LOG);
+
+    pthread_mutex_lock(&queue_mutex);
+    while (1) {
+        // 1. Esperar por jogos, compactando nos períodos sem trabalho. Sem variável de condição:
+        // as sessões em corrotina à espera de queue_mutex só acordam com coro_mutex_unlock
+        if (queue_count == 0 && writer_running) {
+            int seen = queue_changes;
+            coro_mutex_unlock(&queue_mutex);
+            int changed = coro_wait(&queue_changes, seen, LEADERBOARD_COMPACT_PERIOD_MS);
+            pthread_mutex_lock(&queue_mutex);
+            if (!changed && queue_count == 0) {
+                coro_mutex_unlock(&queue_mutex);
+                compact_index();
+                pthread_mutex_lock(&queue_mutex);
+            }
+            continue;
+        }
+        if (queue_count == 0 && !writer_running) break;
+
+        // 2. Retirar todos os jogos pendentes de uma vez
+        int n = 0;
+        while (queue_count > 0) {
+            batch[n++] = queue[queue_head];
+            queue_head = (queue_head + 1) % LEADERBOARD_QUEUE_SIZE;
+            queue_count--;
+        }
+        coro_mutex_unlock(&queue_mutex);
+
+        // 3. Escrever sem o lock da fila, as sessões nunca esperam pelo disco
+        append_batch(batch, n);
+        if (delta_count >= LEADERBOARD_COMPACT_THRESHOLD) {
+            compact_index();
+        }
+
+        pthread_mutex_lock(&queue_mutex);
+    }
+    coro_mutex_unlock(&queue_mutex);
+
+    compact_index();
+    return NULL;
+}
+
+int leaderboard_open(void) {
+    // 1. Abrir o log e descartar um registo incompleto no fim (escrita interrompida)
+    log_fd = open(LEADERBOARD_LOG_FILE, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (log_fd == -1) {
+        debug("Leaderboard: failed to open %s\n", LEADERBOARD_LOG_FILE);
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(log_fd, &st) == -1) {
+        close(log_fd);
+        log_fd = -1;
+        return 1;
+    }
+    log_records = st.st_size / sizeof(leaderboard_record_t);
+    if ((size_t)st.st_size != log_records * sizeof(leaderboard_record_t)) {
+        debug("Leaderboard: dropping torn record at end of log\n");
+        if (ftruncate(log_fd, log_records * sizeof(leaderboard_record_t)) == -1) {
+            close(log_fd);
+            log_fd = -1;
+            return 1;
+        }
+    }
+
+    // 2. Mapear o índice, se existir e for coerente com o log
+    void *map;
+    size_t size;
+    int indexed = 0;
+    if (map_index(&map, &size) == 0) {
+        const index_header_t *h = map;
+        if (h->log_records <= log_records) {
+            set_index(map, size);
+            indexed = h->log_records;
+        }
+        else {
+            debug("Leaderboard: index is ahead of log, rebuilding\n");
+            munmap(map, size);
+        }
+    }
+
+    // 3. O que está no log mas não no índice fica no delta até à próxima compactação
+    covered_records = indexed;
+    if (indexed < log_records) {
+        int n = log_records - indexed;
+        leaderboard_record_t *tail = malloc(n * sizeof(leaderboard_record_t));
+        if (!tail ||
+            pread(log_fd, tail, n * sizeof(leaderboard_record_t), (off_t)indexed * sizeof(leaderboard_record_t))
+                != (ssize_t)(n * sizeof(leaderboard_record_t)) ||
+            delta_append(tail, n) != 0) {
+            debug("Leaderboard: failed to read log tail\n");
+        }
+        else {
+            covered_records = log_records;
+        }
+        free(tail);
+    }
+    debug("Leaderboard: %d games in log, %d indexed\n", log_records, indexed);
+
+    // 4. Arrancar a tarefa de escrita
+    writer_running = 1;
+    if (pthread_create(&writer_tid, NULL, leaderboard_thread, NULL) != 0) {
+        writer_running = 0;
+        close(log_fd);
+        log_fd = -1;
+        return 1;
+    }
+    return 0;
+}
+
+void leaderboard_submit(const leaderboard_record_t *record) {
+    coro_mutex_lock(&queue_mutex);
+    if (!writer_running || queue_count == LEADERBOARD_QUEUE_SIZE) {
+        coro_mutex_unlock(&queue_mutex);
+        debug("Leaderboard: queue full, dropping game of %s\n", record->client_id);
+        return;
+    }
+    queue[(queue_head + queue_count) % LEADERBOARD_QUEUE_SIZE] = *record;
+    queue_count++;
+    __atomic_add_fetch(&queue_changes, 1, __ATOMIC_SEQ_CST);
+    coro_wake(&queue_changes);
+    coro_mutex_unlock(&queue_mutex);
+}
+
+/*Junta os candidatos do índice e do delta e fica com os k melhores*/
+static int select_best(leaderboard_record_t *candidates, int n, leaderboard_record_t *out, int k) {
+    qsort(candidates, n, sizeof(leaderboard_record_t), compare_score);
+    if (n > k) n = k;
+    memcpy(out, candidates, n * sizeof(leaderboard_record_t));
+    return n;
+}
+
+int leaderboard_top(leaderboard_record_t *out, int k) {
+    if (k <= 0) return 0;
+    coro_rwlock_rdlock(&index_lock);
+
+    int from_index = index_header ? index_header->count : 0;
+    if (from_index > k) from_index = k;
+
+    leaderboard_record_t *candidates = malloc((from_index + delta_count + 1) * sizeof(leaderboard_record_t));
+    if (!candidates) {
+        coro_rwlock_unlock(&index_lock);
+        return 0;
+    }
+    memcpy(candidates, index_scores, from_index * sizeof(leaderboard_record_t));
+    memcpy(candidates + from_index, delta, delta_count * sizeof(leaderboard_record_t));
+    int n = from_index + delta_count;
+    coro_rwlock_unlock(&index_lock);
+
+    n = select_best(candidates, n, out, k);
+    free(candidates);
+    return n;
+}
+
+int leaderboard_player(const char *client_id, leaderboard_record_t *out, int k) {
+    if (k <= 0) return 0;
+    coro_rwlock_rdlock(&index_lock);
+
+    // 1. Pesquisa binária pelo primeiro jogo do jogador em by_player
+    int count = index_header ? index_header->count : 0;
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strncmp(index_scores[index_players[mid]].client_id, client_id, LEADERBOARD_ID_LENGTH) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    leaderboard_record_t *candidates = malloc((k + delta_count + 1) * sizeof(leaderboard_record_t));
+    if (!candidates) {
+        coro_rwlock_unlock(&index_lock);
+        return 0;
+    }
+
+    // 2. Os jogos do jogador estão seguidos e já por ordem de pontos
+    int n = 0;
+    for (int p = lo; p < count && n < k; p++) {
+        const leaderboard_record_t *r = &index_scores[index_players[p]];
+        if (strncmp(r->client_id, client_id, LEADERBOARD_ID_LENGTH) != 0) break;
+        candidates[n++] = *r;
+    }
+    for (int d = 0; d < delta_count; d++) {
+        if (strncmp(delta[d].client_id, client_id, LEADERBOARD_ID_LENGTH) == 0) {
+            candidates[n++] = delta[d];
+        }
+    }
+    coro_rwlock_unlock(&index_lock);
+
+    n = select_best(candidates, n, out, k);
+    free(candidates);
+    return n;
+}
+
+void leaderboard_close(void) {
+    pthread_mutex_lock(&queue_mutex);
+    if (!writer_running) {
+        coro_mutex_unlock(&queue_mutex);
+        return;
+    }
+    writer_running = 0;
+    __atomic_add_fetch(&queue_changes, 1, __ATOMIC_SEQ_CST);
+    coro_wake(&queue_changes);
+    coro_mutex_unlock(&queue_mutex);
+
+    pthread_join(writer_tid, NULL);
+
+    close(log_fd);
+    log_fd = -1;
+    if (index_map) munmap(index_map, index_map_size);
+    index_map = NULL;
+    index_header = NULL;
+    free(delta);
+    delta = NULL;
+    delta_count = delta_capacity = 0;
+}
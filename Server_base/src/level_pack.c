@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+
+#include "level_pack.h"
+#include "parser.h"
+#include "affinity.h"
+#include "tick_clock.h"
+#include "debug.h"
+
+// Mudanças que dão uma versão nova; a diretoria apagada ou trocada obriga a voltar a vigiá-la
+#define LEVEL_PACK_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static pthread_mutex_t pack_lock = PTHREAD_MUTEX_INITIALIZER;
+static level_pack_t *current = NULL; // protegido por pack_lock, tal como as contagens
+static int last_version = 0;
+
+static char pack_dir[MAX_FILENAME];
+static int watching = 0;
+static pthread_t watch_tid;
+static int watch_fd = -1; // inotify, criado antes da primeira leitura da diretoria
+static int watch_wd = -1; // a diretoria vigiada, -1 se ainda não existe
+
+/*Função auxiliar que liberta uma versão que já ninguém usa*/
+static void pack_free(level_pack_t *pack) {
+    for (int i = 0; i < pack->n_levels; i++) {
+        headless_free_pacman(&pack->pacmans[i]);
+        unload_level(pack->levels[i]);
+        arena_destroy(&pack->arenas[i]);
+        free(pack->names[i]);
+    }
+    free(pack->names);
+    free(pack->levels);
+    free(pack->arenas);
+    free(pack->pacmans);
+    free(pack);
+}
+
+/*Função auxiliar que lista os ficheiros .lvl da diretoria com a memória que cada um vai ocupar.
+Devolve o número de ficheiros, -1 se a diretoria não abre*/
+static int list_level_files(level_pack_t *pack, char ***names, size_t **sizes) {
+    DIR *dir = opendir(pack_dir);
+    if (!dir) {
+        debug("Failed to open directory: %s\n", pack_dir);
+        return -1;
+    }
+
+    struct dirent *entry;
+    int n = 0, capacity = 0;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        char *dot = strrchr(entry->d_name, '.');
+        if (!dot || strcmp(dot, ".lvl") != 0) continue;
+
+        int width, height;
+        if (read_level_dim(entry->d_name, pack_dir, &width, &height) != 0 || width <= 0 || height <= 0) {
+            debug("Skipping level without dimensions: %s\n", entry->d_name);
+            continue;
+        }
+
+        if (n == capacity) {
+            capacity = capacity ? 2 * capacity : MAX_LEVELS;
+            char **grown = realloc(*names, capacity * sizeof(char *));
+            if (grown) *names = grown;
+            size_t *grown_sizes = grown ? realloc(*sizes, capacity * sizeof(size_t)) : NULL;
+            if (!grown_sizes) break;
+            *sizes = grown_sizes;
+        }
+        if (!((*names)[n] = strdup(entry->d_name))) continue;
+
+        size_t size = level_memory_size(width, height);
+        (*sizes)[n++] = size;
+        if (size > pack->largest) pack->largest = size;
+    }
+    closedir(dir);
+    return n;
+}
+
+/*Função auxiliar que lê a diretoria numa versão nova. Devolve NULL se não tem níveis*/
+static level_pack_t *pack_build(void) {
+    level_pack_t *pack = calloc(1, sizeof(level_pack_t));
+    if (!pack) return NULL;
+
+    // 1. Ficheiros e o tamanho de cada um
+    char **files = NULL;
+    size_t *sizes = NULL;
+    int n_files = list_level_files(pack, &files, &sizes);
+    if (n_files > 0) {
+        pack->names = calloc(n_files, sizeof(char *));
+        pack->levels = calloc(n_files, sizeof(board_t *));
+        pack->arenas = calloc(n_files, sizeof(arena_t));
+        pack->pacmans = calloc(n_files, sizeof(headless_pacman_t));
+    }
+    if (n_files <= 0 || !pack->names || !pack->levels || !pack->arenas || !pack->pacmans) {
+        for (int i = 0; i < n_files; i++) free(files[i]);
+        free(files);
+        free(sizes);
+        free(pack->names);
+        free(pack->levels);
+        free(pack->arenas);
+        free(pack->pacmans);
+        free(pack);
+        return NULL;
+    }
+
+    // 2. Carregar cada nível na sua arena, com o ficheiro PAC; os que falham ficam de fora, como ao jogar
+    for (int i = 0; i < n_files; i++) {
+        arena_t *arena = &pack->arenas[pack->n_levels];
+        board_t *board = (arena_init(arena, sizes[i]) == 0) ? arena_alloc(arena, sizeof(board_t)) : NULL;
+        if (board) board->arena = arena;
+        if (!board || load_level(board, files[i], pack_dir) == -1) {
+            debug("Failed to load level: %s\n", files[i]);
+            arena_destroy(arena);
+            free(files[i]);
+            continue;
+        }
+        headless_read_pacman(board, &pack->pacmans[pack->n_levels]);
+        pack->names[pack->n_levels] = files[i];
+        pack->levels[pack->n_levels] = board;
+        pack->n_levels++;
+    }
+    free(files);
+    free(sizes);
+
+    if (pack->n_levels == 0) {
+        pack_free(pack);
+        return NULL;
+    }
+    pack->refcount = 1; // a referência de ser a atual
+    return pack;
+}
+
+/*Função auxiliar que lê a diretoria e, se tem níveis, faz da versão nova a atual*/
+static void pack_reload(void) {
+    long long start = tick_clock_now_ms();
+    level_pack_t *pack = pack_build();
+    if (!pack) {
+        debug("Level pack in %s has no levels, keeping the current version\n", pack_dir);
+        return;
+    }
+
+    pthread_mutex_lock(&pack_lock);
+    pack->version = ++last_version;
+    level_pack_t *old = current;
+    current = pack;
+    pthread_mutex_unlock(&pack_lock);
+
+    debug("Level pack version %d: %d levels loaded in %lld ms\n", pack->version, pack->n_levels, tick_clock_now_ms() - start);
+    level_pack_release(old);
+}
+
+/*Tarefa que vigia a diretoria dos níveis e gera uma versão nova quando as mudanças acalmam*/
+static void *watch_thread(void *arg) {
+    (void)arg;
+    // Os níveis são tocados primeiro aqui e copiados pelos mundos, nos cores de simulação
+    affinity_pin(AFFINITY_SIM);
+
+    // Sem a diretoria na primeira leitura, a versão lê-se quando ela aparecer
+    int fd = watch_fd, wd = watch_wd;
+    int pending = 0, lost = (wd == -1);
+    long long last_event = 0;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (__atomic_load_n(&watching, __ATOMIC_ACQUIRE)) {
+        // 1. (Re)vigiar a diretoria; se voltou depois de apagada ou trocada, o conteúdo é outro
+        if (wd == -1 && (wd = inotify_add_watch(fd, pack_dir, LEVEL_PACK_EVENTS | IN_ONLYDIR)) != -1 && lost) {
+            lost = 0;
+            pending = 1;
+            last_event = tick_clock_now_ms();
+        }
+
+        // 2. Esperar por mudanças, e que acalmem antes de ler a diretoria
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, pending ? LEVEL_PACK_SETTLE_MS : LEVEL_PACK_POLL_MS) > 0) {
+            ssize_t n;
+            while ((n = read(fd, events, sizeof(events))) > 0) {
+                for (char *p = events; p < events + n;) {
+                    struct inotify_event *event = (struct inotify_event *)p;
+                    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                        inotify_rm_watch(fd, wd);
+                        wd = -1;
+                        lost = 1;
+                    }
+                    else if (!(event->mask & IN_IGNORED)) {
+                        pending = 1;
+                    }
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            last_event = tick_clock_now_ms();
+            continue;
+        }
+
+        // 3. Sem mudanças há LEVEL_PACK_SETTLE_MS: versão nova
+        if (pending && tick_clock_now_ms() - last_event >= LEVEL_PACK_SETTLE_MS) {
+            pending = 0;
+            pack_reload();
+        }
+    }
+
+    return NULL;
+}
+
+int level_pack_open(const char *dirpath, int watch) {
+    snprintf(pack_dir, sizeof(pack_dir), "%s", dirpath);
+
+    // 1. Vigiar antes de ler: uma mudança durante a primeira leitura já fica em fila para a tarefa
+    if (watch && (watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+        debug("inotify unavailable, level pack will not be reloaded\n");
+    }
+    if (watch_fd != -1) watch_wd = inotify_add_watch(watch_fd, pack_dir, LEVEL_PACK_EVENTS | IN_ONLYDIR);
+
+    // 2. Primeira versão
+    pack_reload();
+
+    // 3. As mudanças passam a ser tratadas em segundo plano
+    if (watch_fd != -1) {
+        __atomic_store_n(&watching, 1, __ATOMIC_RELEASE);
+        if (pthread_create(&watch_tid, NULL, watch_thread, NULL) != 0) {
+            debug("Failed to start level pack watcher\n");
+            watching = 0;
+            close(watch_fd);
+            watch_fd = -1;
+        }
+    }
+
+    pthread_mutex_lock(&pack_lock);
+    int loaded = (current != NULL);
+    pthread_mutex_unlock(&pack_lock);
+    return loaded ? 0 : -1;
+}
+
+level_pack_t *level_pack_acquire(void) {
+    pthread_mutex_lock(&pack_lock);
+    level_pack_t *pack = current;
+    if (pack) pack->refcount++;
+    pthread_mutex_unlock(&pack_lock);
+    return pack;
+}
+
+void level_pack_release(level_pack_t *pack) {
+    if (!pack) return;
+
+    pthread_mutex_lock(&pack_lock);
+    int last = (--pack->refcount == 0);
+    pthread_mutex_unlock(&pack_lock);
+
+    if (last) {
+        debug("Level pack version %d released\n", pack->version);
+        pack_free(pack);
+    }
+}
+
+void level_pack_close(void) {
+    if (__atomic_exchange_n(&watching, 0, __ATOMIC_ACQ_REL)) {
+        pthread_join(watch_tid, NULL);
+        close(watch_fd);
+        watch_fd = -1;
+    }
+
+    pthread_mutex_lock(&pack_lock);
+    level_pack_t *pack = current;
+    current = NULL;
+    pthread_mutex_unlock(&pack_lock);
+    level_pack_release(pack);
+}
@@ -0,0 +1,360 @@
+/*
+pacman_batch: avaliação offline de uma diretoria de níveis, para validar a dificuldade sem jogar à mão.
+Cada nível é jogado sozinho (sem passar ao seguinte) com muitas sementes e várias estratégias de
+pacman, repartido por todos os cores, com a mesma simulação do modo headless do servidor.
+Mostra por nível e estratégia a taxa de conclusão, a pontuação média e os ticks até ao portal.
+
+Uso: pacman_batch [-s sementes] [-j tarefas] [-t max_ticks] [-p script,random,greedy,portal] <diretoria>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "board.h"
+#include "headless.h"
+#include "arena.h"
+#include "tick_clock.h"
+#include "debug.h"
+
+#define BATCH_CHUNK 16 // execuções que um trabalhador tira de cada vez (sementes seguidas do mesmo nível)
+
+enum {
+    STRATEGY_SCRIPT, // o ficheiro PAC do nível
+    STRATEGY_RANDOM, // uma direção ao acaso em cada tick
+    STRATEGY_GREEDY, // o ponto mais próximo, e o portal quando já não há pontos
+    STRATEGY_PORTAL, // o caminho mais curto para o portal
+    N_STRATEGIES
+};
+
+static const char *strategy_names[N_STRATEGIES] = {"script", "random", "greedy", "portal"};
+
+typedef struct {
+    long long runs;
+    long long completed;      // chegou ao portal
+    long long deaths;
+    long long timeouts;       // não acabou em max_ticks
+    long long points;
+    long long portal_ticks;   // ticks somados das execuções que chegaram ao portal
+} batch_result_t;
+
+// Pacman que segue o caminho mais curto (BFS) até ao alvo, contornando paredes e monstros
+typedef struct {
+    int *queue;
+    signed char *first; // primeira jogada do caminho até cada posição, -1 = por visitar
+    int capacity;
+    int to_dots;        // 1 = ponto mais próximo (o portal sem pontos), 0 = só o portal
+} bfs_policy_t;
+
+typedef struct {
+    pthread_t tid;
+    batch_result_t *results; // n_levels * N_STRATEGIES, somados no fim
+    long long ticks;
+    bfs_policy_t bfs;
+    arena_t arena;           // o nível de cada execução, copiado e devolvido de uma vez
+} batch_worker_t;
+
+static char levels_dir[MAX_FILENAME];
+static char **levels = NULL;
+static int n_levels = 0;
+static board_t **templates = NULL;          // cada nível lido uma vez, copiado em cada execução
+static headless_pacman_t *pacmans = NULL;   // o ficheiro PAC de cada nível, lido uma vez
+static size_t largest = 0;                  // level_memory_size do maior nível
+static int strategies[N_STRATEGIES];
+static int n_strategies = 0;
+static int seeds = 1000;
+static long long max_ticks = HEADLESS_MAX_TICKS;
+static long long n_jobs = 0;
+static long long next_job = 0;
+
+static char random_policy(board_t *board, int pacman_index, void *state) {
+    (void)board;
+    (void)pacman_index;
+    (void)state;
+    return 'R'; // resolvido pelo move_pacman com a semente do tabuleiro
+}
+
+static char bfs_policy(board_t *board, int pacman_index, void *state) {
+    bfs_policy_t *bfs = (bfs_policy_t *)state;
+    int width = board->width;
+    int cells = width * board->height;
+    if (cells > bfs->capacity) {
+        int *queue = realloc(bfs->queue, cells * sizeof(int));
+        if (queue) bfs->queue = queue;
+        signed char *first = realloc(bfs->first, cells);
+        if (first) bfs->first = first;
+        if (!queue || !first) return 0;
+        bfs->capacity = cells;
+    }
+
+    static const int step_x[] = {0, 0, -1, 1};
+    static const int step_y[] = {-1, 1, 0, 0};
+    const uint64_t *targets = (bfs->to_dots && board->dots_left > 0) ? board->dots : board->portals;
+
+    pacman_t *pac = &board->pacmans[pacman_index];
+    int start = pac->pos_y * width + pac->pos_x;
+    memset(bfs->first, -1, cells);
+    bfs->first[start] = 0;
+    int head = 0, tail = 0;
+    bfs->queue[tail++] = start;
+
+    while (head < tail) {
+        int p = bfs->queue[head++];
+        if (p != start && bit_test(targets, p)) return "WSAD"[bfs->first[p]];
+
+        int x = p % width, y = p / width;
+        for (int d = 0; d < 4; d++) {
+            int nx = x + step_x[d], ny = y + step_y[d];
+            if (nx < 0 || nx >= width || ny < 0 || ny >= board->height) continue;
+            int q = ny * width + nx;
+            if (bfs->first[q] != -1 || bit_test(board->walls, q) || bit_test(board->ghost_cells, q)) continue;
+            bfs->first[q] = (p == start) ? d : bfs->first[p];
+            bfs->queue[tail++] = q;
+        }
+    }
+    return 0; // sem caminho: fica à espera que os monstros o abram
+}
+
+/*Função auxiliar que joga uma execução (nível, estratégia, semente) e soma o resultado*/
+static void run_job(batch_worker_t *worker, int level, int strategy, int seed) {
+    // 1. Cópia do nível já lido, sem tocar em ficheiros
+    board_t *board = arena_alloc(&worker->arena, sizeof(board_t));
+    if (!board) return;
+    board->arena = &worker->arena;
+    if (copy_level(board, templates[level]) == -1) {
+        arena_reset(&worker->arena);
+        return;
+    }
+    board->rng = (unsigned int)seed;
+
+    script_policy_t script;
+    if (headless_place_pacman(board, 0, &pacmans[level], &script) != 0) {
+        unload_level(board);
+        arena_reset(&worker->arena);
+        return;
+    }
+
+    pacman_policy_t policy = bfs_policy;
+    void *state = &worker->bfs;
+    if (strategy == STRATEGY_SCRIPT) {
+        policy = script_policy;
+        state = &script;
+    }
+    else if (strategy == STRATEGY_RANDOM) {
+        policy = random_policy;
+    }
+    worker->bfs.to_dots = (strategy == STRATEGY_GREEDY);
+
+    // 2. Jogar e somar o resultado
+    long long ticks = 0;
+    int result = headless_play_level(board, policy, state, max_ticks, &ticks);
+    worker->ticks += ticks;
+
+    batch_result_t *r = &worker->results[level * N_STRATEGIES + strategy];
+    r->runs++;
+    r->points += board->pacmans[0].points;
+    if (result == REACHED_PORTAL) {
+        r->completed++;
+        r->portal_ticks += ticks;
+    }
+    else if (result == DEAD_PACMAN) r->deaths++;
+    else r->timeouts++;
+
+    unload_level(board);
+    arena_reset(&worker->arena);
+}
+
+/*Tarefa de cada trabalhador: tira execuções aos blocos até se acabarem*/
+static void *batch_thread(void *arg) {
+    batch_worker_t *worker = (batch_worker_t *)arg;
+    // A arena é tocada primeiro por quem a usa; sem memória, blocos à medida
+    if (arena_init(&worker->arena, largest) != 0) arena_init(&worker->arena, 0);
+
+    while (1) {
+        long long first = __atomic_fetch_add(&next_job, BATCH_CHUNK, __ATOMIC_RELAXED);
+        if (first >= n_jobs) break;
+        long long last = (first + BATCH_CHUNK < n_jobs) ? first + BATCH_CHUNK : n_jobs;
+
+        // Execução j: semente j % seeds, estratégia e nível pelo resto
+        for (long long job = first; job < last; job++) {
+            int seed = (int)(job % seeds);
+            int strategy = strategies[(job / seeds) % n_strategies];
+            int level = (int)(job / seeds / n_strategies);
+            if (strategy == STRATEGY_SCRIPT && !pacmans[level].script) continue;
+            run_job(worker, level, strategy, seed + 1);
+        }
+    }
+    arena_destroy(&worker->arena);
+    return NULL;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*Função auxiliar que lista os níveis da diretoria por nome e lê cada um, com o seu ficheiro PAC, uma só vez.
+Devolve o número de níveis, -1 se a diretoria não abre*/
+static int list_levels(void) {
+    DIR *dir = opendir(levels_dir);
+    if (!dir) return -1;
+
+    struct dirent *entry;
+    int capacity = 0;
+    while ((entry = readdir(dir)) != NULL) {
+        char *dot = strrchr(entry->d_name, '.');
+        if (entry->d_name[0] == '.' || !dot || strcmp(dot, ".lvl") != 0) continue;
+
+        if (n_levels == capacity) {
+            capacity = capacity ? 2 * capacity : MAX_LEVELS;
+            char **grown = realloc(levels, capacity * sizeof(char *));
+            if (!grown) break;
+            levels = grown;
+        }
+        if ((levels[n_levels] = strdup(entry->d_name)) != NULL) n_levels++;
+    }
+    closedir(dir);
+    if (n_levels == 0) return 0;
+    qsort(levels, n_levels, sizeof(char *), compare_names);
+
+    // Um nível que não carrega é tirado da lista, para as execuções não falharem aos milhares
+    templates = calloc(n_levels, sizeof(board_t *));
+    pacmans = calloc(n_levels, sizeof(headless_pacman_t));
+    if (!templates || !pacmans) return -1;
+    int kept = 0;
+    for (int i = 0; i < n_levels; i++) {
+        board_t *board = calloc(1, sizeof(board_t));
+        if (!board || load_level(board, levels[i], levels_dir) == -1) {
+            fprintf(stderr, "Skipping %s: failed to load\n", levels[i]);
+            free(board);
+            free(levels[i]);
+            continue;
+        }
+        headless_read_pacman(board, &pacmans[kept]);
+        size_t size = level_memory_size(board->width, board->height);
+        if (size > largest) largest = size;
+        templates[kept] = board;
+        levels[kept++] = levels[i];
+    }
+    n_levels = kept;
+    return n_levels;
+}
+
+/*Função auxiliar que lê a lista de estratégias ("greedy,portal"), devolve -1 se tem uma desconhecida*/
+static int parse_strategies(char *list) {
+    n_strategies = 0;
+    char *save;
+    for (char *name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        int found = -1;
+        for (int s = 0; s < N_STRATEGIES; s++) {
+            if (strcmp(name, strategy_names[s]) == 0) found = s;
+        }
+        if (found == -1 || n_strategies == N_STRATEGIES) return -1;
+        strategies[n_strategies++] = found;
+    }
+    return n_strategies > 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    int n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    for (int s = 0; s < N_STRATEGIES; s++) strategies[n_strategies++] = s;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:j:t:p:")) != -1) {
+        if (opt == 's') seeds = atoi(optarg);
+        else if (opt == 'j') n_threads = atoi(optarg);
+        else if (opt == 't') max_ticks = atoll(optarg);
+        else if (opt == 'p') {
+            if (parse_strategies(optarg) != 0) argc = -1;
+        }
+        else argc = -1;
+    }
+    if (argc - optind != 1 || seeds < 1 || max_ticks < 1) {
+        fprintf(stderr, "Usage: %s [-s seeds] [-j threads] [-t max_ticks] [-p script,random,greedy,portal] <levels_dir>\n", argv[0]);
+        return 1;
+    }
+    if (n_threads < 1) n_threads = 1;
+    snprintf(levels_dir, sizeof(levels_dir), "%s", argv[optind]);
+
+    if (list_levels() <= 0) {
+        fprintf(stderr, "No levels to evaluate in %s\n", levels_dir);
+        return 1;
+    }
+
+    // 1. Repartir as execuções pelos trabalhadores, cada um com os seus resultados
+    n_jobs = (long long)n_levels * n_strategies * seeds;
+    batch_worker_t *workers = calloc(n_threads, sizeof(batch_worker_t));
+    if (!workers) return 1;
+
+    long long start = tick_clock_now_ms();
+    int started = 0;
+    for (int i = 0; i < n_threads; i++) {
+        workers[i].results = calloc((size_t)n_levels * N_STRATEGIES, sizeof(batch_result_t));
+        if (!workers[i].results) break;
+        if (pthread_create(&workers[i].tid, NULL, batch_thread, &workers[i]) != 0) {
+            free(workers[i].results);
+            break;
+        }
+        started++;
+    }
+    if (started == 0) return 1;
+
+    // 2. Juntar os resultados
+    batch_result_t *results = calloc((size_t)n_levels * N_STRATEGIES, sizeof(batch_result_t));
+    long long ticks = 0, runs = 0;
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].tid, NULL);
+        ticks += workers[i].ticks;
+        for (int j = 0; results && j < n_levels * N_STRATEGIES; j++) {
+            batch_result_t *from = &workers[i].results[j];
+            results[j].runs += from->runs;
+            runs += from->runs;
+            results[j].completed += from->completed;
+            results[j].deaths += from->deaths;
+            results[j].timeouts += from->timeouts;
+            results[j].points += from->points;
+            results[j].portal_ticks += from->portal_ticks;
+        }
+        free(workers[i].results);
+        free(workers[i].bfs.queue);
+        free(workers[i].bfs.first);
+    }
+    long long elapsed_ms = tick_clock_now_ms() - start;
+    if (!results) return 1;
+
+    // 3. Relatório por nível e estratégia
+    printf("%-24s %-8s %8s %7s %7s %8s %10s %10s\n",
+           "level", "strategy", "runs", "done%", "died%", "timeout%", "avg_score", "avg_ticks");
+    for (int l = 0; l < n_levels; l++) {
+        for (int s = 0; s < n_strategies; s++) {
+            batch_result_t *r = &results[l * N_STRATEGIES + strategies[s]];
+            if (r->runs == 0) {
+                printf("%-24s %-8s %8s\n", levels[l], strategy_names[strategies[s]], "n/a");
+                continue;
+            }
+            char avg_ticks[32] = "-";
+            if (r->completed) snprintf(avg_ticks, sizeof(avg_ticks), "%.1f", (double)r->portal_ticks / r->completed);
+            printf("%-24s %-8s %8lld %6.1f%% %6.1f%% %7.1f%% %10.1f %10s\n",
+                   levels[l], strategy_names[strategies[s]], r->runs,
+                   100.0 * r->completed / r->runs, 100.0 * r->deaths / r->runs, 100.0 * r->timeouts / r->runs,
+                   (double)r->points / r->runs, avg_ticks);
+        }
+    }
+    double elapsed = (elapsed_ms > 0 ? elapsed_ms : 1) / 1000.0;
+    printf("%lld runs, %lld ticks in %.3f s on %d threads: %.0f ticks/s\n",
+           runs, ticks, elapsed, started, ticks / elapsed);
+
+    for (int l = 0; l < n_levels; l++) {
+        unload_level(templates[l]);
+        free(templates[l]);
+        headless_free_pacman(&pacmans[l]);
+        free(levels[l]);
+    }
+    free(levels);
+    free(templates);
+    free(pacmans);
+    free(results);
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,328 @@
+/*
+pacman_levelgen: gera pacotes de níveis (.lvl + .m) de qualquer tamanho para testes de escala
+(parser, memória e custo das frames). A mesma semente gera sempre os mesmos ficheiros.
+Todas as posições livres ficam ligadas ao ponto de partida do pacman, e o portal fica na mais longe.
+
+Uso: pacman_levelgen [-s semente] [-l níveis] [-d LxA] [-w paredes%] [-g monstros] [-m padrão] [-t tempo] [-P] <diretoria>
+Padrões dos monstros: patrol, random, charge, chase, repeat, mix (um de cada, à vez).
+Com -P cada nível leva um ficheiro PAC com o caminho mais curto até ao portal (modo -H e pacman_batch).
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "board.h"
+
+#define MAX_DIM 4096
+#define MAX_ATTEMPTS 16 // grelhas sorteadas por nível antes de desistir (paredes demais)
+
+enum {
+    PATTERN_PATROL, // quadrado com REPEAT de cada lado
+    PATTERN_RANDOM, // 'R'
+    PATTERN_CHARGE, // alguns 'R' e um 'C'
+    PATTERN_CHASE,  // 'H'
+    PATTERN_REPEAT, // blocos encaixados e esperas
+    N_PATTERNS,
+    PATTERN_MIX = N_PATTERNS
+};
+
+static const char *pattern_names[] = {"patrol", "random", "charge", "chase", "repeat", "mix"};
+
+typedef struct {
+    int width, height;
+    int wall_percent;
+    int n_ghosts;
+    int pattern;
+    int tempo;
+    int with_pacman;
+} levelgen_config_t;
+
+// Grelha de um nível e o resultado da procura a partir do pacman
+typedef struct {
+    char *grid;          // 'X', 'o' ou '@', linha a linha
+    int *queue;          // posições livres pela ordem da procura
+    signed char *move;   // jogada que chegou a cada posição (0..3 = W, S, A, D), -1 = por visitar
+    int start;           // onde o load_pacman põe o pacman: a primeira posição livre
+    int portal;
+    int reachable;       // posições em queue
+} level_grid_t;
+
+static const int step_x[] = {0, 0, -1, 1};
+static const int step_y[] = {-1, 1, 0, 0};
+
+/*Função auxiliar que sorteia as paredes e fecha as zonas a que o pacman não chega.
+Devolve 0, ou -1 se sobram menos de min_free posições livres*/
+static int build_grid(level_grid_t *level, const levelgen_config_t *config, unsigned int *seed, int min_free) {
+    int width = config->width, height = config->height;
+
+    // 1. Contorno de parede e paredes ao acaso por dentro
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int border = (x == 0 || y == 0 || x == width - 1 || y == height - 1);
+            int wall = border || (int)(rand_r(seed) % 100) < config->wall_percent;
+            level->grid[y * width + x] = wall ? 'X' : 'o';
+        }
+    }
+
+    level->start = -1;
+    for (int p = 0; p < width * height; p++) {
+        if (level->grid[p] == 'o') {
+            level->start = p;
+            break;
+        }
+    }
+    if (level->start == -1) return -1;
+
+    // 2. Procura em largura a partir do pacman
+    memset(level->move, -1, (size_t)width * height);
+    level->move[level->start] = 0;
+    int head = 0, tail = 0;
+    level->queue[tail++] = level->start;
+    while (head < tail) {
+        int p = level->queue[head++];
+        int x = p % width, y = p / width;
+        for (int d = 0; d < 4; d++) {
+            int q = (y + step_y[d]) * width + x + step_x[d]; // o contorno é parede, nunca sai da grelha
+            if (level->grid[q] == 'X' || level->move[q] != -1) continue;
+            level->move[q] = (signed char)d;
+            level->queue[tail++] = q;
+        }
+    }
+    level->reachable = tail;
+    if (tail < min_free) return -1;
+
+    // 3. O que ficou por visitar passa a parede, o portal é a posição mais longe
+    for (int p = 0; p < width * height; p++) {
+        if (level->move[p] == -1) level->grid[p] = 'X';
+    }
+    level->portal = level->queue[tail - 1];
+    level->grid[level->portal] = '@';
+    return 0;
+}
+
+/*Função auxiliar que escreve um bloco de n jogadas iguais*/
+static void write_run(FILE *file, char move, int n) {
+    if (n == 1) fprintf(file, "%c\n", move);
+    else fprintf(file, "REPEAT %d\n%c\nEND\n", n, move);
+}
+
+/*Função auxiliar que escreve as jogadas de um monstro com o padrão dado*/
+static void write_ghost_moves(FILE *file, int pattern, unsigned int *seed) {
+    int side = 1 + (int)(rand_r(seed) % 8);
+    switch (pattern) {
+        case PATTERN_PATROL:
+            write_run(file, 'D', side);
+            write_run(file, 'S', side);
+            write_run(file, 'A', side);
+            write_run(file, 'W', side);
+            break;
+        case PATTERN_RANDOM:
+            fprintf(file, "R\n");
+            break;
+        case PATTERN_CHARGE:
+            write_run(file, 'R', side);
+            fprintf(file, "C\n");
+            break;
+        case PATTERN_CHASE:
+            fprintf(file, "H\n");
+            break;
+        default: // PATTERN_REPEAT
+            fprintf(file, "REPEAT %d\n", 1 + (int)(rand_r(seed) % 4));
+            write_run(file, 'D', side);
+            write_run(file, 'A', side);
+            fprintf(file, "END\nT %d\nR\n", 1 + (int)(rand_r(seed) % 3));
+            break;
+    }
+}
+
+/*Função auxiliar que devolve o número de jogadas do pacman até ao portal*/
+static int portal_distance(const level_grid_t *level, int width) {
+    int length = 0;
+    for (int p = level->portal; p != level->start; length++) {
+        int d = level->move[p];
+        p -= step_y[d] * width + step_x[d];
+    }
+    return length;
+}
+
+/*Função auxiliar que escreve o ficheiro PAC: POS do pacman e o caminho até ao portal em blocos*/
+static int write_pacman(const char *path, const level_grid_t *level, int width) {
+    // 1. Caminho de trás para a frente pelas jogadas que chegaram a cada posição
+    int length = portal_distance(level, width);
+    char *path_moves = malloc(length > 0 ? length : 1);
+    if (!path_moves) return -1;
+    for (int p = level->portal, i = length - 1; p != level->start; i--) {
+        int d = level->move[p];
+        path_moves[i] = "WSAD"[d];
+        p -= step_y[d] * width + step_x[d];
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        free(path_moves);
+        return -1;
+    }
+
+    // 2. Jogadas iguais seguidas ficam num REPEAT
+    fprintf(file, "PASSO 0\nPOS %d %d\n", level->start % width, level->start / width);
+    for (int i = 0; i < length;) {
+        int run = 1;
+        while (i + run < length && path_moves[i + run] == path_moves[i]) run++;
+        write_run(file, path_moves[i], run);
+        i += run;
+    }
+    free(path_moves);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+/*Função auxiliar que gera o nível number na diretoria. Devolve 0, ou -1 em caso de erro*/
+static int generate_level(const char *dir, int number, const levelgen_config_t *config, unsigned int seed, level_grid_t *level) {
+    int width = config->width, height = config->height;
+
+    // 1. Grelha com lugar para o pacman, o portal e os monstros
+    int attempt = 0;
+    while (build_grid(level, config, &seed, config->n_ghosts + 2) != 0) {
+        if (++attempt == MAX_ATTEMPTS) {
+            fprintf(stderr, "Level %d: not enough free positions, lower the wall density or the ghosts\n", number);
+            return -1;
+        }
+    }
+
+    char path[MAX_FILENAME];
+    char mon_line[MAX_GHOSTS * 16] = "MON";
+
+    // 2. Monstros em posições sorteadas entre as alcançáveis (sem o pacman nem o portal)
+    int candidates = level->reachable - 2;
+    int *free_cells = level->queue + 1; // queue[0] é o pacman, queue[reachable - 1] o portal
+    for (int i = 0; i < config->n_ghosts; i++) {
+        int pick = i + (int)(rand_r(&seed) % (unsigned int)(candidates - i));
+        int cell = free_cells[pick];
+        free_cells[pick] = free_cells[i];
+        free_cells[i] = cell;
+
+        char name[32];
+        snprintf(name, sizeof(name), "%02d_%02d.m", number, i);
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        FILE *file = fopen(path, "w");
+        if (!file) {
+            perror(path);
+            return -1;
+        }
+        int pattern = (config->pattern == PATTERN_MIX) ? i % N_PATTERNS : config->pattern;
+        fprintf(file, "PASSO %d\nPOS %d %d\n", (int)(rand_r(&seed) % 3), cell % width, cell / width);
+        write_ghost_moves(file, pattern, &seed);
+        if (fclose(file) != 0) {
+            perror(path);
+            return -1;
+        }
+        strcat(mon_line, " ");
+        strcat(mon_line, name);
+    }
+
+    // 3. Ficheiro PAC, antes de escrever a grelha (o caminho usa as jogadas da procura)
+    char pac_name[32];
+    snprintf(pac_name, sizeof(pac_name), "%02d.p", number);
+    if (config->with_pacman) {
+        snprintf(path, sizeof(path), "%s/%s", dir, pac_name);
+        if (write_pacman(path, level, width) != 0) {
+            perror(path);
+            return -1;
+        }
+    }
+
+    // 4. O nível: cabeçalho e grelha
+    snprintf(path, sizeof(path), "%s/level_%02d.lvl", dir, number);
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    fprintf(file, "DIM %d %d\nTEMPO %d\n", width, height, config->tempo);
+    if (config->n_ghosts > 0) fprintf(file, "%s\n", mon_line);
+    if (config->with_pacman) fprintf(file, "PAC %s\n", pac_name);
+    for (int y = 0; y < height; y++) {
+        fwrite(level->grid + (size_t)y * width, 1, width, file);
+        fputc('\n', file);
+    }
+    if (fclose(file) != 0) {
+        perror(path);
+        return -1;
+    }
+
+    printf("level_%02d.lvl: %dx%d, %d dots, %d ghosts, portal %d moves away\n",
+           number, width, height, level->reachable - 1, config->n_ghosts, portal_distance(level, width));
+    return 0;
+}
+
+static int parse_pattern(const char *name) {
+    for (int p = 0; p <= PATTERN_MIX; p++) {
+        if (strcmp(name, pattern_names[p]) == 0) return p;
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    levelgen_config_t config = {
+        .width = 64, .height = 64, .wall_percent = 20, .n_ghosts = 4,
+        .pattern = PATTERN_MIX, .tempo = 100, .with_pacman = 0
+    };
+    unsigned int seed = 1;
+    int n_levels = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:l:d:w:g:m:t:P")) != -1) {
+        if (opt == 's') seed = (unsigned int)strtoul(optarg, NULL, 10);
+        else if (opt == 'l') n_levels = atoi(optarg);
+        else if (opt == 'd') {
+            if (sscanf(optarg, "%dx%d", &config.width, &config.height) != 2) argc = -1;
+        }
+        else if (opt == 'w') config.wall_percent = atoi(optarg);
+        else if (opt == 'g') config.n_ghosts = atoi(optarg);
+        else if (opt == 'm') {
+            if ((config.pattern = parse_pattern(optarg)) < 0) argc = -1;
+        }
+        else if (opt == 't') config.tempo = atoi(optarg);
+        else if (opt == 'P') config.with_pacman = 1;
+        else argc = -1;
+    }
+    if (argc - optind != 1 || n_levels < 1 || n_levels > MAX_LEVELS ||
+        config.width < 3 || config.width > MAX_DIM || config.height < 3 || config.height > MAX_DIM ||
+        config.wall_percent < 0 || config.wall_percent > 90 ||
+        config.n_ghosts < 0 || config.n_ghosts > MAX_GHOSTS || config.tempo < 1) {
+        fprintf(stderr, "Usage: %s [-s seed] [-l levels (1-%d)] [-d WxH (3-%d)] [-w wall%% (0-90)] [-g ghosts (0-%d)]"
+                        " [-m patrol|random|charge|chase|repeat|mix] [-t tempo] [-P] <levels_dir>\n",
+                argv[0], MAX_LEVELS, MAX_DIM, MAX_GHOSTS);
+        return 1;
+    }
+
+    const char *dir = argv[optind];
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        perror(dir);
+        return 1;
+    }
+
+    size_t cells = (size_t)config.width * config.height;
+    level_grid_t level = {
+        .grid = malloc(cells),
+        .queue = malloc(cells * sizeof(int)),
+        .move = malloc(cells),
+    };
+    int result = 0;
+    if (!level.grid || !level.queue || !level.move) {
+        fprintf(stderr, "Not enough memory for a %dx%d level\n", config.width, config.height);
+        result = 1;
+    }
+
+    // Cada nível com a sua semente, para se poder gerar um só sem mudar os outros
+    for (int i = 0; i < n_levels && result == 0; i++) {
+        if (generate_level(dir, i, &config, seed + (unsigned int)i, &level) != 0) result = 1;
+    }
+
+    free(level.grid);
+    free(level.queue);
+    free(level.move);
+    return result;
+}
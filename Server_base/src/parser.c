@@ -5,10 +5,40 @@
 #include <fcntl.h>
 
 #include "parser.h"
+#include "ghost_script.h"
 #include "debug.h"
 
+int read_level_dim(char *filename, char *dirname, int *width, int *height) {
+    char fullname[MAX_FILENAME];
+    snprintf(fullname, sizeof(fullname), "%s/%s", dirname, filename);
+
+    int fd = open(fullname, O_RDONLY);
+    if (fd == -1) return -1;
 
-int read_level(board_t* board, GameSession* session, char* filename, char* dirname) {
+    // O DIM vem antes da grelha, as linhas até lá são curtas
+    int result = -1;
+    char command[MAX_COMMAND_LENGTH];
+    while (read_line(fd, command) > 0) {
+        if (command[0] == '#' || command[0] == '\0') continue;
+
+        char *save;
+        char *word = strtok_r(command, " \t\n", &save);
+        if (!word || strcmp(word, "DIM") != 0) continue;
+
+        char *arg1 = strtok_r(NULL, " \t\n", &save);
+        char *arg2 = strtok_r(NULL, " \t\n", &save);
+        if (arg1 && arg2) {
+            *width = atoi(arg1);
+            *height = atoi(arg2);
+            result = 0;
+        }
+        break;
+    }
+    close(fd);
+    return result;
+}
+
+int read_level(board_t* board, char* filename, char* dirname) {
 
     char fullname[MAX_FILENAME];
     strcpy(fullname, dirname);
@@ -21,40 +51,55 @@ int read_level(board_t* board, GameSession* session, char* filename, char* dirna
         return -1;
     }
     
-    char command[MAX_COMMAND_LENGTH];
+    // grid rows can be much longer than a command, the buffer grows once DIM is known
+    int line_size = MAX_COMMAND_LENGTH;
+    char *command = malloc(line_size);
+    if (!command) {
+        close(fd);
+        return -1;
+    }
 
-    // Pacman is optional
-    board->n_pacmans = 1;
+    // One slot per player that can join the board, empty slots are never alive
+    board->n_pacmans = MAX_PACMANS;
 
     strcpy(board->level_name, filename);
     *strrchr(board->level_name, '.') = '\0';
 
     int read;
-    while ((read = read_line(fd, command)) > 0) {
+    while ((read = read_line_max(fd, command, line_size)) > 0) {
 
         // comment
         if (command[0] == '#' || command[0] == '\0') continue;
 
-        char *word = strtok(command, " \t\n");
+        char *save; // strtok_r: os níveis são lidos por várias tarefas ao mesmo tempo
+        char *word = strtok_r(command, " \t\n", &save);
         if (!word) continue;  // skip empty line
 
         if (strcmp(word, "DIM") == 0) {
-            char *arg1 = strtok(NULL, " \t\n");
-            char *arg2 = strtok(NULL, " \t\n");
+            char *arg1 = strtok_r(NULL, " \t\n", &save);
+            char *arg2 = strtok_r(NULL, " \t\n", &save);
             if (arg1 && arg2) {
                 board->width = atoi(arg1);
                 board->height = atoi(arg2);
-                session->width = board->width;
-                session->height = board->height;
                 debug("DIM = %d x %d\n", board->width, board->height);
+
+                if (board->width + 2 > line_size) {
+                    char *grown = realloc(command, board->width + 2);
+                    if (!grown) {
+                        free(command);
+                        close(fd);
+                        return -1;
+                    }
+                    command = grown;
+                    line_size = board->width + 2;
+                }
             }
         }
 
         else if (strcmp(word, "TEMPO") == 0) {
-            char *arg = strtok(NULL, " \t\n");
+            char *arg = strtok_r(NULL, " \t\n", &save);
             if (arg) {
                 board->tempo = atoi(arg);
-                session->tempo = board->tempo;
                 debug("TEMPO = %d\n", board->tempo);
             }
         }
@@ -62,15 +107,23 @@ int read_level(board_t* board, GameSession* session, char* filename, char* dirna
         else if (strcmp(word, "MON") == 0) {
             char *arg;
             int i = 0;
-            while ((arg = strtok(NULL, " \t\n")) != NULL) {
+            while ((arg = strtok_r(NULL, " \t\n", &save)) != NULL) {
                 snprintf(board->ghosts_files[i], sizeof(board->ghosts_files[0]), "%s/%s", dirname, arg);
                 debug("MON file: %s\n", board->ghosts_files[i]);
                 i+= 1;
-                if (i == MAX_GHOSTS-1) break;
+                if (i == MAX_GHOSTS) break;
             }
             board->n_ghosts = i;
         }
 
+        else if (strcmp(word, "PAC") == 0) {
+            char *arg = strtok_r(NULL, " \t\n", &save);
+            if (arg) {
+                snprintf(board->pacman_file, sizeof(board->pacman_file), "%s/%s", dirname, arg);
+                debug("PAC file: %s\n", board->pacman_file);
+            }
+        }
+
         else {
             break;
         }
@@ -78,16 +131,22 @@ int read_level(board_t* board, GameSession* session, char* filename, char* dirna
 
     if (!board->width || !board->height) {
         debug("Missing dimensions in level file\n");
+        free(command);
         close(fd);
         return -1;
     }
     
     // the end of the file contains the grid
-    board->board = calloc(board->width * board->height, sizeof(board_pos_t));
-    session->grid = calloc(board->width * board->height, sizeof(char));
+    board->board = level_alloc(board, board->width * board->height, sizeof(board_pos_t));
+    board->cells = level_alloc(board, board->width * board->height, sizeof(unsigned char));
 
-    board->pacmans = calloc(board->n_pacmans, sizeof(pacman_t));
-    board->ghosts = calloc(board->n_ghosts, sizeof(ghost_t));
+    board->pacmans = level_alloc(board, board->n_pacmans, sizeof(pacman_t));
+    if (alloc_ghosts(board) < 0) {
+        debug("Failed to allocate ghosts\n");
+        free(command);
+        close(fd);
+        return -1;
+    }
 
     int row = 0;
     // command here still holds the previous line
@@ -95,33 +154,35 @@ int read_level(board_t* board, GameSession* session, char* filename, char* dirna
         if (command[0]== '#' || command[0] == '\0') continue;
         if (row >= board->height) break;
 
-        debug("Line: %s\n", command);
+        if (board->width <= MAX_COMMAND_LENGTH) debug("Line: %s\n", command);
 
+        int line_length = (int)strlen(command);
         for (int col = 0; col < board -> width; col++){
             int idx = row * board->width + col;
-            char content = command[col];
+            char content = (col < line_length) ? command[col] : 'o';
 
             switch (content) {
                 case 'X': // wall
                     board->board[idx].content = 'W';
-                    session->grid[idx] = '#';
+                    board->cells[idx] = CELL_WALL;
                     break;
                 case '@': // portal
                     board->board[idx].content = ' ';
                     board->board[idx].has_portal = 1;
-                    session->grid[idx] = '@';
+                    board->cells[idx] = CELL_PORTAL;
                     break;
                 default:
                     board->board[idx].content = ' ';
                     board->board[idx].has_dot = 1;
-                    session->grid[idx] = '.';
+                    board->cells[idx] = CELL_DOT;
                     break;
             }
         }
 
         row++;
-        read = read_line(fd, command);
+        read = read_line_max(fd, command, line_size);
     }
+    free(command);
 
     if (read == -1) {
       debug("Failed parsing line");
@@ -136,7 +197,7 @@ int read_level(board_t* board, GameSession* session, char* filename, char* dirna
 int read_ghosts(board_t* board) {
     for (int i = 0; i < board->n_ghosts; i++) {
         int fd = open(board->ghosts_files[i], O_RDONLY);
-        ghost_t* ghost = &board->ghosts[i];
+        ghosts_t* ghosts = &board->ghosts;
 
         int read;
         char command[MAX_COMMAND_LENGTH];
@@ -144,27 +205,32 @@ int read_ghosts(board_t* board) {
             // comment
             if (command[0] == '#' || command[0] == '\0') continue;
 
-            char *word = strtok(command, " \t\n");
+            // fields keeps command intact for the moves, which start at the first unknown line
+            char fields[MAX_COMMAND_LENGTH];
+            strcpy(fields, command);
+            char *save;
+            char *word = strtok_r(fields, " \t\n", &save);
             if (!word) continue;  // skip empty line
 
             if (strcmp(word, "PASSO") == 0) {
-                char *arg = strtok(NULL, " \t\n");
+                char *arg = strtok_r(NULL, " \t\n", &save);
                 if (arg) {
-                    ghost->passo = atoi(arg);
-                    ghost->waiting = ghost->passo;
-                    debug("Ghost passo: %d\n", ghost->passo);
+                    ghosts->passo[i] = atoi(arg);
+                    ghosts->waiting[i] = ghosts->passo[i];
+                    debug("Ghost passo: %d\n", ghosts->passo[i]);
                 }
             }
             else if (strcmp(word, "POS") == 0) {
-                char *arg1 = strtok(NULL, " \t\n");
-                char *arg2 = strtok(NULL, " \t\n");
+                char *arg1 = strtok_r(NULL, " \t\n", &save);
+                char *arg2 = strtok_r(NULL, " \t\n", &save);
                 if (arg1 && arg2) {
-                    ghost->pos_x = atoi(arg1);
-                    ghost->pos_y = atoi(arg2);
-                    int idx = ghost->pos_y * board->width + ghost->pos_x;
+                    ghosts->pos_x[i] = atoi(arg1);
+                    ghosts->pos_y[i] = atoi(arg2);
+                    int idx = ghosts->pos_y[i] * board->width + ghosts->pos_x[i];
                     board->board[idx].content = 'M';
+                    board->cells[idx] = CELL_GHOST;
                     //Por ghosts na grid no translate board to session
-                    debug("Ghost Pos = %d x %d\n", ghost->pos_x, ghost->pos_y);
+                    debug("Ghost Pos = %d x %d\n", ghosts->pos_x[i], ghosts->pos_y[i]);
                 }
             }
             else {
@@ -172,35 +238,24 @@ int read_ghosts(board_t* board) {
             }
         }
 
-        // end of the file contains the moves
-        ghost->current_move = 0;
+        // end of the file contains the moves, compiled into a script shared by equal ghosts
+        ghosts->pc[i] = 0;
+        ghost_script_builder_t builder;
+        ghost_script_begin(&builder);
 
         // command here still holds the previous line
-        int move = 0;
-        while (read > 0 && move < MAX_MOVES) {
-            if (command[0]== '#' || command[0] == '\0') continue;
-            if (command[0] == 'A' ||
-                command[0] == 'D' ||
-                command[0] == 'W' ||
-                command[0] == 'S' ||
-                command[0] == 'R' ||
-                command[0] == 'C') {
-                    ghost->moves[move].command = command[0];
-                    ghost->moves[move].turns = 1; 
-                    move += 1;
-            }
-            else if (command[0] == 'T' && command[1] == ' ') {
-                int t = atoi(command+2);
-                if (t > 0) {
-                    ghost->moves[move].command = command[0];
-                    ghost->moves[move].turns = t;
-                    ghost->moves[move].turns_left = t;
-                    move += 1;
-                }
+        while (read > 0) {
+            if (command[0] != '#' && command[0] != '\0') {
+                if (ghost_script_add_line(&builder, command) < 0) debug("Ignoring ghost move: %s\n", command);
             }
             read = read_line(fd, command);
         }
-        ghost->n_moves = move;
+        ghosts->script[i] = ghost_script_finish(&builder);
+        if (!ghosts->script[i]) {
+            debug("Failed compiling ghost moves\n");
+            close(fd);
+            return -1;
+        }
 
         if (read == -1) {
             debug("Failed reading line\n");
@@ -214,7 +269,70 @@ int read_ghosts(board_t* board) {
     return 0;
 }
 
+ghost_script_t *read_pacman(board_t* board, pacman_t* pacman) {
+    pacman->pos_x = pacman->pos_y = -1;
+    pacman->passo = 0;
+
+    int fd = open(board->pacman_file, O_RDONLY);
+    if (fd == -1) {
+        debug("Failed to open pacman file: %s\n", board->pacman_file);
+        return NULL;
+    }
+
+    int read;
+    char command[MAX_COMMAND_LENGTH];
+    while ((read = read_line(fd, command)) > 0) {
+        // comment
+        if (command[0] == '#' || command[0] == '\0') continue;
+
+        char fields[MAX_COMMAND_LENGTH];
+        strcpy(fields, command);
+        char *save;
+        char *word = strtok_r(fields, " \t\n", &save);
+        if (!word) continue;  // skip empty line
+
+        if (strcmp(word, "PASSO") == 0) {
+            char *arg = strtok_r(NULL, " \t\n", &save);
+            if (arg) pacman->passo = atoi(arg);
+        }
+        else if (strcmp(word, "POS") == 0) {
+            char *arg1 = strtok_r(NULL, " \t\n", &save);
+            char *arg2 = strtok_r(NULL, " \t\n", &save);
+            if (arg1 && arg2) {
+                pacman->pos_x = atoi(arg1);
+                pacman->pos_y = atoi(arg2);
+            }
+        }
+        else {
+            break;
+        }
+    }
+
+    // the rest are moves, compiled like the ghosts' (C and H do nothing for a pacman)
+    ghost_script_builder_t builder;
+    ghost_script_begin(&builder);
+    while (read > 0) {
+        if (command[0] != '#' && command[0] != '\0') {
+            if (ghost_script_add_line(&builder, command) < 0) debug("Ignoring pacman move: %s\n", command);
+        }
+        read = read_line(fd, command);
+    }
+    close(fd);
+
+    ghost_script_t *script = ghost_script_finish(&builder);
+    if (read == -1) {
+        debug("Failed reading line\n");
+        ghost_script_release(script);
+        return NULL;
+    }
+    return script;
+}
+
 int read_line(int fd, char *buf) {
+    return read_line_max(fd, buf, MAX_COMMAND_LENGTH);
+}
+
+int read_line_max(int fd, char *buf, int max) {
     int i = 0;
     char c;
     ssize_t n;
@@ -223,7 +341,7 @@ int read_line(int fd, char *buf) {
         if (c == '\r') continue;
         if (c == '\n') break;
         buf[i++] = c;
-        if (i == MAX_COMMAND_LENGTH - 1) break;
+        if (i == max - 1) break;
     }
 
     buf[i] = '\0';
@@ -10,22 +10,48 @@
 #include <errno.h>
 #include <dirent.h>
 #include <semaphore.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <stdint.h>
 
 #include "protocol.h"
 #include "debug.h"
 #include "server.h"
+#include "leaderboard.h"
+#include "encoder.h"
+#include "spectator.h"
+#include "world.h"
+#include "coroutine.h"
+#include "tick_pool.h"
+#include "affinity.h"
+#include "tick_clock.h"
+#include "parser.h"
+#include "ghost_script.h"
+#include "headless.h"
 
 // VARIÁVEIS GLOBAIS 
 sem_t server_semaphore;
 pthread_mutex_t server_mutex;
-char connectbuf[512][(1 + 2 * MAX_PIPE_PATH_LENGTH) * sizeof(char)]; // buffer para pedidos de conexão
+connect_request_t connectbuf[MAX_CONNECT_QUEUE]; // buffer para pedidos de conexão
 int users_queue_count = 0; // número de pedidos na fila
 
-GameSession **active_sessions = NULL;
+GameSession **active_sessions = NULL; // uma posição por tarefa de sessão viva, NULL = livre
+
+// Pool de tarefas de sessão (protegido por server_mutex)
+int n_sessions = 0;    // tarefas de sessão criadas
+int idle_sessions = 0; // tarefas à espera de pedido
 
 char level_files_dirpath[128];
 int max_sessions;
+int min_sessions = 1;  // tarefas que ficam à espera mesmo sem clientes (-m)
+int max_queue = 0;     // pedidos à espera de sessão antes de recusar (-q, 0 = max_sessions)
 char server_fifo[MAX_PIPE_PATH_LENGTH];
+int use_socket = 0; // registo por socket Unix SOCK_SEQPACKET em vez de FIFO
+int use_coroutines = 0; // sessões, mundos e fantasmas em corrotinas sobre poucas tarefas (-C)
+int headless_games = 0;  // jogos a simular sem clientes (-H), 0 = servidor normal
+int headless_next_game = 0;
 
 volatile sig_atomic_t sigusr1_recebido = 0;
 volatile sig_atomic_t terminar_servidor = 0;
@@ -60,7 +86,8 @@ void gerar_top5_pontuacoes() {
     ScoreEntry temp_list[max_sessions];
     int count = 0;
 
-    // 1. Recolher apenas sessões ATIVAS
+    // 1. Recolher apenas sessões ATIVAS (as tarefas livres saem do pool com o mutex)
+    coro_mutex_lock(&server_mutex);
     for (int i = 0; i < max_sessions; i++) {
         GameSession *s = active_sessions[i];
         // Verifica se ponteiro existe E se a sessão está marcada como ativa
@@ -70,6 +97,7 @@ void gerar_top5_pontuacoes() {
             count++;
         }
     }
+    coro_mutex_unlock(&server_mutex);
 
     // 2. Ordenar (Bubble Sort é rápido suficiente para < 100 elementos)
     for (int i = 0; i < count - 1; i++) {
@@ -92,6 +120,23 @@ void gerar_top5_pontuacoes() {
                 i + 1, temp_list[i].id, temp_list[i].score);
     }
 
+    // 4. Acrescentar os melhores jogos de sempre (consulta ao índice em memória)
+    leaderboard_record_t best[5];
+    int n_best = leaderboard_top(best, 5);
+    fprintf(f, "--- TOP 5 DE SEMPRE ---\n");
+    for (int i = 0; i < n_best; i++) {
+        fprintf(f, "%dº Lugar - Jogador: %s - Pontos: %d - Níveis: %d - Duração: %d.%03ds\n",
+                i + 1, best[i].client_id, best[i].points, best[i].levels,
+                best[i].duration_ms / 1000, best[i].duration_ms % 1000);
+    }
+
+    // 5. Pontualidade dos ticks da simulação desde o arranque
+    tick_stats_t ticks;
+    tick_clock_stats(&ticks);
+    fprintf(f, "--- TICKS ---\n");
+    fprintf(f, "Ticks: %lld - Overruns: %lld - Atraso médio: %lldms - Atraso máximo: %lldms\n",
+            ticks.ticks, ticks.overruns, ticks.ticks ? ticks.late_ms / ticks.ticks : 0, ticks.max_late_ms);
+
     fclose(f);
     debug("Estatísticas geradas: %d jogadores listados.\n", count);
 }
@@ -100,457 +145,1150 @@ static inline int get_board_index(board_t* board, int x, int y) {
     return y * board->width + x;
 }
 
-/*Esta tarefa é responsável por receber o input do cliente
-e por fazer a movimentação do pacman, tal como retornar o estado do pacman*/
-void* input_handler_thread(void* arg){
-    pacman_thread_arg_t *pac_arg = (pacman_thread_arg_t*) arg;
+/*Função auxiliar que extrai o id do cliente do pipe de pedidos ("/tmp/<id>_request")*/
+static void client_id_from_pipe(const char *req_path, char *client_id) {
+    const char *name = strrchr(req_path, '/');
+    name = name ? name + 1 : req_path;
 
-    board_t *board = pac_arg->board;
-    GameSession *session = pac_arg->game_session;
+    size_t len = strnlen(name, MAX_CLIENT_ID_LENGTH - 1);
+    const char *suffix = strstr(name, "_request");
+    if (suffix && (size_t)(suffix - name) < len) len = suffix - name;
 
-    free(pac_arg);
-    
-    char buf[2 * sizeof(char)];
-    int *retval = malloc(sizeof(int));
-    *retval = 0; // Inicializar por segurança
+    memcpy(client_id, name, len);
+    client_id[len] = '\0';
+}
 
-    //Loop principal da thread de input
-    while(1) {
+/*Função auxiliar para o tempo monotónico em milissegundos*/
+static long long monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-        // 1. Verificar se o jogo acabou
-        if (board->pacmans[0].alive == 0) {
-            pthread_mutex_lock(&session->lock);
-            session->active = 0;
-            pthread_mutex_unlock(&session->lock);
-            *retval = QUIT_GAME;
-            break;
+/*Função auxiliar que lê o próximo pedido do cliente, pelo anel partilhado ou pelo pipe.
+Devolve como o read: bytes lidos, 0 se o cliente desligou, -1 em erro*/
+static int read_client_request(GameSession *session, char *buf, int size) {
+    // A espera acorda a cada 100ms para sair quando o mundo acaba (active = 0)
+    if (!session->shm) {
+        while (session->active) {
+            if (coro_poll(session->fd_req, POLLIN, 100) <= 0) continue;
+            int n = read(session->fd_req, buf, size);
+            // Numa corrotina o fd não bloqueia: um poll sem dados ainda não é pedido nenhum
+            if (n == -1 && (errno == EAGAIN || errno == EINTR)) continue;
+            return n;
         }
+        return -1;
+    }
 
-        // 2. Ler (bloqueante, sem lock, o que é bom)
-        memset(buf, 0, sizeof(buf));
-        int n = read(session->fd_req, &buf, sizeof(buf));
-        debug("Read %d bytes from client request pipe\n", n);
+    while (session->active) {
+        // Segmento partido (encolhido pelo cliente): é como se o cliente tivesse desligado
+        int popped = shm_channel_pop_input(session->shm, buf, coro_running() ? 0 : 100);
+        if (popped != 0) return popped > 0 ? 2 : 0;
 
-        if (n < 0) { //Erro
-            debug("Error reading client request\n");
-            pthread_mutex_lock(&session->lock);
-            session->active = 0;
-            pthread_mutex_unlock(&session->lock);
-            break;
+        if (!coro_running()) {
+            // Sem jogadas: o pipe de pedidos continua aberto só para detetar o fim do cliente
+            struct pollfd pfd = { .fd = session->fd_req, .events = POLLIN };
+            if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR))) return 0;
+            continue;
         }
-        if (n == 0) { //Pipe fechado - cliente desconectou
-            debug("Client request pipe closed\n");
-            pthread_mutex_lock(&session->lock);
-            session->active = 0;
-            session->game_over = 1;
-            pthread_mutex_unlock(&session->lock);
-            *retval = QUIT_GAME;
-            break;
-        }
-
-        // 3. Trancar Sessão para processar
-        pthread_mutex_lock(&session->lock);
-        
-        char opcode = buf[0];
-
-        // 4. Processar comando
 
-        // 4.1 Se o cliente pediu para disconectar
-        if (opcode == OP_CODE_DISCONNECT) {
-            session->active = 0; // Parar as outras threads
-            pthread_mutex_unlock(&session->lock); // Destrancar antes de sair
-            *retval = QUIT_GAME;
-            debug("Client requested disconnection\n");
-            return (void*) retval;
+        // Numa corrotina o futex bloquearia o escalonador: a próxima jogada acorda-a pelo fd de pedidos
+        int armed = shm_channel_arm_nudge(session->shm);
+        if (armed != 0) {
+            if (armed < 0) return 0;
+            continue;
         }
-        
-        // 4.2 Se o cliente enviou um comando de jogo
-        if (opcode == OP_CODE_PLAY) {
-            char command = buf[1];
-
-            // 5. Mover Pacman
-            pthread_rwlock_wrlock(&board->state_lock); // Trancar o tabuleiro para mexer
-            
-            command_t play = { .command = command, .turns = 1 };
-            debug("KEY %c\n", play.command);
-
-            int result = move_pacman(board, 0, &play);
-            
-            pthread_rwlock_unlock(&board->state_lock); // Já acabámos de mexer no tabuleiro, destrancar
-
-            if (result == REACHED_PORTAL) {
-                *retval = NEXT_LEVEL;
-                pthread_mutex_unlock(&session->lock); // Destranca sessão
-                break; // Sai do loop
-            }
-
-            if (result == DEAD_PACMAN) {
-                *retval = QUIT_GAME;
-                session->game_over = 1;
-                //session->active = 0;
-                pthread_mutex_unlock(&session->lock); // Destranca sessão
-                break;
-            }
+        if (coro_poll(session->fd_req, POLLIN, 100) > 0) {
+            char nudges[SHM_INPUT_RING_SIZE];
+            ssize_t n = read(session->fd_req, nudges, sizeof(nudges));
+            if (n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) return 0;
         }
-
-        // 6. Fim da iteração: destranca a sessão para a próxima volta
-        pthread_mutex_unlock(&session->lock);
     }
-
-    sleep_ms(100); // Pequena espera para garantir que o cliente recebe o estado final
-    
-    return (void*) retval;
+    return -1;
 }
 
-/*Função para enviar o estado do tabuleiro para o cliente*/
-int send_board_to_client(GameSession *session) {
+/*Função auxiliar que monta o frame do estado traduzido na sessão e o entrega aos espectadores.
+Com memória partilhada o frame fica já publicado no slot do cliente e devolve NULL;
+pelos pipes ou socket devolve o frame (da sessão) que falta escrever com write_board_frame*/
+static frame_t *build_board_frame(GameSession *session) {
 
-    int header_size = 1*sizeof(char) + 6 * sizeof(int); // OP + 6 inteiros
-    int board_size = session->width * session->height;
+    int frame_size = BOARD_HEADER_SIZE + session->grid_bytes;
 
     debug("Preparing to send board update to client\n");
-    char *buffer = malloc(header_size);
-    if (!buffer) return 1;
+    char *buffer;
+    frame_t *frame = NULL; // o mesmo frame vai para o jogador e para os espectadores
+    if (session->shm) {
+        // Com memória partilhada o frame é escrito diretamente no slot do cliente (capacidade validada ao mapear)
+        if (frame_size > session->shm->slot_capacity) {
+            debug("Frame of %d bytes does not fit the shared slot\n", frame_size);
+            session->active = 0;
+            return NULL;
+        }
+        buffer = shm_channel_begin_frame(session->shm);
+    }
+    else {
+        frame = session->frame = frame_reuse(session->frame, frame_size);
+        if (!frame) return NULL;
+        buffer = frame->data;
+    }
 
     int p = 0;
     // 1. OP CODE
     buffer[p++] = OP_CODE_BOARD;
-    // 2. Ler dados do cabeçalho
-    memcpy(buffer + p, &session->width, sizeof(int)); p += sizeof(int);
-    memcpy(buffer + p, &session->height, sizeof(int)); p += sizeof(int);
+    // 2. Ler dados do cabeçalho (as dimensões são as do viewport)
+    memcpy(buffer + p, &session->grid_width, sizeof(int)); p += sizeof(int);
+    memcpy(buffer + p, &session->grid_height, sizeof(int)); p += sizeof(int);
     memcpy(buffer + p, &session->tempo, sizeof(int)); p += sizeof(int);
     memcpy(buffer + p, &session->victory, sizeof(int)); p += sizeof(int);
     memcpy(buffer + p, &session->game_over, sizeof(int)); p += sizeof(int);
     memcpy(buffer + p, &session->score, sizeof(int)); p += sizeof(int);
+    memcpy(buffer + p, &session->view_x, sizeof(int)); p += sizeof(int);
+    memcpy(buffer + p, &session->view_y, sizeof(int)); p += sizeof(int);
+    memcpy(buffer + p, &session->encoding, sizeof(int)); p += sizeof(int);
+
+    // 3. Copiar a janela do tabuleiro (já codificada) a seguir ao cabeçalho (sem grid se nunca houve memória para ele)
+    if (session->grid_bytes > 0) memcpy(buffer + p, session->grid, session->grid_bytes);
 
-    // 3. Enviar cabeçalho primeiro
+    if (session->shm) {
+        // 3.1 Os espectadores recebem uma cópia do slot, sem voltar a codificar
+        if (spectators_watching(session) && (frame = session->frame = frame_reuse(session->frame, frame_size)) != NULL) {
+            memcpy(frame->data, buffer, frame_size);
+        }
+        if (shm_channel_commit_frame(session->shm, frame_size) != 0) {
+            debug("Shared memory segment no longer valid, closing session\n");
+            session->active = 0;
+            return NULL;
+        }
+        spectators_publish(session, frame);
+        return NULL;
+    }
+
+    // 4. Entregar já aos espectadores (sem esperar pelas escritas), a sessão fica com a sua referência
+    spectators_publish(session, frame);
+    return frame;
+}
+
+/*Função auxiliar que escreve o frame inteiro ao cliente (pode esperar por ele: sem locks)*/
+static int write_board_frame(GameSession *session, frame_t *frame) {
     debug("Sending board update to client:\n");
-    int n = write(session->fd_notif, buffer, header_size);
-    if (n <= 0) {
+    int socket = (session->fd_notif == session->fd_req);
+    if ((socket && frame_fit_send_buffer(session->fd_notif, &session->sndbuf, frame->size) != 0) ||
+        coro_write(session->fd_notif, frame->data, frame->size) <= 0) {
         session->active = 0;
         return 1;
     }
-    
-    // 4. Preparar e enviar o tabuleiro
-    char *board_buffer = malloc(board_size);
-    if (!board_buffer) {
-        free(buffer);
-        return 1;
+    return 0;
+}
+
+/*Função auxiliar que monta (com world->lock) o frame de cada jogador com o estado já traduzido.
+Os frames que falta escrever ficam em frames, e o mundo fica a contar com o envio (world->sending)
+para que nenhum destes jogadores saia antes de deliver_frames. Devolve quantos há a escrever*/
+static int snapshot_frames(world_t *world, const int *send_to, GameSession **targets, frame_t **frames) {
+    // Uma ronda de envios de cada vez: as escritas ao mesmo cliente não se misturam
+    while (world->sending > 0) {
+        world_wait(world, 100);
     }
-    memcpy(board_buffer, session->grid, board_size);
 
-    debug("Sending board grid to client:\n");
-    int k = write(session->fd_notif, board_buffer, board_size);
+    int n = 0;
+    for (int i = 0; i < MAX_PACMANS; i++) {
+        if (!send_to[i] || !world->players[i]->active) continue;
+        frame_t *frame = build_board_frame(world->players[i]);
+        if (!frame) continue;
+        frame_retain(frame);
+        targets[n] = world->players[i];
+        frames[n++] = frame;
+    }
+    if (n > 0) world->sending++;
+    return n;
+}
 
-    if (k <= 0) {
-        session->active = 0;
-        return 1;
+/*Função auxiliar que escreve, já sem world->lock, os frames de snapshot_frames e avisa quem espera por eles*/
+static void deliver_frames(world_t *world, int n, GameSession **targets, frame_t **frames) {
+    if (n == 0) return;
+    for (int i = 0; i < n; i++) {
+        write_board_frame(targets[i], frames[i]);
+        frame_release(frames[i]);
     }
+    debug("Board sent to clients\n");
 
-    // 5. Limpar
-    free(buffer);
-    free(board_buffer);
-    return 0;
+    coro_mutex_lock(&world->lock);
+    world->sending--;
+    world_signal(world);
+    coro_mutex_unlock(&world->lock);
+}
+
+/*Função auxiliar que centra uma janela de tamanho view na posição pos, sem sair do nível*/
+static int center_view(int pos, int view, int size) {
+    int start = pos - view / 2;
+    if (start > size - view) start = size - view;
+    if (start < 0) start = 0;
+    return start;
 }
 
 /*Função para traduzir o estado na estrutura do tabuleiro para a estrutura de sessão*/
 void translate_board_to_session(board_t *board, GameSession *session) {
     debug("Translating board to session format\n");
 
-    // Assegurar que o grid da sessão está alocado
-    if (!session->grid) {
-        session->grid = malloc(board->width * board->height);
+    pacman_t *pac = &board->pacmans[session->pacman_index];
+    session->score = pac->points;
+    session->pacman_x = pac->pos_x;
+    session->pacman_y = pac->pos_y;
+    session->tempo = board->tempo;
+    session->width = board->width;
+    session->height = board->height;
+    if(pac->alive == 0) {
+        session->game_over = 1;
     }
-    for (int y = 0; y < board->height; y++) {
-        for (int x = 0; x < board->width; x++) {
-            int idx = get_board_index(board, x, y);
-            if(board->board[idx].content == 'W') {
-                session->grid[idx] = '#'; // Wall
-            }
-            else if(board->board[idx].content == 'P') {
-                session->grid[idx] = 'C'; // Pacman
-            }
-            else if(board->board[idx].content == 'M') {
-                session->grid[idx] = 'M'; // Monster
-            }
-            else if(board->board[idx].has_portal) {
-                session->grid[idx] = '@'; // Portal
-            }
-            else if(board->board[idx].has_dot) {
-                session->grid[idx] = '.'; // Dot
+
+    // 1. Calcular o tamanho do viewport
+    int view_w = (session->view_width > 0 && session->view_width < board->width) ? session->view_width : board->width;
+    int view_h = (session->view_height > 0 && session->view_height < board->height) ? session->view_height : board->height;
+
+    // 2. Assegurar que os buffers da sessão têm o tamanho do viewport.
+    // Sem memória ficam os antigos (e o último frame, que ainda lhes corresponde) e o jogo acaba
+    if (!session->grid || session->grid_width != view_w || session->grid_height != view_h) {
+        unsigned char *cells = malloc(view_w * view_h);
+        char *grid = malloc(encoded_size(view_w * view_h, session->encoding));
+        if (!cells || !grid) {
+            debug("Failed to allocate a %dx%d viewport for client %s\n", view_w, view_h, session->client_id);
+            free(cells);
+            free(grid);
+            session->game_over = 1;
+            return;
+        }
+        free(session->cells);
+        free(session->grid);
+        session->cells = cells;
+        session->grid = grid;
+        session->grid_width = view_w;
+        session->grid_height = view_h;
+    }
+
+    // 2.1 Centrar o viewport no pacman
+    session->view_x = center_view(session->pacman_x, view_w, board->width);
+    session->view_y = center_view(session->pacman_y, view_h, board->height);
+
+    // 3. Copiar os códigos das células dentro do viewport, linha a linha
+    for (int y = 0; y < view_h; y++) {
+        int idx = get_board_index(board, session->view_x, session->view_y + y);
+        memcpy(&session->cells[y * view_w], &board->cells[idx], view_w);
+    }
+
+    // 4. Codificar na codificação negociada com o cliente (tabela de símbolos vetorial)
+    session->grid_bytes = encode_cells(session->cells, view_w * view_h, session->encoding, session->grid);
+}
+
+/*Função que recebe o input do cliente e move o seu pacman no mundo,
+até o cliente sair, o pacman morrer ou o mundo acabar*/
+static void play_in_world(world_t *world, GameSession *session) {
+    char buf[2 * sizeof(char)];
+
+    while (1) {
+        // 1. Ler (bloqueante, sem lock, o que é bom)
+        memset(buf, 0, sizeof(buf));
+        int n = read_client_request(session, buf, sizeof(buf));
+        debug("Read %d bytes from client request pipe\n", n);
+
+        if (n < 0) { //Erro ou fim do mundo
+            debug("Error reading client request\n");
+            break;
+        }
+        if (n == 0) { //Pipe fechado - cliente desconectou
+            debug("Client request pipe closed\n");
+            break;
+        }
+
+        // 2. Processar comando
+        char opcode = buf[0];
+
+        // 2.1 Se o cliente pediu para disconectar
+        if (opcode == OP_CODE_DISCONNECT) {
+            debug("Client requested disconnection\n");
+            break;
+        }
+        if (opcode != OP_CODE_PLAY) continue;
+
+        // 3. Mover o pacman do jogador, só com um nível a decorrer
+        GameSession *targets[MAX_PACMANS];
+        frame_t *frames[MAX_PACMANS];
+        int n_frames = 0;
+        coro_mutex_lock(&world->lock);
+        int result = VALID_MOVE;
+        if (world->active) {
+            board_t *board = world->board; // muda a cada nível
+            command_t play = { .command = buf[1], .turns = 1 };
+            debug("KEY %c (pacman %d)\n", play.command, session->pacman_index);
+
+            coro_rwlock_wrlock(&board->state_lock); // Trancar o tabuleiro para mexer
+            result = move_pacman(board, session->pacman_index, &play);
+            // 3.0 O jogador morto recebe o estado final, traduzido ainda com o tabuleiro trancado
+            if (result == DEAD_PACMAN) translate_board_to_session(board, session);
+            coro_rwlock_unlock(&board->state_lock);
+
+            // 3.1 Um pacman no portal faz o mundo inteiro passar de nível
+            if (result == REACHED_PORTAL) {
+                world->level_result = NEXT_LEVEL;
+                world_signal(world);
             }
-            else {
-                session->grid[idx] = ' '; // Empty
+            // 3.2 O jogador recebe já o estado final, antes de sair do mundo (escrito sem o lock)
+            if (result == DEAD_PACMAN) {
+                int send_to[MAX_PACMANS] = {0};
+                send_to[session->pacman_index] = 1;
+                n_frames = snapshot_frames(world, send_to, targets, frames);
             }
         }
+        coro_mutex_unlock(&world->lock);
+        deliver_frames(world, n_frames, targets, frames);
+
+        if (result == DEAD_PACMAN) {
+            break;
+        }
     }
-    
-    if (board->n_pacmans > 0) {
-        session->score = board->pacmans[0].points;
-        session->pacman_x = board->pacmans[0].pos_x;
-        session->pacman_y = board->pacmans[0].pos_y;
+}
+
+/*Função auxiliar que conta o fim de uma tarefa e acorda quem espera pela última (wait_tasks)*/
+static void task_done(int *running) {
+    if (__atomic_sub_fetch(running, 1, __ATOMIC_SEQ_CST) == 0) coro_wake(running);
+}
+
+/*Função auxiliar que corre uma tarefa e avisa quem espera por ela*/
+static void run_task(void *arg) {
+    task_arg_t *task = (task_arg_t *)arg;
+    task->fn(task->arg);
+    if (task->running) task_done(task->running);
+    free(task);
+}
+
+static void *task_thread(void *arg) {
+    run_task(arg);
+    return NULL;
+}
+
+/*Função auxiliar que corre fn(arg) numa corrotina (modo -C) ou numa thread destacada.
+Com running, o contador é incrementado já e decrementado quando fn acaba (ver wait_tasks)*/
+static int start_task(void *(*fn)(void *), void *arg, int *running) {
+    task_arg_t *task = malloc(sizeof(task_arg_t));
+    if (!task) return -1;
+    task->fn = fn;
+    task->arg = arg;
+    task->running = running;
+    if (running) __atomic_add_fetch(running, 1, __ATOMIC_RELAXED);
+
+    int result;
+    if (use_coroutines) {
+        result = coro_spawn(run_task, task);
     }
-    if(board->pacmans[0].alive == 0) {
-        session->game_over = 1;
+    else {
+        pthread_t tid;
+        result = pthread_create(&tid, NULL, task_thread, task);
+        if (result == 0) pthread_detach(tid);
     }
+    if (result != 0) {
+        if (running) __atomic_sub_fetch(running, 1, __ATOMIC_RELAXED);
+        free(task);
+        return -1;
+    }
+    return 0;
+}
 
+/*Função auxiliar que espera que acabem as tarefas arrancadas com este contador, acordada pela última*/
+static void wait_tasks(int *running) {
+    int left;
+    while ((left = __atomic_load_n(running, __ATOMIC_ACQUIRE)) > 0) {
+        coro_wait(running, left, -1);
+    }
 }
 
-/*Tarefa responsável pelo movimento independente dos monstros*/
-void* ghost_thread(void *arg) {
-    ghost_thread_arg_t *ghost_arg = (ghost_thread_arg_t*) arg;
+/*Função auxiliar que marca o primeiro movimento de cada monstro, depois da sua primeira espera.
+Devolve o prazo do primeiro*/
+static long long start_ghost_clocks(board_t *board, tick_clock_t *clocks) {
+    long long next = tick_clock_now_ms() + 100; // sem monstros, só verifica se o nível acabou
+    for (int i = 0; i < board->n_ghosts; i++) {
+        tick_clock_start(&clocks[i], board->tempo * (1 + board->ghosts.passo[i]));
+        if (clocks[i].next_ms < next) next = clocks[i].next_ms;
+    }
+    return next;
+}
 
-    board_t *board = ghost_arg->board;
-    GameSession *session = (GameSession*) ghost_arg->game_session;
-    int ghost_ind = ghost_arg->ghost_index;
-    ghost_t* ghost = &board->ghosts[ghost_ind];
+/*Função auxiliar que move de uma vez (move_ghosts) os monstros com o tempo vencido e marca o seu
+próximo movimento. Chamada com o state_lock, devolve o prazo do próximo*/
+static long long tick_ghosts(board_t *board, tick_clock_t *clocks, long long now_ms) {
+    unsigned char due[MAX_GHOSTS];
+    long long next = now_ms + 100;
+    for (int i = 0; i < board->n_ghosts; i++) {
+        due[i] = (clocks[i].next_ms <= now_ms);
+        if (due[i]) tick_clock_advance(&clocks[i], now_ms, board->tempo * (1 + board->ghosts.passo[i]));
+        if (clocks[i].next_ms < next) next = clocks[i].next_ms;
+    }
+    move_ghosts(board, due);
+    return next;
+}
 
-    free(ghost_arg);
+/*Tarefa responsável pelo movimento dos monstros de um nível, todos de uma vez em cada tick*/
+void* ghosts_thread(void *arg) {
+    world_t *world = (world_t *)arg;
+    board_t *board = world->board;
+
+    // Prazos absolutos: o tempo do movimento e da espera pelo lock não atrasa os seguintes
+    tick_clock_t clocks[MAX_GHOSTS];
+    long long next = start_ghost_clocks(board, clocks);
 
     while (1) {
-        sleep_ms(board->tempo * (1 + ghost->passo));
+        coro_sleep_until_ms(next);
 
-        pthread_rwlock_wrlock(&board->state_lock);
-        if (!session->active) {
-            pthread_rwlock_unlock(&board->state_lock);
+        coro_rwlock_wrlock(&board->state_lock);
+        if (!world->active) {
+            coro_rwlock_unlock(&board->state_lock);
             break;
         }
         
-        // 1. Mover monstro
-        move_ghost(board, ghost_ind, &ghost->moves[ghost->current_move%ghost->n_moves]);
-        pthread_rwlock_unlock(&board->state_lock);
+        // 1. Mover os monstros
+        next = tick_ghosts(board, clocks, tick_clock_now_ms());
+        coro_rwlock_unlock(&board->state_lock);
     }
     return NULL;
 }
 
-/*Tarefa responsável pelo envio periódico do estado do tabuleiro para o cliente*/
-void* send_board_thread(void* arg){
-    pacman_thread_arg_t *pac_arg = (pacman_thread_arg_t*) arg;
+/*Tick de um nível no tick pool (modo -T): move de uma vez, com um só lock, os fantasmas cujo tempo chegou.
+O nível sai do pool no primeiro tick depois de o mundo parar*/
+static int level_tick(tick_task_t *task, long long now_ms) {
+    level_ticker_t *ticker = (level_ticker_t *)task;
+    world_t *world = ticker->world;
+    board_t *board = world->board;
+
+    coro_rwlock_wrlock(&board->state_lock);
+    if (!world->active) {
+        coro_rwlock_unlock(&board->state_lock);
+        task_done(ticker->running);
+        free(ticker);
+        return -1;
+    }
+
+    // 1. Mover os monstros com o tempo vencido e marcar o seu próximo movimento
+    task->deadline_ms = tick_ghosts(board, ticker->ghost_clocks, now_ms);
+    coro_rwlock_unlock(&board->state_lock);
+    return 0;
+}
 
-    board_t *board = pac_arg->board;
-    GameSession *session = pac_arg->game_session;
+/*Função auxiliar que entrega os monstros do nível ao tick pool, devolve 0 se conseguiu*/
+static int start_level_ticker(world_t *world, int *running) {
+    level_ticker_t *ticker = calloc(1, sizeof(level_ticker_t));
+    if (!ticker) return -1;
+    ticker->world = world;
+    ticker->running = running;
+    ticker->task.run = level_tick;
+    ticker->task.node = world->node;
+    ticker->task.deadline_ms = start_ghost_clocks(world->board, ticker->ghost_clocks);
+
+    __atomic_add_fetch(running, 1, __ATOMIC_RELAXED);
+    if (tick_pool_submit(&ticker->task) != 0) {
+        __atomic_sub_fetch(running, 1, __ATOMIC_RELAXED);
+        free(ticker);
+        return -1;
+    }
+    return 0;
+}
+
+/*Tarefa responsável pelo envio periódico do estado do tabuleiro para todos os jogadores do mundo*/
+void* send_board_thread(void* arg){
+    world_t *world = (world_t*) arg;
+    board_t *board = world->board;
 
-    free(pac_arg);
     debug("Board sender thread starts now\n");
 
-    while(session->active) {
-        sleep_ms(100); // Dormir 100ms (10 FPS)
+    // O primeiro frame do nível sai já, os seguintes a cada FRAME_PERIOD_MS
+    tick_clock_t clock;
+    tick_clock_start(&clock, 0);
 
-        pthread_mutex_lock(&session->lock);
-        if (!session->active) {
-            pthread_mutex_unlock(&session->lock);
+    while(1) {
+        coro_sleep_until_ms(clock.next_ms); // 10 FPS, sem escorregar com o tempo de envio
+        tick_clock_advance(&clock, tick_clock_now_ms(), FRAME_PERIOD_MS);
+
+        coro_mutex_lock(&world->lock);
+        if (!world->active) {
+            coro_mutex_unlock(&world->lock);
             break;
         }
-        // 1. Prepara e envia o tabuleiro
-        translate_board_to_session(board, session);
-        send_board_to_client(session);
-        debug("Board sent to client\n");
 
-        pthread_mutex_unlock(&session->lock);
+        // 1. Traduzir as janelas de todos os jogadores com uma só leitura do tabuleiro
+        coro_rwlock_rdlock(&board->state_lock);
+        for (int i = 0; i < MAX_PACMANS; i++) {
+            if (world->placed[i]) translate_board_to_session(board, world->players[i]);
+        }
+        coro_rwlock_unlock(&board->state_lock);
+
+        // 2. Montar os frames com o lock e escrevê-los a cada jogador já sem ele:
+        // um cliente lento não atrasa as jogadas nem a saída dos outros
+        GameSession *targets[MAX_PACMANS];
+        frame_t *frames[MAX_PACMANS];
+        int n_frames = snapshot_frames(world, world->placed, targets, frames);
+        coro_mutex_unlock(&world->lock);
+        deliver_frames(world, n_frames, targets, frames);
     }
     return NULL;
 }
 
-/*Tarefa responsável pelo jogo de cada cliente*/
-void *session_thread(void *arg) {
-    GameSession *session = (GameSession *)arg;
+/*Função auxiliar que fixa a versão atual do pacote de níveis (os mundos que já jogam ficam com a sua)
+e reserva as arenas dos níveis com o tamanho do maior, no nó NUMA node. Devolve o número de níveis,
+-1 se não há pacote*/
+static int open_levels(level_prefetch_t *prefetch, int node) {
+    prefetch->pack = level_pack_acquire();
+    if (!prefetch->pack) {
+        debug("No levels in %s\n", level_files_dirpath);
+        return -1;
+    }
 
-    while(1){
-        // 1. Esperar por pedido de conexão
-        sem_wait(&server_semaphore); // Esperar por thread de sessão disponível
+    // Sem memória para as arenas, os níveis ficam em blocos alocados à medida.
+    // No modo -C quem as aloca e lhes toca é um escalonador de corrotinas: a política põe-nas no nó do mundo
+    for (int i = 0; i < 2; i++) {
+        if (arena_init(&prefetch->arenas[i], prefetch->pack->largest) != 0) arena_init(&prefetch->arenas[i], 0);
+        else affinity_place(prefetch->arenas[i].block->data, prefetch->arenas[i].block->capacity, node);
+    }
+    return prefetch->pack->n_levels;
+}
 
-        pthread_mutex_lock(&server_mutex);
+/*Função auxiliar que liberta um nível carregado, devolvendo a sua arena de uma vez*/
+static void free_level(board_t *board) {
+    arena_t *arena = board->arena;
+    unload_level(board);
+    arena_reset(arena);
+}
 
-        // 2. Tratar do pedido mais antigo
-        char connect_request[(1 + 2 * MAX_PIPE_PATH_LENGTH) * sizeof(char)];
-        memcpy(connect_request, connectbuf[0], sizeof(connect_request));
+/*Função auxiliar que larga a versão dos níveis, as arenas e o nível carregado que já não vai ser jogado*/
+static void free_levels(level_prefetch_t *prefetch) {
+    if (prefetch->board) free_level(prefetch->board);
+    level_pack_release(prefetch->pack);
+    prefetch->pack = NULL;
+    arena_destroy(&prefetch->arenas[0]);
+    arena_destroy(&prefetch->arenas[1]);
+}
 
-        // 3. Deslocar os pedidos no buffer
-        for (int i = 1; i < users_queue_count; i++) {
-            memcpy(connectbuf[i - 1], connectbuf[i], sizeof(connectbuf[i]));
+/*Tarefa que prepara o próximo nível, copiado da versão do pacote do mundo, enquanto o atual é jogado.
+Deixa-o em prefetch->board, ou NULL se já não há mais níveis*/
+void *prefetch_level_thread(void *arg) {
+    level_prefetch_t *prefetch = (level_prefetch_t *)arg;
+    prefetch->board = NULL;
+
+    while (prefetch->pack && prefetch->next < prefetch->pack->n_levels) {
+        // O nível a decorrer está na outra arena, esta ficou livre com o anterior
+        int level = prefetch->next++;
+        arena_t *arena = &prefetch->arenas[prefetch->next_arena];
+        board_t *board = arena_alloc(arena, sizeof(board_t));
+        if (!board) break;
+        board->arena = arena;
+        if (copy_level(board, prefetch->pack->levels[level]) == -1) {
+            debug("Failed to copy level: %s\n", prefetch->pack->names[level]);
+            arena_reset(arena);
+            continue;
         }
-        users_queue_count--;
+        prefetch->board = board;
+        prefetch->board_level = level;
+        prefetch->next_arena ^= 1;
+        break;
+    }
+    return NULL;
+}
 
-        pthread_mutex_unlock(&server_mutex);
+/*Tarefa responsável pelos níveis de um mundo: a simulação dos fantasmas e o envio
+dos frames são feitos uma só vez para todos os jogadores que lá estão.
+O nível seguinte é carregado em segundo plano, a passagem de nível é só trocar o tabuleiro*/
+void *world_thread(void *arg) {
+    world_t *world = (world_t *)arg;
+
+    // Os níveis são alocados e tocados primeiro aqui, nos cores de simulação do nó do mundo
+    // (os monstros e o carregamento herdam a afinidade; numa corrotina a tarefa é do escalonador e não se mexe)
+    if (!coro_running()) affinity_pin_node(AFFINITY_SIM, world->node);
+
+    // 1. Fixar a versão dos níveis e preparar já o primeiro
+    level_prefetch_t prefetch = {0};
+    open_levels(&prefetch, world->node);
+    prefetch_level_thread(&prefetch);
+    int prefetching = 0;
+
+    while (prefetch.board) {
+        // 2. Trocar para o nível já carregado e colocar os jogadores que ainda estão em jogo
+        board_t *board = prefetch.board;
+        prefetch.board = NULL;
+
+        coro_mutex_lock(&world->lock);
+        if (world->n_players == 0) {
+            world->closed = 1;
+            coro_mutex_unlock(&world->lock);
+            free_level(board);
+            break;
+        }
+        world->board = board;
+        world->level++;
+        for (int i = 0; i < MAX_PACMANS; i++) {
+            if (world->placed[i] && !world->players[i]->game_over) {
+                load_pacman(board, i, world->players[i]->score);
+            }
+        }
+        world->level_result = CONTINUE_PLAY;
+        world->active = 1;
+        coro_mutex_unlock(&world->lock);
+
+        // 3. Criar tarefas do nível, partilhadas por todos os jogadores
+        int running = 0;
+        start_task(send_board_thread, world, &running);
+
+        // 3.1 Os monstros são um tick no pool partilhado por todos os mundos, ou uma tarefa por nível
+        if (board->n_ghosts > 0 && (!tick_pool_running() || start_level_ticker(world, &running) != 0)) {
+            start_task(ghosts_thread, world, &running);
+        }
+
+        // 3.2 Copiar o nível seguinte enquanto este é jogado (sem tarefa, copia-o já)
+        if (start_task(prefetch_level_thread, &prefetch, &prefetching) != 0) {
+            prefetch_level_thread(&prefetch);
+        }
+
+        // 4. Esperar que um pacman chegue ao portal ou que já ninguém possa jogar
+        coro_mutex_lock(&world->lock);
+        while (world->level_result == CONTINUE_PLAY && world_alive_players(world) > 0) {
+            world_wait(world, 100); // as mortes por fantasmas não acordam ninguém
+        }
+        coro_rwlock_wrlock(&board->state_lock);
+        world->active = 0;
+        coro_rwlock_unlock(&board->state_lock);
+        int result = world->level_result;
+        coro_mutex_unlock(&world->lock);
+
+        // 5. Parar o nível; o seguinte normalmente já está pronto
+        wait_tasks(&running);
+        wait_tasks(&prefetching);
+
+        // 6. Estado final do nível para todos, com vitória se não há mais níveis
+        // Sem nível seguinte o mundo fecha já, antes do último frame: quem chegar depois começa outro
+        coro_mutex_lock(&world->lock);
+        int last_level = (result == NEXT_LEVEL && prefetch.board == NULL);
+        if (result != NEXT_LEVEL || last_level) world->closed = 1;
+        debug("World '%s' level %d ended with %d dots left\n", world->name, world->level, board->dots_left);
+        for (int i = 0; i < MAX_PACMANS; i++) {
+            GameSession *player = world->players[i];
+            if (!world->placed[i]) continue;
+            translate_board_to_session(board, player);
+            if (last_level && !player->game_over) player->victory = 1;
+        }
+        GameSession *targets[MAX_PACMANS];
+        frame_t *frames[MAX_PACMANS];
+        int n_frames = snapshot_frames(world, world->placed, targets, frames);
+        world->board = NULL;
+        coro_mutex_unlock(&world->lock);
+        deliver_frames(world, n_frames, targets, frames);
+        free_level(board);
+
+        if (result != NEXT_LEVEL) break;
+    }
+
+    // 7. Libertar o nível carregado que já não vai ser jogado e a lista
+    free_levels(&prefetch);
+
+    // 8. Fechar o mundo (se ficou sem níveis antes de jogar algum) e esperar que os jogadores que restam saiam
+    coro_mutex_lock(&world->lock);
+    world->closed = 1;
+    coro_mutex_unlock(&world->lock);
+    world_close(world);
+    coro_mutex_lock(&world->lock);
+    for (int i = 0; i < MAX_PACMANS; i++) {
+        if (world->players[i]) world->players[i]->active = 0;
+    }
+    while (world->n_players > 0) {
+        world_wait(world, 100);
+    }
+    coro_mutex_unlock(&world->lock);
+
+    debug("World '%s' finished after %d levels\n", world->name, world->level);
+    world_free(world);
+    return NULL;
+}
+
+/*Função auxiliar que joga um nível do modo headless (-H): o pacman 0 segue o ficheiro PAC do nível,
+já lido na versão do pacote. Devolve NEXT_LEVEL, QUIT_GAME se o pacman morreu ou CONTINUE_PLAY
+se o nível não acabou em HEADLESS_MAX_TICKS*/
+static int play_headless_level(board_t *board, const headless_pacman_t *pacman, int *points, headless_worker_t *worker) {
+    script_policy_t policy;
+    if (headless_place_pacman(board, *points, pacman, &policy) != 0) return QUIT_GAME;
+
+    int result = headless_play_level(board, script_policy, &policy, HEADLESS_MAX_TICKS, &worker->ticks);
+    *points = board->pacmans[0].points;
+
+    if (result == REACHED_PORTAL) return NEXT_LEVEL;
+    return (result == DEAD_PACMAN) ? QUIT_GAME : CONTINUE_PLAY;
+}
+
+/*Tarefa de um trabalhador do modo headless: joga jogos inteiros, nível a nível, até não haver mais*/
+static void *headless_thread(void *arg) {
+    headless_worker_t *worker = (headless_worker_t *)arg;
+    int cpu = affinity_pin_one(AFFINITY_SIM, worker->index);
+
+    level_prefetch_t prefetch = {0};
+    if (open_levels(&prefetch, (cpu >= 0) ? affinity_cpu_node(cpu) : -1) <= 0) {
+        free_levels(&prefetch);
+        return NULL;
+    }
+
+    while (__atomic_fetch_add(&headless_next_game, 1, __ATOMIC_RELAXED) < headless_games) {
+        // Cada jogo volta ao primeiro nível, nas arenas deste trabalhador
+        prefetch.next = 0;
+        prefetch_level_thread(&prefetch);
+        int points = 0;
+
+        while (prefetch.board) {
+            board_t *board = prefetch.board;
+            int result = play_headless_level(board, &prefetch.pack->pacmans[prefetch.board_level], &points, worker);
+            free_level(board);
+            prefetch.board = NULL;
+
+            if (result == QUIT_GAME) worker->deaths++;
+            if (result == CONTINUE_PLAY) worker->timeouts++;
+            if (result != NEXT_LEVEL) break;
+            worker->levels++;
+            prefetch_level_thread(&prefetch);
+        }
+        worker->games++;
+        worker->points += points;
+    }
+
+    free_levels(&prefetch);
+    return NULL;
+}
+
+/*Modo headless (-H): joga headless_games jogos em n_threads tarefas, sem clientes, e mostra o débito.
+Devolve 0 se correu*/
+static int run_headless(int n_threads) {
+    headless_worker_t *workers = calloc(n_threads, sizeof(headless_worker_t));
+    if (!workers) return 1;
+
+    struct timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+    long long start = monotonic_ms();
+
+    int started = 0;
+    for (int i = 0; i < n_threads; i++) {
+        workers[i].index = i;
+        if (pthread_create(&workers[i].tid, NULL, headless_thread, &workers[i]) != 0) break;
+        started++;
+    }
+    headless_worker_t total = {0};
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].tid, NULL);
+        total.ticks += workers[i].ticks;
+        total.games += workers[i].games;
+        total.levels += workers[i].levels;
+        total.deaths += workers[i].deaths;
+        total.timeouts += workers[i].timeouts;
+        total.points += workers[i].points;
+    }
+
+    long long elapsed_ms = monotonic_ms() - start;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+    double elapsed = (elapsed_ms > 0 ? elapsed_ms : 1) / 1000.0;
+    double cpu = (cpu_end.tv_sec - cpu_start.tv_sec) + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e9;
+    if (cpu <= 0) cpu = elapsed;
+
+    // O débito por core conta o tempo de CPU, não o de relógio: não depende de quantos cores havia livres
+    printf("Headless: %d games on %d threads, %d levels cleared, %d deaths, %d timeouts, %lld points\n",
+           total.games, started, total.levels, total.deaths, total.timeouts, total.points);
+    printf("Headless: %lld ticks in %.3f s (%.3f s CPU): %.0f ticks/s, %.0f ticks/s/core\n",
+           total.ticks, elapsed, cpu, total.ticks / elapsed, total.ticks / cpu);
+    debug("Headless: %d games, %lld ticks in %lld ms\n", total.games, total.ticks, elapsed_ms);
+
+    free(workers);
+    return started > 0 ? 0 : 1;
+}
+
+void *session_thread(void *arg);
 
-        // 4. Processar o pedido de conexão
-        board_t game_board;
-        memset(session, 0, sizeof(GameSession));
-        memset(&game_board, 0, sizeof(game_board));
-        session->active = 1;
-        pthread_mutex_init(&session->lock, NULL);
+/*Função auxiliar que cria uma tarefa de sessão numa posição livre, devolve 0 se conseguiu (com server_mutex).
+A tarefa conta como livre desde já, para um pedido seguinte não criar outra. No modo -C é uma corrotina*/
+static int spawn_session_thread() {
+    int slot = -1;
+    for (int i = 0; i < max_sessions && slot == -1; i++) {
+        if (!active_sessions[i]) slot = i;
+    }
+    if (slot == -1) return -1;
+
+    // A simulação escreve em cada tick o estado traduzido na sessão: muda-se para o nó de cada mundo onde entra
+    active_sessions[slot] = affinity_alloc(sizeof(GameSession), -1);
+    if (!active_sessions[slot]) return -1;
+
+    if (start_task(session_thread, (void *)(intptr_t)slot, NULL) != 0) {
+        affinity_release(active_sessions[slot], sizeof(GameSession));
+        active_sessions[slot] = NULL;
+        return -1;
+    }
+    n_sessions++;
+    idle_sessions++;
+    return 0;
+}
+
+/*Função auxiliar que cresce o pool enquanto há mais pedidos na fila do que tarefas livres (com server_mutex)*/
+static void grow_session_pool() {
+    while (users_queue_count > idle_sessions && n_sessions < max_sessions) {
+        if (spawn_session_thread() != 0) break;
+    }
+}
+
+/*Função auxiliar que retira a tarefa da posição slot do pool (com server_mutex, já fora das livres).
+A posição fica livre na mesma secção em que deixa de contar, e um pedido que tenha chegado
+entretanto ganha logo outra tarefa*/
+static void retire_session(int slot) {
+    affinity_release(active_sessions[slot], sizeof(GameSession));
+    active_sessions[slot] = NULL;
+    n_sessions--;
+    grow_session_pool();
+}
+
+/*Função auxiliar que espera pelo pedido mais antigo da fila. Devolve 0 com o pedido em *pending,
+ou -1 (já retirada do pool) se a tarefa ficou SESSION_IDLE_TIMEOUT_MS sem pedidos e o pool tem mais
+do que min_sessions. As corrotinas não esperam: são baratas de criar e saem logo que a fila fica vazia*/
+static int wait_connect_request(int slot, connect_request_t *pending) {
+    // 1. Esperar por pedido de conexão
+    while (!use_coroutines) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += SESSION_IDLE_TIMEOUT_MS / 1000;
+        deadline.tv_nsec += (SESSION_IDLE_TIMEOUT_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (sem_timedwait(&server_semaphore, &deadline) == 0) break;
+        if (errno != ETIMEDOUT) continue;
+
+        // 1.1 Sem trabalho: encolher, a não ser que um pedido tenha chegado entretanto
+        coro_mutex_lock(&server_mutex);
+        if (users_queue_count == 0 && n_sessions > min_sessions) {
+            idle_sessions--;
+            retire_session(slot);
+            coro_mutex_unlock(&server_mutex);
+            return -1;
+        }
+        coro_mutex_unlock(&server_mutex);
+    }
+
+    coro_mutex_lock(&server_mutex);
+    idle_sessions--;
+    if (users_queue_count == 0) {
+        retire_session(slot);
+        coro_mutex_unlock(&server_mutex);
+        return -1;
+    }
+
+    // 2. Tratar do pedido mais antigo
+    *pending = connectbuf[0];
+
+    // 3. Deslocar os pedidos no buffer
+    for (int i = 1; i < users_queue_count; i++) {
+        connectbuf[i - 1] = connectbuf[i];
+    }
+    users_queue_count--;
+
+    // 3.1 Esta tarefa deixou de estar livre: os pedidos que restam podem precisar de outra
+    grow_session_pool();
+
+    coro_mutex_unlock(&server_mutex);
+    return 0;
+}
 
-        // 5. Abrir pipes do cliente, por ordem que são abertos no api.c
-        char req_path[MAX_PIPE_PATH_LENGTH], notif_path[MAX_PIPE_PATH_LENGTH];
-        memcpy(req_path, connect_request + sizeof(char), MAX_PIPE_PATH_LENGTH);
-        memcpy(notif_path, connect_request + sizeof(char) + MAX_PIPE_PATH_LENGTH * sizeof(char), MAX_PIPE_PATH_LENGTH);
+/*Função auxiliar que abre um pipe do cliente. Numa corrotina nem a abertura nem o uso podem bloquear:
+tenta de novo a cada 10ms, dando ao cliente até um segundo para abrir o outro lado, e o fd fica
+não bloqueante (as leituras e escritas esperam com coro_poll / coro_write)*/
+static int open_client_pipe(const char *path, int flags) {
+    if (!coro_running()) return open(path, flags);
+
+    for (int i = 0; i < 100; i++) {
+        int fd = open(path, flags | O_NONBLOCK);
+        if (fd != -1) return fd;
+        if (errno != ENXIO) return -1;
+        coro_sleep_ms(10);
+    }
+    return -1;
+}
 
+/*Função auxiliar que serve um pedido de conexão, do ACK ao fim do jogo do cliente*/
+static void serve_client(GameSession *session, connect_request_t *pending) {
+    char *connect_request = pending->request;
+
+    // 4. Processar o pedido de conexão
+    memset(session, 0, sizeof(GameSession));
+    session->active = 1;
+
+    // 5. Abrir pipes do cliente, por ordem que são abertos no api.c
+    char req_path[MAX_PIPE_PATH_LENGTH], notif_path[MAX_PIPE_PATH_LENGTH];
+    memcpy(req_path, connect_request + sizeof(char), MAX_PIPE_PATH_LENGTH);
+    memcpy(notif_path, connect_request + sizeof(char) + MAX_PIPE_PATH_LENGTH * sizeof(char), MAX_PIPE_PATH_LENGTH);
+    req_path[MAX_PIPE_PATH_LENGTH - 1] = '\0';
+    client_id_from_pipe(req_path, session->client_id);
+
+    // 5.1 Tamanho do terminal do cliente, para o viewport
+    int view_offset = sizeof(char) + 2 * MAX_PIPE_PATH_LENGTH * sizeof(char);
+    memcpy(&session->view_width, connect_request + view_offset, sizeof(int));
+    memcpy(&session->view_height, connect_request + view_offset + sizeof(int), sizeof(int));
+    debug("Client %s viewport: %d x %d\n", session->client_id, session->view_width, session->view_height);
+
+    // 5.2 Escolher a codificação mais compacta que o cliente suporta
+    int encodings;
+    memcpy(&encodings, connect_request + view_offset + 2 * sizeof(int), sizeof(int));
+    session->encoding = (encodings & BOARD_ENCODING_BIT(BOARD_ENCODING_PACKED4)) ? BOARD_ENCODING_PACKED4 : BOARD_ENCODING_RAW;
+
+    // 5.3 Se o cliente criou um segmento partilhado, os frames e as jogadas passam por lá
+    char shm_name[MAX_PIPE_PATH_LENGTH];
+    memcpy(shm_name, connect_request + view_offset + 3 * sizeof(int), MAX_PIPE_PATH_LENGTH);
+    shm_name[MAX_PIPE_PATH_LENGTH - 1] = '\0';
+    if (shm_name[0] != '\0') {
+        session->shm = shm_channel_attach(shm_name);
+    }
+
+    if (pending->fd >= 0) {
+        // 5.4 Cliente por socket: um só fd para pedidos e notificações, os pipes só dão o id
+        session->fd_req = pending->fd;
+        session->fd_notif = pending->fd;
+        if (coro_running()) fcntl(pending->fd, F_SETFL, fcntl(pending->fd, F_GETFL) | O_NONBLOCK);
+        debug("Client %s connected by socket\n", session->client_id);
+    }
+    else {
         debug("Notif pipe:%s\n", notif_path);
-        session->fd_notif = open(notif_path, O_WRONLY);
+        session->fd_notif = open_client_pipe(notif_path, O_WRONLY);
         if (session->fd_notif == -1) {
             debug("Failed to open client request FIFO\n");
-            return NULL;
+            shm_channel_detach(session->shm);
+            return;
         }
 
-        session->fd_req = open(req_path, O_RDONLY);
+        session->fd_req = open_client_pipe(req_path, O_RDONLY);
         if (session->fd_req == -1) {
             debug("Failed to open client notification FIFO\n");
+            shm_channel_detach(session->shm);
             close(session->fd_notif);
-            return NULL;
+            return;
         }
         debug("Client FIFOs opened\n");
+    }
 
 
-        // 6. Enviar Ack de conexão
-        char ack[2 * sizeof(char)] = {OP_CODE_CONNECT, 0}; // Result 0 = OK
+    // 5.5 Mundo onde o cliente quer jogar ("" = jogo individual)
+    char world_name[MAX_PIPE_PATH_LENGTH];
+    memcpy(world_name, connect_request + view_offset + 3 * sizeof(int) + MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH);
+    world_name[MAX_PIPE_PATH_LENGTH - 1] = '\0';
 
-        if(write(session->fd_notif, ack, 2 * sizeof(char)) == -1) {
-            debug("Failed to send connection ACK to client\n");
-            close(session->fd_req);
-            close(session->fd_notif);
-            return NULL;
+    int created;
+    world_t *world = world_join(world_name, session, &created);
+    if (world && created) {
+        start_task(world_thread, world, NULL);
+    }
+    if (world) affinity_move(session, sizeof(GameSession), world->node); // a simulação escreve nela a cada tick
+
+    // 6. Enviar Ack de conexão (recusado se o mundo está cheio)
+    char ack[CONNECT_ACK_SIZE] = {OP_CODE_CONNECT, world ? CONNECT_OK : CONNECT_REFUSED, session->shm ? TRANSPORT_SHM : TRANSPORT_FIFO};
+
+    if(coro_write(session->fd_notif, ack, sizeof(ack)) == -1 || !world) {
+        debug("Failed to send connection ACK to client\n");
+        if (world) world_leave(world, session);
+        shm_channel_detach(session->shm);
+        close(session->fd_req);
+        if (session->fd_notif != session->fd_req) close(session->fd_notif);
+        return;
+    }
+    debug("Connection ACK sent to client\n");
+
+    // 6.1 A partir daqui o jogo pode ser visto por espectadores
+    spectators_open(session);
+
+    leaderboard_record_t personal_best;
+    if (leaderboard_player(session->client_id, &personal_best, 1) == 1) {
+        debug("Client %s personal best: %d points\n", session->client_id, personal_best.points);
+    }
+    long long started_ms = monotonic_ms();
+
+    // 7. Entrar no tabuleiro e jogar até sair, perder ou o mundo acabar
+    world_enter(world, session);
+    play_in_world(world, session);
+    int levels = world_leave(world, session);
+
+    // 8. Registar o jogo no leaderboard (a escrita em disco é feita noutra tarefa)
+    leaderboard_record_t record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.client_id, session->client_id, sizeof(record.client_id));
+    record.levels = levels;
+    record.points = session->score;
+    record.duration_ms = (int)(monotonic_ms() - started_ms);
+    record.finished_at = (long long)time(NULL);
+    leaderboard_submit(&record);
+
+    // 9. Limpeza (os espectadores já têm o frame final pendente)
+    spectators_close(session);
+    free(session->grid);
+    free(session->cells);
+    frame_release(session->frame);
+    session->grid = NULL;
+    session->cells = NULL;
+    session->frame = NULL;
+    shm_channel_detach(session->shm);
+    session->shm = NULL;
+    close(session->fd_req);
+    if (session->fd_notif != session->fd_req) close(session->fd_notif);
+}
+
+/*Tarefa de sessão do pool: serve clientes um a um e sai quando fica parada e o pool pode encolher*/
+void *session_thread(void *arg) {
+    int slot = (int)(intptr_t)arg;
+    GameSession *session = active_sessions[slot];
+    connect_request_t pending;
+
+    while (wait_connect_request(slot, &pending) == 0) {
+        serve_client(session, &pending);
+
+        coro_mutex_lock(&server_mutex);
+        idle_sessions++;
+        coro_mutex_unlock(&server_mutex);
+    }
+
+    // A posição já ficou livre em wait_connect_request
+    debug("Session thread %d stopped\n", slot);
+    return NULL;
+}
+
+/*Função auxiliar que cria o socket Unix SOCK_SEQPACKET de registo no caminho server_fifo*/
+static int open_registry_socket() {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd == -1) return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, server_fifo, sizeof(addr.sun_path) - 1);
+
+    unlink(server_fifo);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, max_sessions) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*Função auxiliar que espera pelo próximo pedido de conexão no socket de registo.
+Os clientes aceites ficam em handshakes até mandarem o pedido, e um só poll vigia o socket de registo
+e todos eles: um cliente lento não prende a host_thread, só perde o lugar ao fim de HANDSHAKE_TIMEOUT_MS.
+Com a fila cheia o cliente é aceite na mesma, para receber a recusa em vez de esperar no backlog.
+Devolve o fd do cliente com o pedido em request, ou -1 se não houve pedido (sinal, tempo ou pedido inválido)*/
+static int accept_connect_request(int listen_fd, char *request, int *n) {
+    static handshake_t handshakes[MAX_HANDSHAKES];
+    static int n_handshakes = 0;
+
+    // 1. Desistir dos que não mandaram o pedido a tempo; o mais próximo de expirar dá o limite do poll
+    long long now = monotonic_ms();
+    int timeout_ms = -1;
+    for (int i = 0; i < n_handshakes;) {
+        long long left = handshakes[i].accepted_ms + HANDSHAKE_TIMEOUT_MS - now;
+        if (left <= 0) {
+            debug("Client accepted on socket sent no connection request\n");
+            close(handshakes[i].fd);
+            handshakes[i] = handshakes[--n_handshakes];
+            continue;
         }
-        debug("Connection ACK sent to client\n");
+        if (timeout_ms == -1 || left < timeout_ms) timeout_ms = (int)left;
+        i++;
+    }
 
-        int total_levels = 0;
-        DIR* count_dir = opendir(level_files_dirpath);
-        struct dirent* count_entry;
-        while ((count_entry = readdir(count_dir)) != NULL) {
-            char *dot = strrchr(count_entry->d_name, '.');
-            if (!dot) continue;
-            if (strcmp(dot, ".lvl") == 0) {
-                total_levels++;
-            }
+    // 2. Esperar (interrompido pelos sinais, tal como o read do FIFO) por um pedido ou por um cliente
+    // novo, este só se houver lugar: os restantes esperam no backlog do socket
+    struct pollfd pfds[MAX_HANDSHAKES + 1];
+    for (int i = 0; i < n_handshakes; i++) {
+        pfds[i].fd = handshakes[i].fd;
+        pfds[i].events = POLLIN;
+    }
+    pfds[n_handshakes].fd = (n_handshakes < MAX_HANDSHAKES) ? listen_fd : -1;
+    pfds[n_handshakes].events = POLLIN;
+    if (poll(pfds, n_handshakes + 1, timeout_ms) <= 0) return -1;
+
+    // 3. Um pedido por chamada: o pedido é a primeira mensagem, já está no socket
+    for (int i = 0; i < n_handshakes; i++) {
+        if (!pfds[i].revents) continue;
+
+        int client_fd = handshakes[i].fd;
+        handshakes[i] = handshakes[--n_handshakes];
+        *n = recv(client_fd, request, CONNECT_REQUEST_SIZE, MSG_DONTWAIT);
+        if (*n != CONNECT_REQUEST_SIZE) {
+            debug("Invalid connection request on socket\n");
+            close(client_fd);
+            return -1;
         }
-        closedir(count_dir);
-
-        // 7. Abre a diretoria
-        DIR* level_dir = opendir(level_files_dirpath);
-        if (level_dir == NULL) {
-            debug("Failed to open directory: %s\n", level_files_dirpath);
-            return 0;
-        }
-
-        struct dirent* entry;
-        int accumulated_points = 0;
-        int current_level_idx = 0;
-        int result;
-        while ((entry = readdir(level_dir)) != NULL && !session->game_over){
-            if (entry->d_name[0] == '.') continue;
-
-            char *dot = strrchr(entry->d_name, '.');
-            if (!dot) continue;
-
-            if (strcmp(dot, ".lvl") == 0) {
-                // 8. Carregar nível
-                if (load_level(&game_board, session, entry->d_name, level_files_dirpath, accumulated_points) == -1) {
-                    debug("Failed to load level: %s\n", entry->d_name);
-                    continue;
-                }
-                current_level_idx++;
-
-                while(1){
-                    
-                    session->active = 1;
-
-                    // 9. Criar threads para o jogo, cuidado com a ordem!
-                    pthread_t input_tid, board_tid;
-                    pthread_t *ghost_tids = malloc(game_board.n_ghosts * sizeof(pthread_t));
-
-                    // 9.1 Criar thread de envio do tabuleiro
-                    pacman_thread_arg_t *board_arg = malloc(sizeof(pacman_thread_arg_t));
-                    board_arg->board = &game_board;
-                    board_arg->game_session = session;
-                    pthread_create(&board_tid, NULL, send_board_thread, board_arg);
-
-                    // 9.2 Criar threads dos fantasmas
-                    for (int i = 0; i < game_board.n_ghosts; i++) {
-                        ghost_thread_arg_t *arg = malloc(sizeof(ghost_thread_arg_t));
-                        arg->board = &game_board;
-                        arg->ghost_index = i;
-                        arg->game_session = session;
-                        pthread_create(&ghost_tids[i], NULL, ghost_thread, (void*) arg);
-                    }
-
-                    // 9.3 Criar thread do input do pacman
-                    pacman_thread_arg_t *pac_arg = malloc(sizeof(pacman_thread_arg_t));
-                    pac_arg->board = &game_board;
-                    pac_arg->game_session = session;
-                    pthread_create(&input_tid, NULL, input_handler_thread, (void *) pac_arg);
-
-                    // 10. Esperar pela thread de input terminar
-                    int *retval;
-                    pthread_join(input_tid, (void**)&retval);
-
-                    // 11. Parar o jogo
-                    pthread_mutex_lock(&session->lock);
-                    session->active = 0;
-                    pthread_mutex_unlock(&session->lock);
-
-                    for (int i = 0; i < game_board.n_ghosts; i++) {
-                        pthread_join(ghost_tids[i], NULL);
-                    }
-
-                    free(ghost_tids);
-
-                    pthread_join(board_tid, NULL);
-
-                    // 12. Processar o resultado do jogo
-                    result = *retval;
-                    free(retval);
-
-                    // 12.1 Se o pacman chegou ao portal
-                    if (result == NEXT_LEVEL) {
-                        accumulated_points = game_board.pacmans[0].points;
-
-                        // Último nível concluído
-                        if (current_level_idx == total_levels) {
-                            pthread_mutex_lock(&session->lock);
-                            session->victory = 1;
-                            pthread_mutex_unlock(&session->lock);
-                            translate_board_to_session(&game_board, session);// tem que enviar o tab final de vitória aqui porque só aqui 
-                            send_board_to_client(session);// é que ele sabe se os níveis acabaram
-                            break; // Sair do loop de níveis
-                        }
-
-                        // Preparar para o próximo nível
-                        if (current_level_idx != total_levels) {
-                            unload_level(&game_board);
-                            free(session->grid);
-                            session->grid = NULL;
-                        }
-                        break; // Carregar próximo nível
-                    }
-
-                    // 12.2 Se o pacman morreu ou pediu para sair
-                    if (result == QUIT_GAME) {
-                        pthread_mutex_lock(&session->lock);
-                        session->game_over = 1;
-                        pthread_mutex_unlock(&session->lock);
-                        unload_level(&game_board);
-                        free(session->grid);
-                        session->grid = NULL;
-                        break; // Sair do loop de níveis
-                    }
-                } //fim do while do nível
-            } //fim do if do .lvl
-
-            // Se o jogo acabou, sair do loop dos níveis
-            if(session->game_over || session->victory || result == QUIT_GAME) {
-                break;
-            }
-        } //fim do while dos níveis
+        return client_fd;
+    }
 
-        // 13. Limpeza
-        close(session->fd_req);
-        close(session->fd_notif);
+    // 4. Cliente novo: fica à espera do pedido com os outros
+    if (pfds[n_handshakes].revents) {
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd != -1) {
+            handshakes[n_handshakes].fd = client_fd;
+            handshakes[n_handshakes].accepted_ms = monotonic_ms();
+            n_handshakes++;
+        }
+    }
+    return -1;
+}
 
-        closedir(level_dir);
-        pthread_mutex_destroy(&session->lock);  
+/*Tarefa que entrega a recusa a um cliente por FIFOs sem prender a host_thread.
+Os pipes são abertos sem bloquear, dando ao cliente até um segundo para abrir o de notificações*/
+static void *reject_thread(void *arg) {
+    reject_arg_t *reject = (reject_arg_t *)arg;
+    char req_path[MAX_PIPE_PATH_LENGTH], notif_path[MAX_PIPE_PATH_LENGTH];
+    memcpy(req_path, reject->request + 1, MAX_PIPE_PATH_LENGTH);
+    memcpy(notif_path, reject->request + 1 + MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH);
+    req_path[MAX_PIPE_PATH_LENGTH - 1] = '\0';
+    notif_path[MAX_PIPE_PATH_LENGTH - 1] = '\0';
+
+    // 1. Esperar que o cliente abra o pipe de notificações para leitura
+    int fd_notif = -1;
+    for (int i = 0; i < 100 && fd_notif == -1; i++) {
+        fd_notif = open(notif_path, O_WRONLY | O_NONBLOCK);
+        if (fd_notif == -1) sleep_ms(10);
     }
+
+    if (fd_notif != -1) {
+        // 2. O cliente só lê o ACK depois de abrir o pipe de pedidos, que precisa de um leitor
+        int fd_req = open(req_path, O_RDONLY | O_NONBLOCK);
+        if (write(fd_notif, reject->ack, sizeof(reject->ack)) != sizeof(reject->ack)) {
+            debug("Failed to send rejection to client\n");
+        }
+
+        // 3. Manter os pipes abertos até o cliente desistir deles
+        struct pollfd pfd = { .fd = fd_notif, .events = 0 };
+        poll(&pfd, 1, 1000);
+        if (fd_req != -1) close(fd_req);
+        close(fd_notif);
+    }
+    free(reject);
     return NULL;
 }
 
+/*Função auxiliar que recusa um pedido de conexão por falta de capacidade, com o tempo sugerido para tentar de novo*/
+static void reject_connect_request(const char *request, int client_fd, int retry_after_ms) {
+    char ack[CONNECT_ACK_SIZE] = {OP_CODE_CONNECT, CONNECT_BUSY, TRANSPORT_FIFO};
+    memcpy(ack + 3, &retry_after_ms, sizeof(int));
+
+    // 1. Por socket a recusa segue logo, o buffer do cliente está vazio
+    if (client_fd != -1) {
+        send(client_fd, ack, sizeof(ack), MSG_DONTWAIT);
+        close(client_fd);
+        return;
+    }
+
+    // 2. Por FIFOs a abertura dos pipes depende do cliente, fica para outra tarefa
+    reject_arg_t *reject = malloc(sizeof(reject_arg_t));
+    if (!reject) return;
+    memcpy(reject->request, request, CONNECT_REQUEST_SIZE);
+    memcpy(reject->ack, ack, CONNECT_ACK_SIZE);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, reject_thread, reject) != 0) {
+        free(reject);
+        return;
+    }
+    pthread_detach(tid);
+}
+
 /*Tarefa responsável pelo atendimento aos pedidos de conexão dos clientes*/
 void* host_thread(void* arg) {
     (void)arg;
@@ -561,32 +1299,41 @@ void* host_thread(void* arg) {
     sigaddset(&mask, SIGINT);
     pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
 
-    // 1. Criar pipe do servidor
-    mkfifo(server_fifo, 0666);
+    int fd, dummy_fd = -1;
+    if (use_socket) {
+        // 1. Criar o socket de registo (mensagens com fronteiras, um fd por cliente)
+        fd = open_registry_socket();
+        if (fd == -1) {
+            debug("Failed to open server socket\n");
+            return NULL;
+        }
+    }
+    else {
+        // 1. Criar pipe do servidor
+        mkfifo(server_fifo, 0666);
 
-    // 2. Abre para leitura
-    int fd = open(server_fifo, O_RDONLY);
+        // 2. Abre para leitura
+        fd = open(server_fifo, O_RDONLY);
 
-    // 2.1 Abrir para escrita dummy para não receber EOF
-    int dummy_fd = open(server_fifo, O_WRONLY);
+        // 2.1 Abrir para escrita dummy para não receber EOF
+        dummy_fd = open(server_fifo, O_WRONLY);
 
-    if (fd == -1 || dummy_fd == -1) {
-        debug("Failed to open server FIFO\n");
-        return NULL;
+        if (fd == -1 || dummy_fd == -1) {
+            debug("Failed to open server FIFO\n");
+            return NULL;
+        }
     }
 
     // 3. Inicializa semáforo e buffer produtor-consumidor
-    sem_init(&server_semaphore, 0, 0); // começa a zeros, o passo 4. trata da capacidade
+    sem_init(&server_semaphore, 0, 0); // conta os pedidos na fila
     pthread_mutex_init(&server_mutex, NULL); 
 
-    // 4. Inicializar threads de sessão de jogo
-    for (int i = 0; i < max_sessions; i++) {
-        pthread_t sessions;
-        active_sessions[i] = malloc(sizeof(GameSession));
-        pthread_create(&sessions, NULL, session_thread, (void*)active_sessions[i]);
-    }
+    // 4. Inicializar as tarefas de sessão mínimas, as restantes são criadas com a procura
+    coro_mutex_lock(&server_mutex);
+    while (n_sessions < min_sessions && spawn_session_thread() == 0);
+    coro_mutex_unlock(&server_mutex);
 
-    char temp_buf[(1 + 2 * MAX_PIPE_PATH_LENGTH) * sizeof(char)];
+    char temp_buf[CONNECT_REQUEST_SIZE];
 
     while(1){
 
@@ -600,10 +1347,18 @@ void* host_thread(void* arg) {
         if (terminar_servidor) break;
 
         // 4. Espera por conexão de cliente
-        // Protocolo connect: OP(1) + PipeReq(40) + PipeNotif(40) + 2(\0) = 81 bytes
+        // Protocolo connect: OP(1) + PipeReq(40) + PipeNotif(40) + Viewport(2 * int) + Codificações(int) + Shm(40) = 133 bytes
         memset(temp_buf, 0, sizeof(temp_buf));
 
-        int n = read(fd, &temp_buf, sizeof(temp_buf));
+        int client_fd = -1;
+        int n;
+        if (use_socket) {
+            client_fd = accept_connect_request(fd, temp_buf, &n);
+            if (client_fd == -1) continue; // sinal, fila cheia ou pedido inválido
+        }
+        else {
+            n = read(fd, &temp_buf, sizeof(temp_buf));
+        }
 
         if (n < 0) {
             if (errno == EINTR) {
@@ -618,25 +1373,42 @@ void* host_thread(void* arg) {
         }
 
         char opcode = temp_buf[0];
-        if (opcode == OP_CODE_CONNECT && n == (1 + 2 * MAX_PIPE_PATH_LENGTH) * sizeof(char)) {
-            // 5. Coloca pedido na fila (buffer produtor-consumidor)
-            pthread_mutex_lock(&server_mutex);
+        if (opcode == OP_CODE_CONNECT && n == CONNECT_REQUEST_SIZE) {
+            // 5. Coloca pedido na fila (buffer produtor-consumidor), ou recusa se a fila está cheia
+            int retry_after_ms = 0;
+            coro_mutex_lock(&server_mutex);
+
+            if (users_queue_count >= max_queue) {
+                // 5.1 Sugerir uma espera proporcional aos pedidos à frente por tarefa de sessão
+                retry_after_ms = CONNECT_RETRY_MS * (1 + users_queue_count / max_sessions);
+            }
+            else {
+                memcpy(connectbuf[users_queue_count].request, temp_buf, sizeof(temp_buf));
+                connectbuf[users_queue_count].fd = client_fd;
+                if (!use_coroutines) sem_post(&server_semaphore);
+                users_queue_count++;
+                grow_session_pool();
+            }
 
-            memcpy(connectbuf[users_queue_count], temp_buf, sizeof(connectbuf[0]));
-            sem_post(&server_semaphore);
-            users_queue_count++;
+            coro_mutex_unlock(&server_mutex);
 
-            pthread_mutex_unlock(&server_mutex);
+            if (retry_after_ms > 0) {
+                debug("Connection queue full, client told to retry in %d ms\n", retry_after_ms);
+                reject_connect_request(temp_buf, client_fd, retry_after_ms);
+            }
+        }
+        else if (opcode == OP_CODE_SPECTATE && n == CONNECT_REQUEST_SIZE) {
+            // 5.1 Espectadores não ocupam sessões: cada um tem a sua tarefa de escrita
+            spectator_attach(temp_buf, client_fd);
+        }
+        else if (client_fd != -1) {
+            close(client_fd);
         }
 
     }
 
-    // 6. Limpeza
-    for (int i = 0; i < max_sessions; i++) {
-        free(active_sessions[i]);
-    }
-    
-    close(dummy_fd);
+    // 6. Limpeza (cada tarefa de sessão liberta a sua sessão)
+    if (dummy_fd != -1) close(dummy_fd);
     unlink(server_fifo);
     close(fd);
     pthread_mutex_destroy(&server_mutex);
@@ -676,15 +1448,48 @@ int main(int argc, char *argv[]) {
     }
 
     open_debug_file("server_debug.log");
-    if(argc != 4) {
-        debug("Usage: %s <levels_dir(str)> <max_sessions(int)> <nome_FIFO_de_registo(str)>\n", argv[0]);
+
+    // Opções: -S usa um socket Unix SOCK_SEQPACKET como registo em vez do FIFO,
+    //         -m tarefas de sessão sempre criadas, -q pedidos à espera antes de recusar,
+    //         -C sessões em corrotinas sobre n escalonadores (0 = um por core),
+    //         -T monstros de todos os níveis em n trabalhadores com roubo de trabalho (0 = um por core),
+    //         -A cores para as tarefas de I/O, simulação e leaderboard ("io:sim:log", p.ex. "0-1:2-7:0"),
+    //         -H n jogos sem clientes, o mais depressa possível, em max_sessions tarefas (sem FIFO de registo)
+    int opt, coroutine_threads = 0, tick_workers = -1;
+    while ((opt = getopt(argc, argv, "Sm:q:C:T:A:H:")) != -1) {
+        if (opt == 'S') use_socket = 1;
+        else if (opt == 'C') {
+            use_coroutines = 1;
+            coroutine_threads = atoi(optarg);
+        }
+        else if (opt == 'T') tick_workers = atoi(optarg);
+        else if (opt == 'A') {
+            if (affinity_configure(optarg) != 0) argc = -1;
+        }
+        else if (opt == 'm') min_sessions = atoi(optarg);
+        else if (opt == 'q') max_queue = atoi(optarg);
+        else if (opt == 'H') {
+            headless_games = atoi(optarg);
+            if (headless_games <= 0) argc = -1;
+        }
+        else argc = -1;
+    }
+    if (argc - optind != 3 && !(headless_games > 0 && argc - optind == 2)) {
+        debug("Usage: %s [-S] [-m min_sessions] [-q max_queue] [-C threads] [-T workers] [-A io:sim:log] <levels_dir(str)> <max_sessions(int)> <nome_FIFO_de_registo(str)>\n", argv[0]);
+        debug("       %s -H games [-A io:sim:log] <levels_dir(str)> <threads(int)>\n", argv[0]);
         return 1;
     }
+    argv += optind - 1;
 
     strncpy(level_files_dirpath, argv[1], sizeof(level_files_dirpath) - 1);
     level_files_dirpath[sizeof(level_files_dirpath) - 1] = '\0';
 
     max_sessions = atoi(argv[2]);
+    if (max_sessions < 1) max_sessions = 1;
+    if (min_sessions < 0) min_sessions = 0;
+    if (min_sessions > max_sessions) min_sessions = max_sessions;
+    if (max_queue <= 0) max_queue = max_sessions;
+    if (max_queue > MAX_CONNECT_QUEUE) max_queue = MAX_CONNECT_QUEUE;
     active_sessions = calloc(max_sessions, sizeof(GameSession*));
 
     if (active_sessions == NULL) {
@@ -692,13 +1497,48 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Modo headless: só a simulação, cada trabalhador fixa-se a um core de simulação
+    if (headless_games > 0) {
+        level_pack_open(level_files_dirpath, 0);
+        int result = run_headless(max_sessions);
+        level_pack_close();
+        close_debug_file();
+        return result;
+    }
+
     strncpy(server_fifo, argv[3], sizeof(server_fifo) - 1);
     server_fifo[sizeof(server_fifo) - 1] = '\0';
 
+    encoder_init();
+
+    // As tarefas herdam a afinidade de quem as cria: tudo parte de I/O e cada papel fixa-se ao arrancar
+    affinity_pin(AFFINITY_IO);
+
+    // Os escalonadores herdam a máscara do main, com SIGUSR1 e SIGINT bloqueados
+    if (use_coroutines && coro_start(coroutine_threads) != 0) {
+        debug("Failed to start coroutine schedulers, using threads\n");
+        use_coroutines = 0;
+    }
+    if (tick_workers >= 0 && tick_pool_start(tick_workers) != 0) {
+        debug("Failed to start tick pool, using a task per ghost\n");
+    }
+
+    // Os níveis são lidos uma vez aqui e de novo só quando a diretoria muda, nunca ao ligar um cliente
+    if (level_pack_open(level_files_dirpath, 1) != 0) {
+        debug("No levels in %s yet, waiting for the directory to have some\n", level_files_dirpath);
+    }
+
+    if (leaderboard_open() != 0) {
+        debug("Leaderboard unavailable, games will not be recorded\n");
+    }
+
     pthread_t host_tid;
     pthread_create(&host_tid, NULL, host_thread, NULL);
     pthread_join(host_tid, NULL);
 
+    leaderboard_close();
+    level_pack_close();
+
     close_debug_file();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,409 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "spectator.h"
+#include "protocol.h"
+#include "coroutine.h"
+#include "tick_clock.h"
+#include "debug.h"
+
+typedef struct spectator {
+    int fd_req;           // só serve para manter o pipe do cliente aberto
+    int fd_notif;         // frames para o espectador (não bloqueante)
+    int opening;          // à espera que o cliente abra os pipes, até opening_deadline_ms
+    long long opening_deadline_ms;
+    int answered;         // o ACK já está em sending (ou enviado)
+    frame_t *pending;     // último frame publicado por enviar, trocado atomicamente (um espectador lento salta frames)
+    frame_t *sending;     // frame a meio da escrita, só a tarefa de envio lhe mexe
+    int sent;             // bytes de sending já escritos
+    int closed;           // a sessão acabou (ou foi recusado): sai depois do que tem pendente
+    int sndbuf;           // socket: bytes pedidos para o buffer de envio (0 = o do sistema)
+    struct spectator_list *list; // sessão a que está ligado (protegido por registry_lock)
+    struct spectator *next;      // na lista da sessão
+    struct spectator *next_served; // nos espectadores da tarefa de envio
+    char request[CONNECT_REQUEST_SIZE];
+} spectator_t;
+
+// Espectadores de uma sessão em jogo
+typedef struct spectator_list {
+    char client_id[MAX_CLIENT_ID_LENGTH];
+    int encoding;         // codificação dos frames do jogador
+    pthread_mutex_t lock; // protege head e count
+    spectator_t *head;
+    int count;
+    struct spectator_list *next;
+} spectator_list_t;
+
+// Sessões que se podem ver, procuradas pelo id do jogador
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static spectator_list_t *registry = NULL;
+
+// Tarefa única que escreve para todos os espectadores; os novos chegam por incoming
+static pthread_once_t sender_once = PTHREAD_ONCE_INIT;
+static int sender_running = 0;
+static pthread_mutex_t incoming_lock = PTHREAD_MUTEX_INITIALIZER;
+static spectator_t *incoming = NULL;
+static int wake_pipe[2] = {-1, -1}; // acorda a tarefa de envio: frame publicado ou espectador novo
+static int wake_pending = 0;        // já há um byte no wake_pipe por ler
+
+frame_t *frame_alloc(int size) {
+    frame_t *frame = malloc(sizeof(frame_t) + size);
+    if (!frame) return NULL;
+    frame->refcount = 1;
+    frame->size = size;
+    frame->capacity = size;
+    return frame;
+}
+
+frame_t *frame_reuse(frame_t *frame, int size) {
+    // Só com a nossa referência já nenhum espectador o está a ler
+    if (frame && __atomic_load_n(&frame->refcount, __ATOMIC_ACQUIRE) == 1 && frame->capacity >= size) {
+        frame->size = size;
+        return frame;
+    }
+    frame_release(frame);
+    return frame_alloc(size);
+}
+
+void frame_retain(frame_t *frame) {
+    __atomic_add_fetch(&frame->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void frame_release(frame_t *frame) {
+    if (frame && __atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(frame);
+    }
+}
+
+int frame_fit_send_buffer(int fd, int *requested, int size) {
+    if (size <= *requested) return 0;
+
+    int wanted = SOCKET_FRAMES_IN_FLIGHT * size;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &wanted, sizeof(wanted));
+
+    // O sistema dobra o pedido (metade é para contabilidade) e limita-o a net.core.wmem_max
+    int granted = 0;
+    socklen_t len = sizeof(granted);
+    if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &granted, &len) == -1 || granted / 2 < size) {
+        debug("Send buffer of %d bytes cannot hold a %d byte frame\n", granted, size);
+        return -1;
+    }
+    *requested = size;
+    return 0;
+}
+
+/*Função auxiliar que tira o espectador da lista da sessão, se ainda lá estiver*/
+static void spectator_detach(spectator_t *spec) {
+    coro_mutex_lock(&registry_lock);
+    spectator_list_t *list = spec->list;
+    if (list) {
+        coro_mutex_lock(&list->lock);
+        for (spectator_t **it = &list->head; *it; it = &(*it)->next) {
+            if (*it == spec) {
+                *it = spec->next;
+                __atomic_store_n(&list->count, list->count - 1, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+        coro_mutex_unlock(&list->lock);
+        spec->list = NULL;
+    }
+    coro_mutex_unlock(&registry_lock);
+}
+
+/*Função auxiliar que liga o espectador à sessão do jogador pedido, devolve 0 se conseguiu*/
+static int spectator_register(spectator_t *spec, const char *target, int encodings) {
+    int result = 1;
+    coro_mutex_lock(&registry_lock);
+    for (spectator_list_t *list = registry; list; list = list->next) {
+        if (strcmp(list->client_id, target) != 0) continue;
+
+        // O frame é enviado tal como foi codificado para o jogador
+        if (encodings & BOARD_ENCODING_BIT(list->encoding)) {
+            coro_mutex_lock(&list->lock);
+            spec->next = list->head;
+            list->head = spec;
+            __atomic_store_n(&list->count, list->count + 1, __ATOMIC_RELAXED);
+            coro_mutex_unlock(&list->lock);
+            spec->list = list;
+            result = 0;
+        }
+        break;
+    }
+    coro_mutex_unlock(&registry_lock);
+    return result;
+}
+
+/*Função auxiliar que acorda a tarefa de envio, com no máximo um byte no pipe por ler*/
+static void sender_wake(void) {
+    if (!__atomic_exchange_n(&wake_pending, 1, __ATOMIC_ACQ_REL) && write(wake_pipe[1], "", 1) == -1) {
+        debug("Failed to wake the spectator sender\n");
+    }
+}
+
+/*Função auxiliar que abre os pipes do cliente sem bloquear, pela mesma ordem que a sessão.
+Devolve 1 se estão abertos, 0 se o cliente ainda não abriu o de notificações, -1 se desistiu*/
+static int spectator_open_pipes(spectator_t *spec) {
+    char req_path[MAX_PIPE_PATH_LENGTH], notif_path[MAX_PIPE_PATH_LENGTH];
+    memcpy(req_path, spec->request + 1, MAX_PIPE_PATH_LENGTH);
+    memcpy(notif_path, spec->request + 1 + MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH);
+    req_path[MAX_PIPE_PATH_LENGTH - 1] = '\0';
+    notif_path[MAX_PIPE_PATH_LENGTH - 1] = '\0';
+
+    spec->fd_notif = open(notif_path, O_WRONLY | O_NONBLOCK);
+    if (spec->fd_notif == -1) {
+        return (errno == ENXIO && tick_clock_now_ms() < spec->opening_deadline_ms) ? 0 : -1;
+    }
+    spec->fd_req = open(req_path, O_RDONLY | O_NONBLOCK);
+    return (spec->fd_req == -1) ? -1 : 1;
+}
+
+/*Função auxiliar que liga o espectador à sessão pedida e põe o ACK como primeiro frame a enviar.
+Se não há sessão, o espectador sai depois de receber a recusa*/
+static int spectator_answer(spectator_t *spec) {
+    int view_offset = 1 + 2 * MAX_PIPE_PATH_LENGTH;
+    int encodings;
+    char target[MAX_CLIENT_ID_LENGTH];
+    memcpy(&encodings, spec->request + view_offset + 2 * sizeof(int), sizeof(int));
+    memcpy(target, spec->request + view_offset + 3 * sizeof(int), MAX_CLIENT_ID_LENGTH);
+    target[MAX_CLIENT_ID_LENGTH - 1] = '\0';
+
+    // Só depois do ACK é que saem frames: os publicados esperam em pending
+    spec->sending = frame_alloc(CONNECT_ACK_SIZE);
+    if (!spec->sending) return -1;
+    char *ack = spec->sending->data;
+    memset(ack, 0, CONNECT_ACK_SIZE);
+    ack[0] = OP_CODE_SPECTATE;
+    ack[1] = spectator_register(spec, target, encodings);
+    ack[2] = TRANSPORT_FIFO;
+    if (ack[1] != 0) spec->closed = 1;
+    debug("Spectator for %s: %s\n", target, ack[1] == 0 ? "attached" : "no such game");
+    return 0;
+}
+
+/*Função auxiliar que avança um espectador tanto quanto der sem bloquear: abrir os pipes,
+responder ao pedido e escrever o último frame publicado.
+Devolve 1 se ficou à espera do fd (POLLOUT), 0 se não tem nada por escrever, -1 se acabou*/
+static int spectator_advance(spectator_t *spec) {
+    if (spec->opening) {
+        int opened = spectator_open_pipes(spec);
+        if (opened <= 0) return opened;
+        spec->opening = 0;
+    }
+    if (!spec->answered) {
+        if (spectator_answer(spec) != 0) return -1;
+        spec->answered = 1;
+    }
+
+    while (1) {
+        // 1. Próximo frame: o fim da sessão é lido antes, para não perder o último publicado
+        if (!spec->sending) {
+            int closed = __atomic_load_n(&spec->closed, __ATOMIC_ACQUIRE);
+            spec->sending = __atomic_exchange_n(&spec->pending, NULL, __ATOMIC_ACQ_REL);
+            spec->sent = 0;
+            if (!spec->sending) return closed ? -1 : 0;
+
+            int socket = (spec->fd_req == spec->fd_notif);
+            if (socket && frame_fit_send_buffer(spec->fd_notif, &spec->sndbuf, spec->sending->size) != 0) return -1;
+        }
+
+        // 2. Escrever o que falta; num pipe cheio o resto fica para quando houver espaço
+        ssize_t n = write(spec->fd_notif, spec->sending->data + spec->sent, spec->sending->size - spec->sent);
+        if (n == -1) return (errno == EAGAIN || errno == EINTR) ? 1 : -1;
+        spec->sent += n;
+        if (spec->sent < spec->sending->size) continue;
+
+        frame_release(spec->sending);
+        spec->sending = NULL;
+    }
+}
+
+/*Função auxiliar que liberta um espectador que acabou*/
+static void spectator_free(spectator_t *spec) {
+    spectator_detach(spec);
+    frame_release(spec->sending);
+    frame_release(spec->pending);
+    if (spec->fd_req != -1 && spec->fd_req != spec->fd_notif) close(spec->fd_req);
+    if (spec->fd_notif != -1) close(spec->fd_notif);
+    free(spec);
+}
+
+/*Tarefa que serve todos os espectadores com fds não bloqueantes: um poll espera por frames
+publicados (wake_pipe), por espaço nos espectadores atrasados e pelos que desligam*/
+static void *sender_thread(void *arg) {
+    (void)arg;
+    spectator_t *served = NULL;
+    int n_served = 0;
+    struct pollfd *pfds = NULL;
+    spectator_t **polled = NULL; // espectador de cada pfds[i], i >= 1
+    int capacity = 0;
+
+    while (1) {
+        // 1. Acordado: esvaziar o pipe antes de ver os espectadores, para não perder um aviso
+        char drain[64];
+        __atomic_store_n(&wake_pending, 0, __ATOMIC_RELEASE);
+        while (read(wake_pipe[0], drain, sizeof(drain)) > 0);
+
+        // 2. Adotar os espectadores novos
+        pthread_mutex_lock(&incoming_lock);
+        while (incoming) {
+            spectator_t *spec = incoming;
+            incoming = spec->next_served;
+            spec->next_served = served;
+            served = spec;
+            n_served++;
+        }
+        pthread_mutex_unlock(&incoming_lock);
+
+        if (n_served + 1 > capacity) {
+            int grown_capacity = 2 * (n_served + 1);
+            struct pollfd *grown = realloc(pfds, grown_capacity * sizeof(struct pollfd));
+            if (grown) pfds = grown;
+            spectator_t **grown_polled = grown ? realloc(polled, grown_capacity * sizeof(spectator_t *)) : NULL;
+            if (!grown_polled) {
+                sleep_ms(SPECTATOR_OPEN_RETRY_MS);
+                continue;
+            }
+            polled = grown_polled;
+            capacity = grown_capacity;
+        }
+
+        // 3. Avançar cada um; os que acabaram saem, os outros ficam no poll
+        int n_pfds = 1, opening = 0;
+        pfds[0].fd = wake_pipe[0];
+        pfds[0].events = POLLIN;
+        for (spectator_t **it = &served; *it;) {
+            spectator_t *spec = *it;
+            int state = spectator_advance(spec);
+            if (state < 0) {
+                *it = spec->next_served;
+                n_served--;
+                spectator_free(spec);
+                continue;
+            }
+            if (spec->opening) opening = 1;
+            else {
+                // Mesmo sem eventos pedidos, o poll avisa quando o cliente desliga (POLLERR / POLLHUP)
+                pfds[n_pfds].fd = spec->fd_notif;
+                pfds[n_pfds].events = (state == 1) ? POLLOUT : 0;
+                polled[n_pfds++] = spec;
+            }
+            it = &spec->next_served;
+        }
+
+        // 4. Esperar; quem ainda não abriu os pipes volta a tentar daqui a pouco
+        if (poll(pfds, n_pfds, opening ? SPECTATOR_OPEN_RETRY_MS : -1) <= 0) continue;
+        for (int i = 1; i < n_pfds; i++) {
+            if (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) __atomic_store_n(&polled[i]->closed, 1, __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+/*Função auxiliar que arranca a tarefa de envio, uma vez*/
+static void sender_start(void) {
+    if (pipe(wake_pipe) == -1) return;
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, sender_thread, NULL) != 0) {
+        debug("Failed to start spectator sender\n");
+        return;
+    }
+    pthread_detach(tid);
+    sender_running = 1;
+}
+
+void spectator_attach(const char *request, int fd) {
+    pthread_once(&sender_once, sender_start);
+    spectator_t *spec = sender_running ? calloc(1, sizeof(spectator_t)) : NULL;
+    if (!spec) {
+        if (fd != -1) close(fd);
+        return;
+    }
+    memcpy(spec->request, request, CONNECT_REQUEST_SIZE);
+    spec->fd_req = fd;
+    spec->fd_notif = fd;
+    if (fd != -1) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    else {
+        // Os pipes são abertos pela tarefa de envio, dando ao cliente até SPECTATOR_OPEN_TIMEOUT_MS
+        spec->opening = 1;
+        spec->opening_deadline_ms = tick_clock_now_ms() + SPECTATOR_OPEN_TIMEOUT_MS;
+    }
+
+    pthread_mutex_lock(&incoming_lock);
+    spec->next_served = incoming;
+    incoming = spec;
+    pthread_mutex_unlock(&incoming_lock);
+    sender_wake();
+}
+
+void spectators_open(GameSession *session) {
+    spectator_list_t *list = calloc(1, sizeof(spectator_list_t));
+    if (!list) return;
+    memcpy(list->client_id, session->client_id, MAX_CLIENT_ID_LENGTH);
+    list->encoding = session->encoding;
+    pthread_mutex_init(&list->lock, NULL);
+
+    coro_mutex_lock(&registry_lock);
+    list->next = registry;
+    registry = list;
+    coro_mutex_unlock(&registry_lock);
+
+    session->spectators = list;
+}
+
+int spectators_watching(GameSession *session) {
+    return session->spectators && __atomic_load_n(&session->spectators->count, __ATOMIC_RELAXED) > 0;
+}
+
+void spectators_publish(GameSession *session, frame_t *frame) {
+    spectator_list_t *list = session->spectators;
+    if (!list || !frame) return;
+
+    coro_mutex_lock(&list->lock);
+    for (spectator_t *spec = list->head; spec; spec = spec->next) {
+        // Uma referência por espectador, o frame anterior por enviar é descartado
+        frame_retain(frame);
+        frame_release(__atomic_exchange_n(&spec->pending, frame, __ATOMIC_ACQ_REL));
+    }
+    int watched = (list->head != NULL);
+    coro_mutex_unlock(&list->lock);
+    if (watched) sender_wake();
+}
+
+void spectators_close(GameSession *session) {
+    spectator_list_t *list = session->spectators;
+    if (!list) return;
+
+    // 1. Deixar de ser encontrada por novos espectadores
+    coro_mutex_lock(&registry_lock);
+    for (spectator_list_t **it = &registry; *it; it = &(*it)->next) {
+        if (*it == list) {
+            *it = list->next;
+            break;
+        }
+    }
+
+    // 2. Avisar os espectadores, que saem depois de enviar o que têm pendente
+    coro_mutex_lock(&list->lock);
+    int watched = (list->head != NULL);
+    for (spectator_t *spec = list->head; spec; spec = spec->next) {
+        spec->list = NULL;
+        __atomic_store_n(&spec->closed, 1, __ATOMIC_RELEASE);
+    }
+    coro_mutex_unlock(&list->lock);
+    coro_mutex_unlock(&registry_lock);
+    if (watched) sender_wake();
+
+    pthread_mutex_destroy(&list->lock);
+    free(list);
+    session->spectators = NULL;
+}
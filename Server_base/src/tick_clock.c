@@ -0,0 +1,42 @@
+#include <time.h>
+
+#include "tick_clock.h"
+
+static tick_stats_t totals;
+
+long long tick_clock_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void tick_clock_start(tick_clock_t *clock, int period_ms) {
+    clock->next_ms = tick_clock_now_ms() + period_ms;
+}
+
+void tick_clock_advance(tick_clock_t *clock, long long now_ms, int period_ms) {
+    // 1. Contabilizar o atraso deste tick
+    long long late = now_ms - clock->next_ms;
+    if (late < 0) late = 0;
+    __atomic_add_fetch(&totals.ticks, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&totals.late_ms, late, __ATOMIC_RELAXED);
+    long long max = __atomic_load_n(&totals.max_late_ms, __ATOMIC_RELAXED);
+    while (late > max && !__atomic_compare_exchange_n(&totals.max_late_ms, &max, late, 1,
+                                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    // 2. O próximo prazo conta a partir do anterior, não de agora, para o período não escorregar
+    clock->next_ms += period_ms;
+
+    // 3. Overrun: o próximo prazo também já passou, recomeçar a partir de agora
+    if (clock->next_ms <= now_ms) {
+        __atomic_add_fetch(&totals.overruns, 1, __ATOMIC_RELAXED);
+        clock->next_ms = now_ms + period_ms;
+    }
+}
+
+void tick_clock_stats(tick_stats_t *stats) {
+    stats->ticks = __atomic_load_n(&totals.ticks, __ATOMIC_RELAXED);
+    stats->overruns = __atomic_load_n(&totals.overruns, __ATOMIC_RELAXED);
+    stats->late_ms = __atomic_load_n(&totals.late_ms, __ATOMIC_RELAXED);
+    stats->max_late_ms = __atomic_load_n(&totals.max_late_ms, __ATOMIC_RELAXED);
+}
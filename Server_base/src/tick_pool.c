@@ -0,0 +1,305 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "tick_pool.h"
+#include "debug.h"
+#include "affinity.h"
+
+// Deque Chase-Lev de tamanho fixo: só o dono faz push e take, qualquer um faz steal
+typedef struct {
+    long top;    // próximo a roubar
+    long bottom; // próxima posição livre do dono
+    tick_task_t *buffer[TICK_DEQUE_SIZE];
+} tick_deque_t;
+
+typedef struct {
+    pthread_t tid;
+    int index;
+    int node;                   // nó NUMA do core onde está fixado
+    tick_deque_t deque;
+    tick_task_t **heap;         // prazos das tarefas deste trabalhador (só o dono mexe)
+    int heap_count;
+    int heap_capacity;
+    pthread_mutex_t inbox_lock; // protege inbox
+    tick_task_t **inbox;        // entregues por outras tarefas
+    int inbox_count;
+    int inbox_capacity;
+    unsigned int wake;          // palavra do futex onde o trabalhador dorme sem trabalho
+    int parked;                 // a dormir em wake: quem lhe dá trabalho tem de o acordar
+} tick_worker_t;
+
+static tick_worker_t *workers = NULL;
+static int n_workers = 0;
+static unsigned int next_worker = 0;
+
+/*Função auxiliar para o tempo monotónico em milissegundos*/
+static long long monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*Dorme enquanto *word == expected, até timeout_ms (-1 = sem limite)*/
+static void futex_wait(unsigned int *word, unsigned int expected, int timeout_ms) {
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, (timeout_ms >= 0) ? &ts : NULL, NULL, 0);
+}
+
+/*Função auxiliar que acorda o trabalhador se estiver a dormir, devolve 1 se o acordou*/
+static int wake_worker(tick_worker_t *worker) {
+    // O trabalho já publicado tem de ser visto antes de parked (o trabalhador faz o inverso)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int parked = 1;
+    if (!__atomic_compare_exchange_n(&worker->parked, &parked, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return 0;
+    __atomic_add_fetch(&worker->wake, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &worker->wake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    return 1;
+}
+
+/*Função auxiliar que acorda um trabalhador parado para roubar ticks vencidos de quem os tem a mais*/
+static void wake_thief(tick_worker_t *worker) {
+    int count = __atomic_load_n(&n_workers, __ATOMIC_ACQUIRE);
+    for (int i = 1; i < count; i++) {
+        if (wake_worker(&workers[(worker->index + i) % count])) return;
+    }
+}
+
+/*Dono: coloca um tick vencido no fundo, devolve -1 se o deque está cheio*/
+static int deque_push(tick_deque_t *deque, tick_task_t *task) {
+    long b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    long t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (b - t >= TICK_DEQUE_SIZE) return -1;
+
+    __atomic_store_n(&deque->buffer[b & (TICK_DEQUE_SIZE - 1)], task, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/*Dono: tira o tick mais recente do fundo, NULL se vazio*/
+static tick_task_t *deque_take(tick_deque_t *deque) {
+    long b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    tick_task_t *task = __atomic_load_n(&deque->buffer[b & (TICK_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+        // Último elemento: disputado com os ladrões pelo topo
+        if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            task = NULL;
+        }
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+/*Ticks no deque, para quem decide se vale a pena acordar ou dormir*/
+static long deque_size(tick_deque_t *deque) {
+    long b = __atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST);
+    return b - t;
+}
+
+/*Ladrão: tira o tick mais antigo do topo, NULL se vazio ou se perdeu a disputa*/
+static tick_task_t *deque_steal(tick_deque_t *deque) {
+    long t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return NULL;
+
+    tick_task_t *task = __atomic_load_n(&deque->buffer[t & (TICK_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return task;
+}
+
+/*Função auxiliar que guarda o prazo de uma tarefa na heap do trabalhador (mínimo na raiz)*/
+static int heap_push(tick_worker_t *worker, tick_task_t *task) {
+    if (worker->heap_count == worker->heap_capacity) {
+        int capacity = worker->heap_capacity ? 2 * worker->heap_capacity : 64;
+        tick_task_t **grown = realloc(worker->heap, capacity * sizeof(tick_task_t *));
+        if (!grown) return -1;
+        worker->heap = grown;
+        worker->heap_capacity = capacity;
+    }
+
+    int i = worker->heap_count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (worker->heap[parent]->deadline_ms <= task->deadline_ms) break;
+        worker->heap[i] = worker->heap[parent];
+        i = parent;
+    }
+    worker->heap[i] = task;
+    return 0;
+}
+
+static tick_task_t *heap_pop(tick_worker_t *worker) {
+    tick_task_t *top = worker->heap[0];
+    tick_task_t *last = worker->heap[--worker->heap_count];
+
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= worker->heap_count) break;
+        if (child + 1 < worker->heap_count && worker->heap[child + 1]->deadline_ms < worker->heap[child]->deadline_ms) {
+            child++;
+        }
+        if (last->deadline_ms <= worker->heap[child]->deadline_ms) break;
+        worker->heap[i] = worker->heap[child];
+        i = child;
+    }
+    if (worker->heap_count > 0) worker->heap[i] = last;
+    return top;
+}
+
+/*Função auxiliar que corre um tick; a tarefa fica com o prazo seguinte na heap de quem a correu*/
+static void run_tick(tick_worker_t *worker, tick_task_t *task) {
+    if (task->run(task, monotonic_ms()) != 0) return;
+    if (heap_push(worker, task) != 0) {
+        debug("Tick pool worker %d out of memory, dropping task\n", worker->index);
+    }
+}
+
+/*Tarefa de cada trabalhador: vence prazos, corre os seus ticks e rouba os dos outros quando fica sem trabalho*/
+static void *tick_worker_thread(void *arg) {
+    tick_worker_t *worker = (tick_worker_t *)arg;
+
+    // Um core por trabalhador, para os deques e as heaps ficarem na cache e no nó de quem os usa
+    int cpu = affinity_pin_one(AFFINITY_SIM, worker->index);
+    __atomic_store_n(&worker->node, (cpu >= 0) ? affinity_cpu_node(cpu) : 0, __ATOMIC_RELEASE);
+
+    while (1) {
+        // 1. Receber as tarefas entregues por outras tarefas
+        pthread_mutex_lock(&worker->inbox_lock);
+        for (int i = 0; i < worker->inbox_count; i++) {
+            if (heap_push(worker, worker->inbox[i]) != 0) run_tick(worker, worker->inbox[i]);
+        }
+        worker->inbox_count = 0;
+        pthread_mutex_unlock(&worker->inbox_lock);
+
+        // 2. Passar os ticks vencidos para o deque, onde podem ser roubados; havendo mais do que um,
+        // acorda-se quem está parado para os repartir
+        long long now = monotonic_ms();
+        while (worker->heap_count > 0 && worker->heap[0]->deadline_ms <= now) {
+            tick_task_t *task = heap_pop(worker);
+            if (deque_push(&worker->deque, task) != 0) run_tick(worker, task); // deque cheio, corre já
+        }
+        if (deque_size(&worker->deque) > 1) wake_thief(worker);
+
+        // 3. Correr os próprios ticks, do mais recente para o mais antigo (os antigos são os roubados)
+        tick_task_t *task = deque_take(&worker->deque);
+        if (task) {
+            run_tick(worker, task);
+            continue;
+        }
+
+        // 4. Sem trabalho: roubar aos outros, começando no seguinte e primeiro no mesmo nó NUMA
+        int count = __atomic_load_n(&n_workers, __ATOMIC_ACQUIRE);
+        tick_worker_t *victim = NULL;
+        for (int remote = 0; remote < 2 && !task; remote++) {
+            for (int i = 1; i < count && !task; i++) {
+                victim = &workers[(worker->index + i) % count];
+                if ((__atomic_load_n(&victim->node, __ATOMIC_ACQUIRE) != worker->node) != remote) continue;
+                task = deque_steal(&victim->deque);
+            }
+        }
+        if (task) {
+            // Se a vítima ainda tem ticks à espera, outro parado pode ajudar
+            if (deque_size(&victim->deque) > 1) wake_thief(worker);
+            run_tick(worker, task);
+            continue;
+        }
+
+        // 5. Parar até ao próximo prazo próprio, ou até alguém entregar ou vencer trabalho (wake_worker)
+        unsigned int wake = __atomic_load_n(&worker->wake, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&worker->parked, 1, __ATOMIC_SEQ_CST);
+        int work = __atomic_load_n(&worker->inbox_count, __ATOMIC_SEQ_CST) > 0;
+        for (int i = 1; i < count && !work; i++) {
+            work = deque_size(&workers[(worker->index + i) % count].deque) > 0;
+        }
+        int wait = -1;
+        if (worker->heap_count > 0) {
+            long long left = worker->heap[0]->deadline_ms - monotonic_ms();
+            wait = (left > 0) ? (int)left : 0;
+        }
+        if (!work && wait != 0) futex_wait(&worker->wake, wake, wait);
+        __atomic_store_n(&worker->parked, 0, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+int tick_pool_start(int workers_wanted) {
+    if (workers_wanted <= 0) workers_wanted = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers_wanted <= 0) workers_wanted = 1;
+
+    workers = calloc(workers_wanted, sizeof(tick_worker_t));
+    if (!workers) return -1;
+
+    for (int i = 0; i < workers_wanted; i++) {
+        tick_worker_t *worker = &workers[i];
+        worker->index = i;
+        pthread_mutex_init(&worker->inbox_lock, NULL);
+    }
+
+    // Os trabalhadores roubam uns aos outros: n_workers só cresce com o trabalhador já pronto
+    for (int i = 0; i < workers_wanted; i++) {
+        if (pthread_create(&workers[i].tid, NULL, tick_worker_thread, &workers[i]) != 0) break;
+        pthread_detach(workers[i].tid);
+        __atomic_store_n(&n_workers, i + 1, __ATOMIC_RELEASE);
+    }
+    debug("Tick pool started: %d workers\n", n_workers);
+    return n_workers > 0 ? 0 : -1;
+}
+
+int tick_pool_running(void) {
+    return __atomic_load_n(&n_workers, __ATOMIC_ACQUIRE) > 0;
+}
+
+int tick_pool_submit(tick_task_t *task) {
+    int count = __atomic_load_n(&n_workers, __ATOMIC_ACQUIRE);
+    int first = __atomic_fetch_add(&next_worker, 1, __ATOMIC_RELAXED) % count;
+
+    // À vez, mas a um trabalhador no nó da memória do tick se houver algum
+    tick_worker_t *worker = &workers[first];
+    for (int i = 0; i < count && task->node >= 0; i++) {
+        tick_worker_t *candidate = &workers[(first + i) % count];
+        if (__atomic_load_n(&candidate->node, __ATOMIC_ACQUIRE) != task->node) continue;
+        worker = candidate;
+        break;
+    }
+
+    pthread_mutex_lock(&worker->inbox_lock);
+    if (worker->inbox_count == worker->inbox_capacity) {
+        int capacity = worker->inbox_capacity ? 2 * worker->inbox_capacity : 16;
+        tick_task_t **grown = realloc(worker->inbox, capacity * sizeof(tick_task_t *));
+        if (grown) {
+            worker->inbox = grown;
+            worker->inbox_capacity = capacity;
+        }
+    }
+    int result = -1;
+    if (worker->inbox_count < worker->inbox_capacity) {
+        worker->inbox[worker->inbox_count++] = task;
+        result = 0;
+    }
+    pthread_mutex_unlock(&worker->inbox_lock);
+
+    if (result == 0) wake_worker(worker);
+    return result;
+}
@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "world.h"
+#include "coroutine.h"
+#include "affinity.h"
+#include "debug.h"
+
+// Mundos com nome, à espera de jogadores (protegido por registry_lock)
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static world_t *registry = NULL;
+
+/*Função auxiliar que cria um mundo vazio*/
+static world_t *world_create(const char *name) {
+    // O mundo é lido a cada tick pela simulação: fica no nó NUMA onde ela vai correr
+    int node = affinity_pick_node(AFFINITY_SIM);
+    world_t *world = affinity_alloc(sizeof(world_t), node);
+    if (!world) return NULL;
+    world->node = node;
+    strncpy(world->name, name, MAX_PIPE_PATH_LENGTH - 1);
+    pthread_mutex_init(&world->lock, NULL);
+    return world;
+}
+
+world_t *world_join(const char *name, GameSession *session, int *created) {
+    *created = 0;
+    world_t *world = NULL;
+
+    // 1. Procurar um mundo com este nome que ainda não acabou (os jogos individuais nunca são partilhados).
+    // O lock do mundo encontrado fica já tomado, para não fechar entre a procura e a entrada
+    coro_mutex_lock(&registry_lock);
+    if (name[0] != '\0') {
+        for (world = registry; world; world = world->next) {
+            if (strcmp(world->name, name) != 0) continue;
+            coro_mutex_lock(&world->lock);
+            if (!world->closed) break;
+            coro_mutex_unlock(&world->lock);
+        }
+    }
+
+    // 2. Criar se não existir
+    if (!world) {
+        world = world_create(name);
+        if (!world) {
+            coro_mutex_unlock(&registry_lock);
+            return NULL;
+        }
+        if (name[0] != '\0') {
+            world->next = registry;
+            registry = world;
+        }
+        *created = 1;
+        coro_mutex_lock(&world->lock);
+    }
+
+    // 3. Ocupar o primeiro pacman livre
+    int index = -1;
+    for (int i = 0; i < MAX_PACMANS && index == -1; i++) {
+        if (!world->players[i]) index = i;
+    }
+    if (index != -1) {
+        world->players[index] = session;
+        world->placed[index] = 0;
+        world->n_players++;
+        session->pacman_index = index;
+        session->first_level = world->level + 1; // ainda não está no tabuleiro
+    }
+    coro_mutex_unlock(&world->lock);
+    coro_mutex_unlock(&registry_lock);
+
+    if (index == -1) {
+        debug("World %s is full\n", name);
+        return NULL;
+    }
+    debug("Client %s joined world '%s' as pacman %d\n", session->client_id, name, index);
+    return world;
+}
+
+void world_enter(world_t *world, GameSession *session) {
+    int index = session->pacman_index;
+
+    coro_mutex_lock(&world->lock);
+    world->placed[index] = 1;
+
+    // A meio de um nível entra já, senão fica para o próximo load
+    session->first_level = world->active ? world->level : world->level + 1;
+    if (world->active) {
+        coro_rwlock_wrlock(&world->board->state_lock);
+        load_pacman(world->board, index, session->score);
+        coro_rwlock_unlock(&world->board->state_lock);
+    }
+    coro_mutex_unlock(&world->lock);
+}
+
+int world_leave(world_t *world, GameSession *session) {
+    int index = session->pacman_index;
+
+    coro_mutex_lock(&world->lock);
+    // Um frame para esta sessão pode estar a ser escrito sem o lock
+    while (world->sending > 0) {
+        world_wait(world, 100);
+    }
+    if (world->active && world->board->pacmans[index].alive) {
+        coro_rwlock_wrlock(&world->board->state_lock);
+        kill_pacman(world->board, index);
+        coro_rwlock_unlock(&world->board->state_lock);
+    }
+    world->players[index] = NULL;
+    world->placed[index] = 0;
+    world->n_players--;
+    // Só os níveis desde que entrou: um mundo partilhado pode ir muito à frente
+    int levels = world->level - session->first_level + 1;
+    if (levels < 0) levels = 0;
+    world_signal(world);
+    coro_mutex_unlock(&world->lock);
+    return levels;
+}
+
+int world_alive_players(world_t *world) {
+    int alive = 0;
+    for (int i = 0; i < MAX_PACMANS; i++) {
+        if (!world->players[i]) continue;
+        if (!world->placed[i] || world->board->pacmans[i].alive) alive++;
+    }
+    return alive;
+}
+
+void world_wait(world_t *world, int ms) {
+    // Sem variável de condição: o lock é largado com coro_mutex_unlock, para acordar as corrotinas
+    // que o esperam, e a espera é no contador (numa corrotina cede o escalonador)
+    int seen = world->changes;
+    coro_mutex_unlock(&world->lock);
+    coro_wait(&world->changes, seen, ms);
+    coro_mutex_lock(&world->lock);
+}
+
+void world_signal(world_t *world) {
+    __atomic_add_fetch(&world->changes, 1, __ATOMIC_SEQ_CST);
+    coro_wake(&world->changes);
+}
+
+void world_close(world_t *world) {
+    coro_mutex_lock(&registry_lock);
+    for (world_t **it = &registry; *it; it = &(*it)->next) {
+        if (*it == world) {
+            *it = world->next;
+            break;
+        }
+    }
+    coro_mutex_unlock(&registry_lock);
+}
+
+void world_free(world_t *world) {
+    pthread_mutex_destroy(&world->lock);
+    affinity_release(world, sizeof(world_t));
+}
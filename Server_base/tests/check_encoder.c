@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "encoder.h"
+
+#define MAX_CELLS 1100 // cobre todos os restos das iterações de 16, 32 e 64 células
+#define ROUNDS 200
+
+/*
+Equivalência das implementações vetoriais com a escalar: para tamanhos de 0 a MAX_CELLS e
+bytes quaisquer (também códigos fora de CELL_*), cada codificação tem de dar os mesmos bytes,
+e nenhuma pode escrever depois do fim que encoded_size anuncia.
+*/
+
+static const char *isa_names[ENCODER_ISAS] = {"scalar", "ssse3", "avx2"};
+
+/*Função auxiliar que codifica com o conjunto de instruções isa, com uma guarda depois do fim*/
+static int encode_with(int isa, const unsigned char *cells, int n, int encoding, char *out) {
+    encoder_use(isa);
+    memset(out, 0x5A, MAX_CELLS + 64);
+    int size = encode_cells(cells, n, encoding, out);
+    for (int i = size; i < size + 64; i++) {
+        if (out[i] != 0x5A) return -1;
+    }
+    return size;
+}
+
+int main(void) {
+    unsigned char cells[MAX_CELLS];
+    static char expected[MAX_CELLS + 64], got[MAX_CELLS + 64];
+    int failures = 0, tested = 0;
+    srand(29);
+
+    for (int isa = ENCODER_SCALAR + 1; isa < ENCODER_ISAS; isa++) {
+        if (encoder_use(isa) != 0) {
+            printf("check_encoder: %s not available, skipped\n", isa_names[isa]);
+            continue;
+        }
+        tested++;
+
+        for (int round = 0; round < ROUNDS; round++) {
+            int n = (round < 130) ? round : rand() % (MAX_CELLS + 1);
+            for (int i = 0; i < n; i++) {
+                cells[i] = (round & 1) ? (unsigned char)(rand() % 7) : (unsigned char)rand();
+            }
+
+            for (int encoding = BOARD_ENCODING_RAW; encoding <= BOARD_ENCODING_PACKED4; encoding++) {
+                int size_expected = encode_with(ENCODER_SCALAR, cells, n, encoding, expected);
+                int size_got = encode_with(isa, cells, n, encoding, got);
+                if (size_got != encoded_size(n, encoding) || size_got != size_expected ||
+                    memcmp(expected, got, size_got) != 0) {
+                    printf("check_encoder: %s differs from scalar, encoding %d, %d cells\n", isa_names[isa], encoding, n);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    if (failures) return 1;
+    printf("check_encoder: ok (%d vector implementations)\n", tested);
+    return 0;
+}
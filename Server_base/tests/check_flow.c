@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "flow_field.h"
+#include "level_fixture.h"
+
+#define LEVELS 100
+#define MAX_SIDE 60
+#define STEPS 200 // jogadas por nível
+
+/*
+Equivalência do campo de distâncias com um BFS novo: em níveis aleatórios com monstros que
+perseguem ('H'), depois de cada jogada (pacman a andar, a entrar ou a morrer, ronda de monstros)
+as distâncias e a direção de flow_field_step em todas as posições livres têm de ser as de um BFS
+feito de raiz a partir dos pacmans vivos. Uma mudança que não marque o campo como desatualizado
+deixa-o com as distâncias de antes, e o BFS de referência apanha-a.
+*/
+
+static char dir[] = "/tmp/check_flow_XXXXXX";
+
+/*Função auxiliar com o movimento dos monstros: o primeiro persegue sempre, os outros às vezes andam ao acaso*/
+static const char *ghost_script(int ghost) {
+    return (ghost == 0 || rand() % 2) ? "H" : "R";
+}
+
+static int is_open(board_t *board, int x, int y) {
+    return x >= 0 && x < board->width && y >= 0 && y < board->height &&
+           board->board[y * board->width + x].content != 'W';
+}
+
+/*Função auxiliar que compara o campo com um BFS de raiz a partir dos pacmans vivos*/
+static int check_field(board_t *board, int *dist, int *queue) {
+    static const int dx[4] = { 0, -1, 0, 1 }, dy[4] = { -1, 0, 1, 0 };
+    int width = board->width, cells = board->width * board->height;
+
+    int head = 0, tail = 0;
+    for (int i = 0; i < cells; i++) dist[i] = FLOW_UNREACHABLE;
+    for (int p = 0; p < board->n_pacmans; p++) {
+        pacman_t *pac = &board->pacmans[p];
+        int source = pac->pos_y * width + pac->pos_x;
+        if (!pac->alive || dist[source] == 0) continue;
+        dist[source] = 0;
+        queue[tail++] = source;
+    }
+    while (head < tail) {
+        int v = queue[head++];
+        for (int d = 0; d < 4; d++) {
+            int nx = v % width + dx[d], ny = v / width + dy[d];
+            if (!is_open(board, nx, ny) || dist[ny * width + nx] != FLOW_UNREACHABLE) continue;
+            dist[ny * width + nx] = dist[v] + 1;
+            queue[tail++] = ny * width + nx;
+        }
+    }
+
+    for (int y = 0; y < board->height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (!is_open(board, x, y)) continue;
+            int best = dist[y * width + x];
+            char expected = 0;
+            for (int d = 0; d < 4; d++) {
+                int nx = x + dx[d], ny = y + dy[d];
+                if (is_open(board, nx, ny) && dist[ny * width + nx] < best) {
+                    best = dist[ny * width + nx];
+                    expected = "WASD"[d];
+                }
+            }
+
+            char step = flow_field_step(board, x, y);
+            if (step != expected || board->flow->dist[y * width + x] != dist[y * width + x]) {
+                printf("check_flow: %dx%d, (%d, %d) has distance %d and step '%c', expected %d and '%c'\n",
+                       board->width, board->height, x, y, board->flow->dist[y * width + x],
+                       step ? step : '-', dist[y * width + x], expected ? expected : '-');
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*Função auxiliar que joga STEPS jogadas aleatórias, comparando o campo depois de cada uma*/
+static int check_steps(board_t *board) {
+    int cells = board->width * board->height;
+    int *dist = malloc(cells * sizeof(int)), *queue = malloc(cells * sizeof(int));
+    if (!dist || !queue) {
+        free(dist);
+        free(queue);
+        return 1;
+    }
+
+    int failed = check_field(board, dist, queue); // ainda sem pacmans
+    for (int s = 0; s < STEPS && !failed; s++) {
+        int p = rand() % MAX_PACMANS;
+        pacman_t *pac = &board->pacmans[p];
+        int action = rand() % 10;
+
+        if (!pac->alive) {
+            if (action < 3) load_pacman_at(board, p, 0, rand() % board->width, rand() % board->height);
+        }
+        else if (action < 6) {
+            command_t command = { .command = "WASD"[rand() % 4], .turns = 1, .turns_left = 1 };
+            move_pacman(board, p, &command);
+        }
+        else if (action == 6) {
+            kill_pacman(board, p);
+        }
+        else {
+            move_ghosts(board, NULL);
+        }
+        failed = check_field(board, dist, queue);
+    }
+
+    free(dist);
+    free(queue);
+    return failed;
+}
+
+int main(void) {
+    if (!mkdtemp(dir)) {
+        perror("check_flow");
+        return 1;
+    }
+    srand(44);
+
+    int failures = 0, levels = 0;
+    for (int level = 0; level < LEVELS && !failures; level++) {
+        int width = 1 + rand() % MAX_SIDE, height = 1 + rand() % MAX_SIDE;
+        int n_ghosts = 0;
+        const char *name = fixture_write_level(dir, width, height, rand() % 50, 1 + rand() % 5, ghost_script, &n_ghosts);
+        if (name && n_ghosts > 0) {
+            board_t loaded = {0}, copy = {0};
+            if (load_level(&loaded, (char *)name, dir) != 0 || copy_level(&copy, &loaded) != 0 || !copy.flow) {
+                printf("check_flow: failed to load a %dx%d level\n", width, height);
+                fixture_remove_level(dir, n_ghosts);
+                failures++;
+                break;
+            }
+            failures += check_steps(&copy);
+            levels++;
+            unload_level(&copy);
+            unload_level(&loaded);
+        }
+        fixture_remove_level(dir, n_ghosts);
+    }
+    rmdir(dir);
+
+    if (failures) return 1;
+    printf("check_flow: ok (%d levels)\n", levels);
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "level_fixture.h"
+
+#define LEVELS 400
+#define MAX_SIDE 70
+#define CHARGES 200 // investidas por nível
+
+/*
+Equivalência das tabelas de paredes mais próximas (wall_left/right/up/down) com uma pesquisa
+célula a célula, em níveis aleatórios lidos do disco e nas cópias (copy_level). Depois, cada
+investida de move_ghost_charged tem de acabar onde acabaria andando célula a célula: antes da
+primeira parede ou monstro, ou em cima do primeiro pacman vivo, que morre.
+*/
+
+static char dir[] = "/tmp/check_walls_XXXXXX";
+
+/*Função auxiliar com o movimento dos monstros: andam para a direita, as investidas são forçadas*/
+static const char *ghost_script(int ghost) {
+    (void)ghost;
+    return "D";
+}
+
+static int is_wall(board_t *board, int x, int y) {
+    return board->board[y * board->width + x].content == 'W';
+}
+
+/*Função auxiliar que compara as tabelas com a parede mais próxima procurada célula a célula*/
+static int check_tables(board_t *board) {
+    for (int y = 0; y < board->height; y++) {
+        for (int x = 0; x < board->width; x++) {
+            int idx = y * board->width + x;
+            int left = x - 1, right = x + 1, up = y - 1, down = y + 1;
+            while (left >= 0 && !is_wall(board, left, y)) left--;
+            while (right < board->width && !is_wall(board, right, y)) right++;
+            while (up >= 0 && !is_wall(board, x, up)) up--;
+            while (down < board->height && !is_wall(board, x, down)) down++;
+            if (board->wall_left[idx] != left || board->wall_right[idx] != right ||
+                board->wall_up[idx] != up || board->wall_down[idx] != down) {
+                printf("check_walls: %dx%d, tables differ at (%d, %d)\n", board->width, board->height, x, y);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*Função auxiliar que faz uma investida célula a célula: devolve o resultado esperado e a paragem*/
+static int reference_charge(board_t *board, int ghost, char direction, int *stop_x, int *stop_y) {
+    int dx = (direction == 'D') - (direction == 'A');
+    int dy = (direction == 'S') - (direction == 'W');
+    int x = board->ghosts.pos_x[ghost], y = board->ghosts.pos_y[ghost];
+    *stop_x = x;
+    *stop_y = y;
+    if (x + dx < 0 || x + dx >= board->width || y + dy < 0 || y + dy >= board->height) return INVALID_MOVE;
+
+    for (x += dx, y += dy; x >= 0 && x < board->width && y >= 0 && y < board->height; x += dx, y += dy) {
+        if (is_wall(board, x, y)) break;
+        int entity = board->occupant[y * board->width + x];
+        if (entity >= MAX_PACMANS) break;
+        if (entity != NO_ENTITY && board->pacmans[entity].alive) {
+            *stop_x = x;
+            *stop_y = y;
+            return DEAD_PACMAN;
+        }
+        *stop_x = x;
+        *stop_y = y;
+    }
+    return VALID_MOVE;
+}
+
+/*Função auxiliar que confirma que occupant e os bitboards de monstros e pacmans batem com as posições*/
+static int check_occupants(board_t *board) {
+    int cells = board->width * board->height;
+    for (int i = 0; i < cells; i++) {
+        int expected = NO_ENTITY;
+        for (int g = 0; g < board->n_ghosts; g++) {
+            if (board->ghosts.pos_y[g] * board->width + board->ghosts.pos_x[g] == i) expected = GHOST_ENTITY(g);
+        }
+        for (int p = 0; p < board->n_pacmans && expected == NO_ENTITY; p++) {
+            pacman_t *pac = &board->pacmans[p];
+            if (pac->alive && pac->pos_y * board->width + pac->pos_x == i) expected = p;
+        }
+        if (board->occupant[i] != expected || bit_test(board->ghost_cells, i) != (expected >= MAX_PACMANS) ||
+            bit_test(board->pacman_cells, i) != (expected != NO_ENTITY && expected < MAX_PACMANS)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*Função auxiliar que põe pacmans em posições aleatórias e compara CHARGES investidas*/
+static int check_charges(board_t *board) {
+    int open = 0;
+    for (int i = 0; i < board->width * board->height; i++) open += (board->board[i].content != 'W');
+
+    for (int p = 0; p < MAX_PACMANS && open > board->n_ghosts + p; p++) {
+        if (rand() % 4 == 0) continue;
+        load_pacman_at(board, p, 0, rand() % board->width, rand() % board->height);
+    }
+
+    for (int c = 0; c < CHARGES && board->n_ghosts > 0; c++) {
+        int ghost = rand() % board->n_ghosts;
+        char direction = "WASD"[rand() % 4];
+        int stop_x, stop_y;
+        int expected = reference_charge(board, ghost, direction, &stop_x, &stop_y);
+
+        int result = move_ghost_charged(board, ghost, direction);
+        if (result != expected || board->ghosts.pos_x[ghost] != stop_x || board->ghosts.pos_y[ghost] != stop_y) {
+            printf("check_walls: %dx%d, charge %c of ghost %d gave %d at (%d, %d), expected %d at (%d, %d)\n",
+                   board->width, board->height, direction, ghost, result,
+                   board->ghosts.pos_x[ghost], board->ghosts.pos_y[ghost], expected, stop_x, stop_y);
+            return 1;
+        }
+        if (check_occupants(board)) {
+            printf("check_walls: %dx%d, occupants out of sync after charge %c of ghost %d\n",
+                   board->width, board->height, direction, ghost);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void) {
+    if (!mkdtemp(dir)) {
+        perror("check_walls");
+        return 1;
+    }
+    srand(41);
+
+    int failures = 0;
+    for (int level = 0; level < LEVELS && !failures; level++) {
+        int width = 1 + rand() % MAX_SIDE, height = 1 + rand() % MAX_SIDE;
+        int n_ghosts;
+        const char *name = fixture_write_level(dir, width, height, rand() % 60, rand() % 7, ghost_script, &n_ghosts);
+        if (!name) {
+            fixture_remove_level(dir, n_ghosts);
+            failures++;
+            break;
+        }
+
+        board_t loaded = {0}, copy = {0};
+        if (load_level(&loaded, (char *)name, dir) != 0 || copy_level(&copy, &loaded) != 0) {
+            printf("check_walls: failed to load a %dx%d level\n", width, height);
+            fixture_remove_level(dir, n_ghosts);
+            failures++;
+            break;
+        }
+        failures += check_tables(&loaded) + check_tables(&copy);
+        if (!failures) failures += check_charges(&copy);
+        unload_level(&copy);
+        unload_level(&loaded);
+        fixture_remove_level(dir, n_ghosts);
+    }
+    rmdir(dir);
+
+    if (failures) return 1;
+    printf("check_walls: ok (%d levels)\n", LEVELS);
+    return 0;
+}
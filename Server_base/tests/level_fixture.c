@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "level_fixture.h"
+
+/*
+Níveis aleatórios em disco para as verificações que carregam níveis com load_level
+(check_walls, check_flow): o mesmo formato que o parser lê, com um ficheiro por monstro.
+*/
+
+const char *fixture_write_level(const char *dir, int width, int height, int density, int ghosts,
+                                const char *(*script)(int ghost), int *n_ghosts) {
+    char path[MAX_FILENAME];
+    *n_ghosts = 0;
+    if (ghosts > MAX_GHOSTS) ghosts = MAX_GHOSTS;
+
+    char *grid = malloc(width * height);
+    if (!grid) return NULL;
+    for (int i = 0; i < width * height; i++) grid[i] = (rand() % 100 < density) ? 'X' : 'o';
+
+    // 1. Monstros em posições livres e distintas
+    int pos[MAX_GHOSTS];
+    int placed = 0;
+    for (int tries = 0; placed < ghosts && tries < 100; tries++) {
+        int idx = rand() % (width * height);
+        if (grid[idx] != 'o') continue;
+        grid[idx] = 'M';
+        pos[placed++] = idx;
+    }
+
+    // 2. Ficheiros dos monstros primeiro, para o remove os apagar mesmo que o nível falhe
+    for (int g = 0; g < placed; g++) {
+        snprintf(path, sizeof(path), "%s/g%d.m", dir, g);
+        FILE *f = fopen(path, "w");
+        if (!f) {
+            free(grid);
+            return NULL;
+        }
+        *n_ghosts = g + 1;
+        fprintf(f, "POS %d %d\n%s\n", pos[g] % width, pos[g] / width, script(g));
+        fclose(f);
+    }
+
+    // 3. O nível
+    snprintf(path, sizeof(path), "%s/%s", dir, FIXTURE_LEVEL);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        free(grid);
+        return NULL;
+    }
+    fprintf(f, "DIM %d %d\nTEMPO 10\n", width, height);
+    if (placed) {
+        fprintf(f, "MON");
+        for (int g = 0; g < placed; g++) fprintf(f, " g%d.m", g);
+        fprintf(f, "\n");
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) fputc(grid[y * width + x] == 'X' ? 'X' : 'o', f);
+        fputc('\n', f);
+    }
+    fclose(f);
+    free(grid);
+    return FIXTURE_LEVEL;
+}
+
+void fixture_remove_level(const char *dir, int n_ghosts) {
+    char path[MAX_FILENAME];
+    for (int g = 0; g < n_ghosts; g++) {
+        snprintf(path, sizeof(path), "%s/g%d.m", dir, g);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, FIXTURE_LEVEL);
+    unlink(path);
+}
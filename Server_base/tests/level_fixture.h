@@ -0,0 +1,16 @@
+#ifndef LEVEL_FIXTURE_H
+#define LEVEL_FIXTURE_H
+
+#define FIXTURE_LEVEL "level.lvl" // nome do nível escrito, relativo à pasta
+
+/*Escreve na pasta dir um nível aleatório width x height com paredes em density% das posições e
+até ghosts monstros em posições livres e distintas, cada um com o seu ficheiro de movimento
+(script(g) dá a linha do monstro g, p.e. "D" ou "H"). Devolve FIXTURE_LEVEL, ou NULL se não
+conseguiu escrever; *n_ghosts fica com os monstros colocados, mesmo em erro*/
+const char *fixture_write_level(const char *dir, int width, int height, int density, int ghosts,
+                                const char *(*script)(int ghost), int *n_ghosts);
+
+/*Apaga da pasta dir o nível e os ficheiros dos n_ghosts monstros*/
+void fixture_remove_level(const char *dir, int n_ghosts);
+
+#endif
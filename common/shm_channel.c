@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shm_channel.h"
+#include "debug.h"
+
+// Canal a que esta tarefa está a aceder, para o SIGBUS saber se a falta é dele
+static __thread shm_channel_t *touching = NULL;
+
+static pthread_once_t sigbus_once = PTHREAD_ONCE_INIT;
+static struct sigaction sigbus_previous;
+
+/*Dorme enquanto *word == expected (futex partilhado entre processos)*/
+static void futex_wait(unsigned int *word, unsigned int expected, int timeout_ms) {
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, (timeout_ms >= 0) ? &ts : NULL, NULL, 0);
+}
+
+static void futex_wake(unsigned int *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/*Segmento encolhido pelo outro lado: as páginas depois do fim davam SIGBUS.
+Se a falta é no canal a que a tarefa está a aceder, o mapeamento passa a memória anónima
+(a instrução repete-se e continua) e o canal fica partido; senão volta o tratamento anterior*/
+static void sigbus_handler(int sig, siginfo_t *info, void *context) {
+    (void)sig;
+    (void)context;
+    shm_channel_t *channel = touching;
+    char *addr = info->si_addr;
+
+    if (channel) {
+        char *base = (char *)channel->shared;
+        if (addr >= base && addr < base + channel->size &&
+            mmap(base, channel->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0) != MAP_FAILED) {
+            channel->broken = 1;
+            return;
+        }
+    }
+    sigaction(SIGBUS, &sigbus_previous, NULL);
+}
+
+static void sigbus_install(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = sigbus_handler;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, &sigbus_previous);
+}
+
+static void begin_access(shm_channel_t *channel) {
+    touching = channel;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static void end_access(void) {
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    touching = NULL;
+}
+
+/*Função auxiliar que cria o lado privado de um segmento já mapeado e validado*/
+static shm_channel_t *channel_wrap(shm_segment_t *shared, size_t size, int slot_capacity) {
+    shm_channel_t *channel = malloc(sizeof(shm_channel_t));
+    if (!channel) {
+        munmap(shared, size);
+        return NULL;
+    }
+    channel->shared = shared;
+    channel->size = size;
+    channel->slot_capacity = slot_capacity;
+    channel->broken = 0;
+    channel->nudge_fd = -1;
+    pthread_once(&sigbus_once, sigbus_install);
+    return channel;
+}
+
+size_t shm_channel_size(int slot_capacity) {
+    return sizeof(shm_segment_t) + 2 * (size_t)slot_capacity;
+}
+
+shm_channel_t *shm_channel_create(const char *name, int slot_capacity) {
+    size_t size = shm_channel_size(slot_capacity);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) {
+        debug("Failed to create shared memory %s\n", name);
+        return NULL;
+    }
+    if (ftruncate(fd, size) == -1) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    shm_segment_t *shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    memset(shared, 0, sizeof(shm_segment_t));
+    shared->slot_capacity = slot_capacity;
+    return channel_wrap(shared, size, slot_capacity);
+}
+
+shm_channel_t *shm_channel_attach(const char *name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1) {
+        debug("Failed to open shared memory %s\n", name);
+        return NULL;
+    }
+
+    // 1. O tamanho vem do fstat, não do cabeçalho que o cliente escreve
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(shm_segment_t) ||
+        (st.st_size - sizeof(shm_segment_t)) % 2 != 0 || (st.st_size - sizeof(shm_segment_t)) / 2 > INT_MAX) {
+        debug("Shared memory %s has an invalid size\n", name);
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    int slot_capacity = (int)((size - sizeof(shm_segment_t)) / 2);
+
+    shm_segment_t *shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) return NULL;
+
+    // 2. A capacidade anunciada tem de corresponder ao tamanho; daqui em diante só se usa a validada
+    shm_channel_t *channel = channel_wrap(shared, size, slot_capacity);
+    if (!channel) return NULL;
+
+    begin_access(channel);
+    int announced = __atomic_load_n(&shared->slot_capacity, __ATOMIC_RELAXED);
+    end_access();
+    if (channel->broken || announced != slot_capacity || slot_capacity <= 0) {
+        debug("Shared memory %s has an invalid layout\n", name);
+        shm_channel_detach(channel);
+        return NULL;
+    }
+    return channel;
+}
+
+void shm_channel_detach(shm_channel_t *channel) {
+    if (!channel) return;
+    munmap(channel->shared, channel->size);
+    free(channel);
+}
+
+int shm_channel_push_input(shm_channel_t *channel, char op, char command) {
+    shm_segment_t *shared = channel->shared;
+    begin_access(channel);
+
+    unsigned int tail = __atomic_load_n(&shared->input_tail, __ATOMIC_RELAXED);
+    unsigned int head = __atomic_load_n(&shared->input_head, __ATOMIC_ACQUIRE);
+    if (tail - head == SHM_INPUT_RING_SIZE) {
+        end_access();
+        return channel->broken ? -1 : 1;
+    }
+
+    char *slot = shared->input[tail & (SHM_INPUT_RING_SIZE - 1)];
+    slot[0] = op;
+    slot[1] = command;
+    __atomic_store_n(&shared->input_tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    // Só há syscall se o servidor estiver à espera, pelo meio que ele anunciou
+    unsigned int waiting = __atomic_exchange_n(&shared->input_waiting, 0, __ATOMIC_SEQ_CST);
+    end_access();
+    if (channel->broken) return -1;
+    if (waiting == SHM_WAIT_FUTEX) futex_wake(&shared->input_tail);
+    else if (waiting == SHM_WAIT_NUDGE && channel->nudge_fd != -1 && write(channel->nudge_fd, "", 1) == -1) {
+        debug("Failed to wake the server through the request pipe\n");
+    }
+    return channel->broken ? -1 : 0;
+}
+
+int shm_channel_pop_input(shm_channel_t *channel, char *out, int timeout_ms) {
+    shm_segment_t *shared = channel->shared;
+    begin_access(channel);
+
+    int waited = 0, result = 0;
+    while (!channel->broken) {
+        unsigned int head = __atomic_load_n(&shared->input_head, __ATOMIC_RELAXED);
+        unsigned int tail = __atomic_load_n(&shared->input_tail, __ATOMIC_ACQUIRE);
+
+        if (head != tail) {
+            char *slot = shared->input[head & (SHM_INPUT_RING_SIZE - 1)];
+            out[0] = slot[0];
+            out[1] = slot[1];
+            __atomic_store_n(&shared->input_head, head + 1, __ATOMIC_RELEASE);
+            result = 1;
+            break;
+        }
+        if (waited || timeout_ms == 0) break;
+
+        // Anunciar a espera e voltar a verificar antes de dormir
+        __atomic_store_n(&shared->input_waiting, SHM_WAIT_FUTEX, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&shared->input_tail, __ATOMIC_SEQ_CST) != head) continue;
+        if (!channel->broken) futex_wait(&shared->input_tail, head, timeout_ms);
+        waited = 1;
+    }
+    end_access();
+    return channel->broken ? -1 : result;
+}
+
+int shm_channel_arm_nudge(shm_channel_t *channel) {
+    shm_segment_t *shared = channel->shared;
+    begin_access(channel);
+
+    // Anunciar e voltar a verificar: uma jogada entretanto já não escreve no fd
+    __atomic_store_n(&shared->input_waiting, SHM_WAIT_NUDGE, __ATOMIC_SEQ_CST);
+    unsigned int head = __atomic_load_n(&shared->input_head, __ATOMIC_RELAXED);
+    int pending = __atomic_load_n(&shared->input_tail, __ATOMIC_SEQ_CST) != head;
+    end_access();
+    return channel->broken ? -1 : pending;
+}
+
+char *shm_channel_begin_frame(shm_channel_t *channel) {
+    shm_segment_t *shared = channel->shared;
+    begin_access(channel);
+
+    // Escreve sempre no slot que não tem o último frame publicado
+    int slot = (shared->frame_seq + 1) & 1;
+    __atomic_store_n(&shared->slots[slot].seq, shared->slots[slot].seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return shared->data + slot * (size_t)channel->slot_capacity;
+}
+
+int shm_channel_commit_frame(shm_channel_t *channel, int size) {
+    shm_segment_t *shared = channel->shared;
+
+    int slot = (shared->frame_seq + 1) & 1;
+    shared->slots[slot].size = size;
+    __atomic_store_n(&shared->slots[slot].seq, shared->slots[slot].seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&shared->frame_seq, shared->frame_seq + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_exchange_n(&shared->frame_waiting, 0, __ATOMIC_SEQ_CST) && !channel->broken) {
+        futex_wake(&shared->frame_seq);
+    }
+    end_access();
+    return channel->broken ? -1 : 0;
+}
+
+int shm_channel_wait_frame(shm_channel_t *channel, unsigned int *last_seq, char *out, int capacity, int timeout_ms) {
+    shm_segment_t *shared = channel->shared;
+    begin_access(channel);
+
+    int waited = 0, result = -1;
+    while (!channel->broken) {
+        unsigned int seq = __atomic_load_n(&shared->frame_seq, __ATOMIC_ACQUIRE);
+
+        if (seq == *last_seq) {
+            if (waited) {
+                result = 0;
+                break;
+            }
+            __atomic_store_n(&shared->frame_waiting, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&shared->frame_seq, __ATOMIC_SEQ_CST) != seq) continue;
+            futex_wait(&shared->frame_seq, seq, timeout_ms);
+            waited = 1;
+            continue;
+        }
+
+        // O frame número seq está no slot seq & 1, lido com seqlock
+        int slot = seq & 1;
+        unsigned int before = __atomic_load_n(&shared->slots[slot].seq, __ATOMIC_ACQUIRE);
+        if (before & 1) continue;
+
+        int size = shared->slots[slot].size;
+        if (size < 0 || size > channel->slot_capacity || size > capacity) break;
+        memcpy(out, shared->data + slot * (size_t)channel->slot_capacity, size);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->slots[slot].seq, __ATOMIC_RELAXED) != before) continue;
+
+        *last_seq = seq;
+        result = size;
+        break;
+    }
+    end_access();
+    return channel->broken ? -1 : result;
+}
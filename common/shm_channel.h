@@ -0,0 +1,82 @@
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+
+#include <stddef.h>
+
+#define SHM_INPUT_RING_SIZE 64 // potência de 2
+
+// Como o servidor espera por jogadas (input_waiting), para o cliente saber como o acordar
+#define SHM_WAIT_FUTEX 1 // a dormir no futex de input_tail
+#define SHM_WAIT_NUDGE 2 // à espera por poll no fd de pedidos (corrotinas): o cliente escreve lá um byte
+
+/*
+Segmento partilhado entre um cliente e o servidor, criado pelo cliente:
+  - anel SPSC de jogadas (cliente produz, servidor consome)
+  - dois slots de frame (servidor escreve alternadamente, cliente lê o último publicado)
+Quem espera dorme num futex sobre o contador que o outro lado avança, ou (servidor em corrotina)
+espera por poll no fd de pedidos, e o outro lado só o acorda se houver alguém à espera.
+Tudo o que está aqui pode ser mudado pelo outro processo a qualquer momento.
+*/
+typedef struct {
+    unsigned int input_head;    // próxima jogada a consumir (servidor)
+    unsigned int input_tail;    // próxima posição livre (cliente), palavra do futex do servidor
+    unsigned int input_waiting; // servidor à espera (SHM_WAIT_*), 0 se está acordado
+    char input[SHM_INPUT_RING_SIZE][2]; // OP + comando, como no pipe de pedidos
+
+    unsigned int frame_seq;     // número do último frame publicado, palavra do futex do cliente
+    unsigned int frame_waiting; // cliente a dormir no futex
+    int slot_capacity;          // bytes de cada slot, só lido ao mapear
+    struct {
+        unsigned int seq;       // seqlock: ímpar enquanto o servidor escreve
+        int size;
+    } slots[2];
+    char data[];                // 2 * slot_capacity
+} shm_segment_t;
+
+/*
+Lado privado do canal em cada processo: o tamanho e a capacidade validados ao mapear,
+os únicos usados depois. Se o outro lado encolher o segmento (ftruncate), o acesso que
+daria SIGBUS passa a ver memória anónima e o canal fica marcado como partido.
+*/
+typedef struct {
+    shm_segment_t *shared;
+    size_t size;                // bytes mapeados
+    int slot_capacity;          // bytes de cada slot
+    volatile int broken;        // o segmento deixou de ser válido
+    int nudge_fd;               // cliente: fd de pedidos, onde acorda um servidor em SHM_WAIT_NUDGE (-1 = nenhum)
+} shm_channel_t;
+
+/*Tamanho total do segmento para slots com a capacidade indicada*/
+size_t shm_channel_size(int slot_capacity);
+
+/*Cria e mapeia o segmento (lado do cliente)*/
+shm_channel_t *shm_channel_create(const char *name, int slot_capacity);
+
+/*Mapeia um segmento criado pelo cliente (lado do servidor)*/
+shm_channel_t *shm_channel_attach(const char *name);
+
+void shm_channel_detach(shm_channel_t *channel);
+
+/*Cliente: coloca uma jogada no anel, devolve 1 se o anel estiver cheio, -1 se o canal está partido*/
+int shm_channel_push_input(shm_channel_t *channel, char op, char command);
+
+/*Servidor: retira uma jogada, devolve 1 se leu, 0 se passou timeout_ms sem jogadas,
+-1 se o canal está partido. Com timeout_ms 0 só consulta o anel, sem anunciar espera*/
+int shm_channel_pop_input(shm_channel_t *channel, char *out, int timeout_ms);
+
+/*Servidor: anuncia que vai esperar por poll no fd de pedidos (SHM_WAIT_NUDGE), para a próxima
+jogada o acordar por lá. Devolve 1 se já há jogadas (não deve esperar), -1 se o canal está partido*/
+int shm_channel_arm_nudge(shm_channel_t *channel);
+
+/*Servidor: devolve o slot onde escrever o próximo frame, sem cópias intermédias.
+Até ao shm_channel_commit_frame a tarefa fica protegida contra o segmento encolher*/
+char *shm_channel_begin_frame(shm_channel_t *channel);
+
+/*Servidor: publica o frame escrito em shm_channel_begin_frame, devolve -1 se o canal está partido*/
+int shm_channel_commit_frame(shm_channel_t *channel, int size);
+
+/*Cliente: espera por um frame mais recente que *last_seq e copia-o para out.
+Devolve o tamanho, 0 se passou timeout_ms, -1 se o frame não couber em out ou o canal está partido*/
+int shm_channel_wait_frame(shm_channel_t *channel, unsigned int *last_seq, char *out, int capacity, int timeout_ms);
+
+#endif
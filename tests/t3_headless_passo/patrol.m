@@ -0,0 +1,6 @@
+PASSO 1
+POS 1 7
+D
+D
+A
+A
@@ -0,0 +1,10 @@
+# caminho exato até ao portal: uma jogada perdida no passo deixa o pacman parado longe dele
+PASSO 2
+POS 1 1
+REPEAT 7
+D
+END
+REPEAT 7
+S
+END
+T 1000000